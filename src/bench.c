@@ -0,0 +1,243 @@
+/** @file bench.c
+ *
+ * @brief Benchmark of the load path of songs and soundfonts: every file of the catalogs of ./songs and ./soundfonts
+ * goes through the steps synthi uses when LOAD is pressed (catalog lookup, file type check, song analysis, player
+ * creation and parsing, mapping of compiled song, soundfont load), first with the file out of page cache (cold), then
+ * in page cache (warm). In cold runs, files are removed from page cache again before each step reading them, as the
+ * previous step has read them in page cache.
+ * One JSON object is written per file and per run on stdout, to be kept and compared over time.
+ *
+ * usage: synthi_bench.a [-l]		-l: lazy loading of samples (synth.dynamic-sample-loading), as in config file
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "main.h"
+#include "catalog.h"
+#include "metadata.h"
+#include "song.h"
+#include "utils.h"
+
+
+// results of one run of one file, in microseconds and bytes
+typedef struct {
+	uint64_t lookup;			// catalog lookup
+	uint64_t check;				// fluid_is_midifile or fluid_is_soundfont
+	uint64_t analyze;			// songs: analysis of midi file (done when metadata cache is outdated)
+	uint64_t load;				// songs: player creation, file added and parsed; soundfonts: fluid_synth_sfload
+	uint64_t compiled;			// songs: compiled song mapped in memory (0 if song is not compiled)
+	uint64_t total;
+	long size;					// size of file
+	long rss;					// resident memory added by load, in kB
+} result_t;
+
+
+// resident memory of the process, in kB
+static long rss_kb ()
+{
+	FILE *f;
+	long size, resident = 0;
+
+	if ((f = fopen ("/proc/self/statm", "r")) == NULL) return 0;
+	if (fscanf (f, "%ld %ld", &size, &resident) != 2) resident = 0;
+	fclose (f);
+	return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+
+// remove file from page cache, so that it is read from SD card again; returns size of file
+static long evict (char *name)
+{
+	int fd;
+	struct stat st;
+
+	if ((fd = open (name, O_RDONLY)) < 0) return 0;
+	if (fstat (fd, &st) < 0) st.st_size = 0;
+	posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+	close (fd);
+	return st.st_size;
+}
+
+
+// write name as a JSON string
+static void print_json_string (char *name)
+{
+	putchar ('"');
+	for (; *name; name++) {
+		if ((*name == '"') || (*name == '\\')) putchar ('\\');
+		if ((unsigned char) *name < 0x20) printf ("\\u%04x", *name);
+		else putchar (*name);
+	}
+	putchar ('"');
+}
+
+
+// write result of a run as one line of JSON
+static void print_result (char *kind, char *name, char *cache, result_t *res)
+{
+	printf ("{\"kind\":\"%s\",\"file\":", kind);
+	print_json_string (name);
+	printf (",\"cache\":\"%s\",\"bytes\":%ld,\"lookup_us\":%llu,\"check_us\":%llu,\"analyze_us\":%llu,\"load_us\":%llu,\"compiled_us\":%llu,\"total_us\":%llu,"
+		"\"mb_per_s\":%.2f,\"rss_delta_kb\":%ld}\n", cache, res->size, (unsigned long long) res->lookup, (unsigned long long) res->check,
+		(unsigned long long) res->analyze, (unsigned long long) res->load, (unsigned long long) res->compiled, (unsigned long long) res->total,
+		(res->total > 0) ? (double) res->size / (double) res->total : 0.0, res->rss);
+	fflush (stdout);
+}
+
+
+// run load path of song number of bank; if cold, midi file and compiled song are out of page cache at each step
+static int bench_song (int bank, int number, int cold, result_t *res)
+{
+	char name [PATH_LEN], file [PATH_LEN];
+	metadata_t md;
+	fluid_player_t *player;
+	seq_t seq;
+	float left [64], right [64];
+	uint64_t t0, t1;
+	long rss;
+
+	memset (res, 0, sizeof (result_t));
+	rss = rss_kb ();
+	t0 = micros ();
+	if (!catalog_lookup (0, bank, number, name, NULL)) return FALSE;
+	t1 = micros ();
+	res->lookup = t1 - t0;
+
+	if (cold) evict (name);
+	t0 = micros ();
+	if (!fluid_is_midifile (name)) return FALSE;
+	t1 = micros ();
+	res->check = t1 - t0;
+
+	if (cold) evict (name);
+	t0 = micros ();
+	metadata_analyze (name, &md);
+	t1 = micros ();
+	res->analyze = t1 - t0;
+
+	// player parses the file when it starts playing: render one block to have it parsed
+	if (cold) evict (name);
+	t0 = micros ();
+	player = new_fluid_player (synth);
+	if (player == NULL) return FALSE;
+	fluid_player_add (player, name);
+	fluid_player_play (player);
+	fluid_synth_write_float (synth, 64, left, 0, 1, right, 0, 1);
+	t1 = micros ();
+	res->load = t1 - t0;
+	res->rss = rss_kb () - rss;
+
+	fluid_player_stop (player);
+	delete_fluid_player (player);
+	fluid_synth_system_reset (synth);
+
+	// compiled song, loaded instead of the midi file when it is up to date
+	memset (&seq, 0, sizeof (seq_t));
+	song_file (name, file);
+	if (cold) evict (file);
+	t0 = micros ();
+	if (song_map (name, &seq) == EXIT_SUCCESS) {
+		t1 = micros ();
+		res->compiled = t1 - t0;
+		song_unmap (&seq);
+	}
+
+	res->total = res->lookup + res->check + res->analyze + res->load;
+	return TRUE;
+}
+
+
+// run load path of soundfont number of bank; if cold, soundfont is out of page cache at each step
+static int bench_soundfont (int bank, int number, int cold, result_t *res)
+{
+	char name [PATH_LEN];
+	uint64_t t0, t1;
+	long rss;
+	int id;
+
+	memset (res, 0, sizeof (result_t));
+	rss = rss_kb ();
+	t0 = micros ();
+	if (!catalog_lookup (1, bank, number, name, NULL)) return FALSE;
+	t1 = micros ();
+	res->lookup = t1 - t0;
+
+	if (cold) evict (name);
+	t0 = micros ();
+	if (!fluid_is_soundfont (name)) return FALSE;
+	t1 = micros ();
+	res->check = t1 - t0;
+
+	if (cold) evict (name);
+	t0 = micros ();
+	id = fluid_synth_sfload (synth, name, TRUE);
+	t1 = micros ();
+	if (id == FLUID_FAILED) return FALSE;
+	res->load = t1 - t0;
+	res->rss = rss_kb () - rss;
+
+	fluid_synth_sfunload (synth, id, TRUE);
+
+	res->total = res->lookup + res->check + res->load;
+	return TRUE;
+}
+
+
+int main (int argc, char *argv [])
+{
+	char name [PATH_LEN];
+	result_t res;
+	uint64_t t0;
+	int bank, number, lazy = FALSE;
+	long size;
+
+	if ((argc >= 2) && !strcmp (argv [1], "-l")) lazy = TRUE;
+
+	// synth without audio driver: blocks are rendered by the benchmark itself
+	settings = new_fluid_settings ();
+	fluid_settings_setint (settings, "synth.dynamic-sample-loading", lazy);
+	synth = new_fluid_synth (settings);
+	if (synth == NULL) {
+		fprintf ( stderr, "unable to create synth.\n" );
+		exit ( 1 );
+	}
+
+	// catalogs, as at startup
+	metadata_init ();
+	t0 = micros ();
+	catalog_build (0);
+	catalog_build (1);
+	printf ("{\"kind\":\"catalog\",\"total_us\":%llu,\"rss_kb\":%ld}\n", (unsigned long long) (micros () - t0), rss_kb ());
+
+	// each file: cold run (files removed from page cache before each step), then warm run (files left in page cache by cold run)
+	for (bank = 0; bank < MAX_BANKS; bank++) {
+		for (number = 0; number < 256; number++) {
+			if (!catalog_lookup (0, bank, number, name, NULL)) continue;
+			size = evict (name);
+			if (!bench_song (bank, number, TRUE, &res)) continue;
+			res.size = size;
+			print_result ("song", name, "cold", &res);
+			if (!bench_song (bank, number, FALSE, &res)) continue;
+			res.size = size;
+			print_result ("song", name, "warm", &res);
+		}
+	}
+
+	for (bank = 0; bank < MAX_BANKS; bank++) {
+		for (number = 0; number < 256; number++) {
+			if (!catalog_lookup (1, bank, number, name, NULL)) continue;
+			size = evict (name);
+			if (!bench_soundfont (bank, number, TRUE, &res)) continue;
+			res.size = size;
+			print_result ("soundfont", name, "cold", &res);
+			if (!bench_soundfont (bank, number, FALSE, &res)) continue;
+			res.size = size;
+			print_result ("soundfont", name, "warm", &res);
+		}
+	}
+
+	delete_fluid_synth (synth);
+	delete_fluid_settings (settings);
+	return 0;
+}
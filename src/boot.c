@@ -0,0 +1,104 @@
+/** @file boot.c
+ *
+ * @brief Staged startup: jack client, ports and surface are made ready first, then default soundfont is loaded by a
+ * boot thread while main thread already serves events. Each phase of startup is timed and logged on stderr.
+ *
+ */
+
+#include <pthread.h>
+#include <time.h>
+#include "types.h"
+#include "globals.h"
+#include "boot.h"
+#include "utils.h"
+
+
+// time of start of synthi, and of last phase traced
+static struct timespec start, last;
+
+// default soundfont loaded by boot thread in loader synth, once for main synth and once for each part; taken by main thread
+static int boot_sf2_id [MAX_PARTS];
+static int is_booted = FALSE;
+
+
+// number of ms between 2 times
+static long elapsed_ms (struct timespec *from, struct timespec *to)
+{
+	return ((to->tv_sec - from->tv_sec) * 1000) + ((to->tv_nsec - from->tv_nsec) / 1000000);
+}
+
+
+// start timing of startup phases; called first thing in main ()
+void boot_trace_start ()
+{
+	clock_gettime (CLOCK_MONOTONIC, &start);
+	last = start;
+}
+
+
+// log end of a startup phase: its duration, time since start of synthi and time since power on
+// (boot time of the whole system is then visible: jackd, a2jmidid, boocli...)
+void boot_trace (char *phase)
+{
+	struct timespec now, power_on;
+
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	clock_gettime (CLOCK_BOOTTIME, &power_on);
+	fprintf ( stderr, "boot: %-24s %6ld ms  (total %6ld ms, %ld.%03ld s since power on)\n", phase, elapsed_ms (&last, &now),
+		elapsed_ms (&start, &now), (long) power_on.tv_sec, power_on.tv_nsec / 1000000 );
+	last = now;
+}
+
+
+// boot thread: load default soundfont in loader synth, which does not render; main thread is woken up when done
+// soundfont is loaded for each synth of parts too: its samples are only read once, and shared by fluidsynth
+static void *boot_thread (void *arg)
+{
+	int p, is_sf2;
+
+	is_sf2 = fluid_is_soundfont (DEFAULT_SF2);
+	for (p = 0; p < nb_parts; p++) {
+		boot_sf2_id [p] = is_sf2 ? fluid_synth_sfload (loader_synth, DEFAULT_SF2, FALSE) : FLUID_FAILED;
+	}
+	if (boot_sf2_id [0] == FLUID_FAILED) fprintf ( stderr, "Unable to load default soundfont %s.\n", DEFAULT_SF2 );
+
+	__atomic_store_n (&is_booted, TRUE, __ATOMIC_RELEASE);
+	wakeup_main ();
+	return NULL;
+}
+
+
+// start loading default soundfont in background; it is loaded at once if boot thread can't be started
+void boot_start ()
+{
+	pthread_t thread;
+
+	if (pthread_create (&thread, NULL, boot_thread, NULL) != 0) {
+		boot_thread (NULL);
+		return;
+	}
+	pthread_detach (thread);
+}
+
+
+// once boot thread is done, move default soundfont to synth, and to synths of parts; returns FALSE while default soundfont is still loading
+// default soundfont will always be in memory and will never be unloaded, to avoid sound issues
+int boot_done (fluid_synth_t *synth)
+{
+	fluid_sfont_t *sfont;
+	int p;
+
+	if (!__atomic_load_n (&is_booted, __ATOMIC_ACQUIRE)) return FALSE;
+
+	for (p = 0; p < nb_parts; p++) {
+		if (boot_sf2_id [p] == FLUID_FAILED) continue;
+		sfont = fluid_synth_get_sfont_by_id (loader_synth, boot_sf2_id [p]);
+		fluid_synth_remove_sfont (loader_synth, sfont);
+		if (p == 0) default_sf2_id = fluid_synth_add_sfont (synth, sfont);
+		else fluid_synth_add_sfont (part_synth [p], sfont);
+		// channels select their default preset in default soundfont
+		fluid_synth_program_reset ((p == 0) ? synth : part_synth [p]);
+	}
+	boot_trace ("default soundfont");
+	return TRUE;
+}
@@ -0,0 +1,10 @@
+/** @file boot.h
+ *
+ * @brief This file defines prototypes of functions inside boot.c
+ *
+ */
+
+void boot_trace_start ();
+void boot_trace (char *);
+void boot_start ();
+int boot_done (fluid_synth_t *);
@@ -0,0 +1,217 @@
+/** @file calibrate.c
+ *
+ * @brief Calibration of synthesis settings on this device: a reference workload (all channels playing, voices kept
+ * at polyphony) is rendered with default soundfont for each candidate setting (interpolation, polyphony, reverb, chorus,
+ * number of cores used for rendering), and the time taken by each block is measured against the period of jack.
+ * Setting of best quality which stays within budget is written in calibration profile, loaded by synthi at startup.
+ * Run it from synthi directory, with jack running as for synthi but with synthi stopped (otherwise it measures both).
+ *
+ * usage: synthi_calibrate.a (config file) (sample rate) (period)		sample rate and period are taken from jack if not given
+ */
+
+#include "types.h"
+#include "main.h"
+#include "config.h"
+#include "profile.h"
+#include "utils.h"
+
+
+// candidate values, from best to lowest quality
+static const int polyphony [] = { 256, 192, 128, 64 };
+static const int interpolation [] = { FLUID_INTERP_7THORDER, FLUID_INTERP_4THORDER, FLUID_INTERP_LINEAR };
+#define NB_POLYPHONY (sizeof (polyphony) / sizeof (polyphony [0]))
+#define NB_INTERPOLATION (sizeof (interpolation) / sizeof (interpolation [0]))
+
+// candidates: quality is ranked by polyphony first, then reverb, chorus and interpolation
+#define NB_CANDIDATES (NB_POLYPHONY * 2 * 2 * NB_INTERPOLATION)
+
+// measures of a candidate, for each number of cores
+typedef struct {
+	profile_t setting;
+	float p99 [CALIBRATE_MAX_CORES + 1];
+	float max [CALIBRATE_MAX_CORES + 1];
+} candidate_t;
+
+
+// get setting of candidate i: the lower i, the better quality
+static void candidate_setting (int i, profile_t *setting)
+{
+	memset (setting, 0, sizeof (profile_t));
+	setting->sample_rate = sample_rate;
+	setting->period = nb_frames_per_packet;
+	setting->interpolation = interpolation [i % NB_INTERPOLATION];
+	i /= NB_INTERPOLATION;
+	setting->chorus = !(i % 2);
+	i /= 2;
+	setting->reverb = !(i % 2);
+	i /= 2;
+	setting->polyphony = polyphony [i];
+}
+
+
+// order of block times
+static int compare_times (const void *a, const void *b)
+{
+	uint64_t ta = *(const uint64_t *) a, tb = *(const uint64_t *) b;
+
+	if (ta == tb) return 0;
+	return (ta < tb) ? -1 : 1;
+}
+
+
+// render reference workload with setting, and measure time taken by each block, as a part of period
+static void measure (fluid_synth_t *synth, profile_t *setting, float *p99, float *max)
+{
+	float left [nb_frames_per_packet], right [nb_frames_per_packet];
+	float *out [2] = { left, right };
+	int nb_warmup = (CALIBRATE_WARMUP_MS * sample_rate) / (1000 * nb_frames_per_packet);
+	int nb_blocks = (CALIBRATE_MS * sample_rate) / (1000 * nb_frames_per_packet);
+	uint64_t block [nb_blocks];
+	struct timespec start, end;
+	float period_ns;
+	int chan, note = 0;
+	int i, j;
+
+	// all channels playing: a different instrument on each melodic channel, drums on channel 10
+	fluid_synth_system_reset (synth);
+	fluid_synth_set_polyphony (synth, setting->polyphony);
+	fluid_synth_set_interp_method (synth, -1, setting->interpolation);
+	fluid_synth_reverb_on (synth, -1, setting->reverb);
+	fluid_synth_chorus_on (synth, -1, setting->chorus);
+	for (chan = 0; chan < 16; chan++) {
+		if (chan != 9) fluid_synth_program_change (synth, chan, chan * 8);
+	}
+
+	for (i = 0; i < nb_warmup + nb_blocks; i++) {
+		// voices kept at polyphony: new notes until polyphony is reached, then notes steal voices, as in a dense song
+		for (j = 0; (j < 8) && ((j == 0) || (fluid_synth_get_active_voice_count (synth) < setting->polyphony)); j++, note++) {
+			chan = note % 16;
+			fluid_synth_noteon (synth, chan, 36 + (note * 7) % 48, 64 + note % 64);
+			if (note >= 64) fluid_synth_noteoff (synth, (note - 64) % 16, 36 + ((note - 64) * 7) % 48);
+		}
+
+		clock_gettime (CLOCK_MONOTONIC, &start);
+		fluid_synth_process (synth, nb_frames_per_packet, 0, NULL, 2, out);
+		clock_gettime (CLOCK_MONOTONIC, &end);
+		if (i >= nb_warmup) block [i - nb_warmup] = (uint64_t) (end.tv_sec - start.tv_sec) * 1000000000 + end.tv_nsec - start.tv_nsec;
+	}
+
+	qsort (block, nb_blocks, sizeof (uint64_t), compare_times);
+	period_ns = 1.0e9f * (float) nb_frames_per_packet / (float) sample_rate;
+	*p99 = (float) block [(nb_blocks * 99) / 100] / period_ns;
+	*max = (float) block [nb_blocks - 1] / period_ns;
+}
+
+
+// get sample rate and period of jack, if jack is running
+static int jack_period ()
+{
+	jack_client_t *cl;
+
+	cl = jack_client_open ("synthi_calibrate", JackNoStartServer, NULL);
+	if (cl == NULL) return EXIT_FAILURE;
+	sample_rate = jack_get_sample_rate (cl);
+	nb_frames_per_packet = jack_get_buffer_size (cl);
+	jack_client_close (cl);
+	return EXIT_SUCCESS;
+}
+
+
+int main (int argc, char *argv [])
+{
+	static candidate_t candidate [NB_CANDIDATES];
+	char *name = "./synthi.cfg";
+	profile_t best;
+	int nb_cores, cores, best_cores;
+	int i;
+
+	if (argc >= 2) name = argv [1];
+	mapping = new_mapping ();
+	if ((mapping == NULL) || (read_config (name, mapping) == EXIT_FAILURE)) {
+		fprintf ( stderr, "error in reading config file.\n" );
+		exit ( 1 );
+	}
+
+	// period to calibrate for: given, or the one of jack
+	if (argc >= 4) {
+		sample_rate = atoi (argv [2]);
+		nb_frames_per_packet = atoi (argv [3]);
+	}
+	else if (jack_period () == EXIT_FAILURE) {
+		fprintf ( stderr, "jack is not running: give sample rate and period.\n" );
+		exit ( 1 );
+	}
+	if ((sample_rate == 0) || (nb_frames_per_packet == 0)) {
+		fprintf ( stderr, "wrong sample rate or period.\n" );
+		exit ( 1 );
+	}
+	fprintf ( stderr, "Calibrating for %d Hz, %d frames (%.2f ms).\n", sample_rate, nb_frames_per_packet,
+		1000.0f * (float) nb_frames_per_packet / (float) sample_rate );
+
+	nb_cores = sysconf (_SC_NPROCESSORS_ONLN);
+	if (nb_cores > CALIBRATE_MAX_CORES) nb_cores = CALIBRATE_MAX_CORES;
+	if (nb_cores < 1) nb_cores = 1;
+
+	// synth is created again for each number of cores (synth.cpu-cores is only read at creation); other settings change on the fly
+	for (cores = 1; cores <= nb_cores; cores++) {
+		settings = new_fluid_settings ();
+		fluid_settings_setint (settings, "synth.sample-rate", sample_rate);
+		fluid_settings_setint (settings, "synth.cpu-cores", cores);
+		fluid_settings_setint (settings, "synth.polyphony", polyphony [0]);
+		synth = new_fluid_synth (settings);
+		if ((synth == NULL) || (fluid_synth_sfload (synth, DEFAULT_SF2, TRUE) == FLUID_FAILED)) {
+			fprintf ( stderr, "unable to create synth with %s.\n", DEFAULT_SF2 );
+			exit ( 1 );
+		}
+
+		for (i = 0; i < NB_CANDIDATES; i++) {
+			candidate_setting (i, &candidate [i].setting);
+			measure (synth, &candidate [i].setting, &candidate [i].p99 [cores], &candidate [i].max [cores]);
+			fprintf ( stderr, "cores %d, interpolation %d, polyphony %3d, reverb %d, chorus %d: p99 %3d%%, max %3d%%\n", cores,
+				candidate [i].setting.interpolation, candidate [i].setting.polyphony, candidate [i].setting.reverb, candidate [i].setting.chorus,
+				(int) (candidate [i].p99 [cores] * 100.0f), (int) (candidate [i].max [cores] * 100.0f) );
+		}
+
+		delete_fluid_synth (synth);
+		delete_fluid_settings (settings);
+	}
+
+	// best quality within budget; for this candidate, number of cores giving fastest rendering
+	for (i = 0; i < NB_CANDIDATES; i++) {
+		best_cores = 0;
+		for (cores = 1; cores <= nb_cores; cores++) {
+			if ((candidate [i].p99 [cores] > CALIBRATE_P99) || (candidate [i].max [cores] > CALIBRATE_MAX)) continue;
+			if ((best_cores == 0) || (candidate [i].p99 [cores] < candidate [i].p99 [best_cores])) best_cores = cores;
+		}
+		if (best_cores > 0) break;
+	}
+
+	// no candidate within budget: lowest quality, on the fastest number of cores (period of jack should be raised)
+	if (i == NB_CANDIDATES) {
+		i = NB_CANDIDATES - 1;
+		best_cores = 1;
+		for (cores = 2; cores <= nb_cores; cores++) {
+			if (candidate [i].p99 [cores] < candidate [i].p99 [best_cores]) best_cores = cores;
+		}
+		fprintf ( stderr, "No setting fits in period: consider a longer period for jack.\n" );
+	}
+
+	best = candidate [i].setting;
+	best.cpu_cores = best_cores;
+	best.p99 = candidate [i].p99 [best_cores];
+	best.max = candidate [i].max [best_cores];
+
+	if (mapping->profile_file [0] == 0) {
+		fprintf ( stderr, "No profile file in config file: profile is not written.\n" );
+		exit ( 1 );
+	}
+	if (profile_write (mapping->profile_file, &best) == EXIT_FAILURE) {
+		fprintf ( stderr, "Unable to write profile %s.\n", mapping->profile_file );
+		exit ( 1 );
+	}
+	fprintf ( stderr, "Profile %s: interpolation %d, polyphony %d, reverb %s, chorus %s, %d core(s): p99 %d%%, max %d%% of period.\n",
+		mapping->profile_file, best.interpolation, best.polyphony, best.reverb ? "on" : "off", best.chorus ? "on" : "off", best.cpu_cores,
+		(int) (best.p99 * 100.0f), (int) (best.max * 100.0f) );
+
+	return 0;
+}
@@ -0,0 +1,338 @@
+/** @file catalog.c
+ *
+ * @brief Catalog of songs and soundfonts: files are grouped in banks of 256 (subdirectories NN_name of ./songs/ and of
+ * ./soundfonts/, files at top of directory being bank 0), so that the library is not limited to 256 songs and 256 soundfonts.
+ * Each directory is indexed in CATALOG_FILE (number, path, division, length and tempo of songs, soundfont linked to
+ * a song, loop region set when a song is loaded): the index is only rebuilt when the directory has changed, and files are then found without any directory scan.
+ * A rebuild only scans directories: division, length and tempo of songs are taken from metadata cache, and songs not
+ * analyzed yet get them once the metadata scanner has analyzed them (see catalog_refresh ()), so startup never waits for it.
+ *
+ */
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "globals.h"
+#include "catalog.h"
+#include "utils.h"
+#include "smf.h"
+#include "metadata.h"
+
+
+// entries of each catalog (songs and soundfonts), and index of entries by bank and number (-1 if there is no file)
+static catalog_entry_t *entry [NB_NAMES];
+static int nb_entries [NB_NAMES];
+static int lookup [NB_NAMES][MAX_BANKS][256];
+
+// catalogs are read by main thread and loader thread, while main thread may rebuild them
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// directory of midi files and of SF2 files
+static char *directory [NB_NAMES] = { "./songs/", "./soundfonts/" };
+
+
+// get number given by the 2 hex digits starting name; returns -1 if name does not start with 2 hex digits
+static int hex_prefix (char *name)
+{
+	int value = 0;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		value <<= 4;
+		if ((name [i] >= '0') && (name [i] <= '9')) value += name [i] - '0';
+		else if ((name [i] >= 'a') && (name [i] <= 'f')) value += name [i] - 'a' + 10;
+		else if ((name [i] >= 'A') && (name [i] <= 'F')) value += name [i] - 'A' + 10;
+		else return -1;
+	}
+	return value;
+}
+
+
+// free entries of a catalog
+static void free_entries (catalog_entry_t *ent, int nb)
+{
+	int i;
+
+	if (ent == NULL) return;
+	for (i = 0; i < nb; i++) free (ent [i].path);
+	free (ent);
+}
+
+
+// add a file to entries; returns FALSE if there is no memory left
+static int add_entry (catalog_entry_t **ent, int *nb, int *size, int bank, int number, char *path)
+{
+	catalog_entry_t *bigger;
+
+	if (*nb == *size) {
+		bigger = realloc (*ent, (*size + 256) * sizeof (catalog_entry_t));
+		if (bigger == NULL) return FALSE;
+		*ent = bigger;
+		*size += 256;
+	}
+
+	memset (&(*ent) [*nb], 0, sizeof (catalog_entry_t));
+	(*ent) [*nb].bank = bank;
+	(*ent) [*nb].number = number;
+	(*ent) [*nb].path = strdup (path);
+	(*ent) [*nb].soundfont = -1;
+	if ((*ent) [*nb].path == NULL) return FALSE;
+	(*nb)++;
+	return TRUE;
+}
+
+
+// add files NN_* of directory dir to entries, in bank; the first file found for a number is kept, as before banks existed
+// if banks is TRUE, subdirectories NN_* are scanned as banks NN
+static void scan_directory (char *dir, int bank, int banks, catalog_entry_t **ent, int *nb, int *size, char found [MAX_BANKS][256])
+{
+	DIR *d;
+	struct dirent *de;
+	struct stat st;
+	char path [PATH_LEN];
+	int number;
+
+	if ((d = opendir (dir)) == NULL) return;
+	while ((de = readdir (d)) != NULL) {
+		if ((number = hex_prefix (de->d_name)) < 0) continue;
+		snprintf (path, PATH_LEN, "%s%s", dir, de->d_name);
+		if (stat (path, &st) < 0) continue;
+
+		// subdirectory: bank of files
+		if (S_ISDIR (st.st_mode)) {
+			if (banks && (number > 0) && (number < MAX_BANKS)) {
+				strncat (path, "/", PATH_LEN - strlen (path) - 1);
+				scan_directory (path, number, FALSE, ent, nb, size, found);
+			}
+			continue;
+		}
+
+		if (!S_ISREG (st.st_mode) || found [bank][number]) continue;
+		if (add_entry (ent, nb, size, bank, number, path)) found [bank][number] = TRUE;
+	}
+	closedir (d);
+}
+
+
+// return TRUE if time a is after time b
+static int is_after (struct timespec *a, struct timespec *b)
+{
+	return (a->tv_sec > b->tv_sec) || ((a->tv_sec == b->tv_sec) && (a->tv_nsec > b->tv_nsec));
+}
+
+
+// return TRUE if index of dir is older than dir or one of its banks: files have been added, removed or renamed
+static int is_outdated (char *dir, char *index)
+{
+	DIR *d;
+	struct dirent *de;
+	struct stat st, st_index;
+	char path [PATH_LEN];
+	int outdated = FALSE;
+
+	if (stat (index, &st_index) < 0) return TRUE;
+	if ((stat (dir, &st) < 0) || is_after (&st.st_mtim, &st_index.st_mtim)) return TRUE;
+
+	if ((d = opendir (dir)) == NULL) return TRUE;
+	while (!outdated && ((de = readdir (d)) != NULL)) {
+		if (hex_prefix (de->d_name) < 0) continue;
+		snprintf (path, PATH_LEN, "%s%s", dir, de->d_name);
+		if ((stat (path, &st) == 0) && S_ISDIR (st.st_mode) && is_after (&st.st_mtim, &st_index.st_mtim)) outdated = TRUE;
+	}
+	closedir (d);
+	return outdated;
+}
+
+
+// read index file of a catalog; returns number of entries, -1 if index can't be read
+static int read_index (char *index, catalog_entry_t **ent, int *size)
+{
+	config_t cfg;
+	config_setting_t *list, *item;
+	const char *path;
+	int nb = 0;
+	int i, bank, number;
+
+	config_init(&cfg);
+	if(! config_read_file(&cfg, index))
+	{
+		config_destroy(&cfg);
+		return -1;
+	}
+
+	list = config_lookup(&cfg, "files");
+	for (i = 0; (list != NULL) && (i < config_setting_length (list)); i++) {
+		item = config_setting_get_elem (list, i);
+		if (!config_setting_lookup_int (item, "bank", &bank) || !config_setting_lookup_int (item, "number", &number)) continue;
+		if (!config_setting_lookup_string (item, "path", &path)) continue;
+		if ((bank < 0) || (bank >= MAX_BANKS) || (number < 0) || (number > 0xFF)) continue;
+		if (!add_entry (ent, &nb, size, bank, number, (char *) path)) break;
+		config_setting_lookup_int (item, "division", &(*ent) [nb - 1].division);
+		config_setting_lookup_int (item, "ticks", &(*ent) [nb - 1].ticks);
+		config_setting_lookup_int (item, "tempo", &(*ent) [nb - 1].tempo);
+		config_setting_lookup_int (item, "soundfont", &(*ent) [nb - 1].soundfont);
+		config_setting_lookup_int (item, "loop_from", &(*ent) [nb - 1].loop [0]);
+		config_setting_lookup_int (item, "loop_to", &(*ent) [nb - 1].loop [1]);
+	}
+
+	config_destroy(&cfg);
+	return nb;
+}
+
+
+// write index file of a catalog
+static int write_index (char *index, catalog_entry_t *ent, int nb)
+{
+	config_t cfg;
+	config_setting_t *list, *item;
+	int i, result;
+
+	config_init(&cfg);
+	list = config_setting_add (config_root_setting (&cfg), "files", CONFIG_TYPE_LIST);
+	for (i = 0; i < nb; i++) {
+		item = config_setting_add (list, NULL, CONFIG_TYPE_GROUP);
+		config_setting_set_int (config_setting_add (item, "bank", CONFIG_TYPE_INT), ent [i].bank);
+		config_setting_set_int (config_setting_add (item, "number", CONFIG_TYPE_INT), ent [i].number);
+		config_setting_set_string (config_setting_add (item, "path", CONFIG_TYPE_STRING), ent [i].path);
+		config_setting_set_int (config_setting_add (item, "division", CONFIG_TYPE_INT), ent [i].division);
+		config_setting_set_int (config_setting_add (item, "ticks", CONFIG_TYPE_INT), ent [i].ticks);
+		config_setting_set_int (config_setting_add (item, "tempo", CONFIG_TYPE_INT), ent [i].tempo);
+		config_setting_set_int (config_setting_add (item, "soundfont", CONFIG_TYPE_INT), ent [i].soundfont);
+		config_setting_set_int (config_setting_add (item, "loop_from", CONFIG_TYPE_INT), ent [i].loop [0]);
+		config_setting_set_int (config_setting_add (item, "loop_to", CONFIG_TYPE_INT), ent [i].loop [1]);
+	}
+
+	result = config_write_atomic (&cfg, index);
+	config_destroy(&cfg);
+
+	// writing index has changed its directory: index is set to a later time, so that it is not seen as outdated
+	if (result == EXIT_SUCCESS) utimensat (AT_FDCWD, index, NULL, 0);
+	return result;
+}
+
+
+// set division, length and tempo of song entry from metadata cache; returns FALSE if song is not in cache yet
+static int song_info (catalog_entry_t *ent)
+{
+	metadata_t md;
+
+	if (!metadata_get (ent->path, &md)) return FALSE;
+	ent->division = md.division;
+	ent->ticks = md.ticks;
+	ent->tempo = smf_start_tempo (&md);
+	return TRUE;
+}
+
+
+// build catalog of kind (0 for songs, 1 for soundfonts) from its index, or by scanning its directory if index is outdated
+// soundfonts and loop regions set for songs in the previous index are kept; returns number of files in catalog
+int catalog_build (int kind)
+{
+	catalog_entry_t *ent = NULL, *old = NULL;
+	char index [PATH_LEN];
+	char found [MAX_BANKS][256];
+	int nb = 0, size = 0, nb_old, size_old = 0;
+	int i, j;
+
+	snprintf (index, PATH_LEN, "%s%s", directory [kind], CATALOG_FILE);
+
+	nb = is_outdated (directory [kind], index) ? -1 : read_index (index, &ent, &size);
+
+	// index is outdated or can't be read: scan directory; information of songs is taken from metadata cache
+	if (nb < 0) {
+		nb = 0;
+		memset (found, 0, sizeof (found));
+		scan_directory (directory [kind], 0, TRUE, &ent, &nb, &size, found);
+
+		nb_old = read_index (index, &old, &size_old);
+		for (i = 0; i < nb; i++) {
+			// songs not in cache yet keep the information of the previous index, until scanner has analyzed them
+			if (kind == 0) song_info (&ent [i]);
+			for (j = 0; j < nb_old; j++) {
+				if (!strcmp (ent [i].path, old [j].path)) {
+					if ((kind == 0) && (ent [i].division == 0)) {
+						ent [i].division = old [j].division;
+						ent [i].ticks = old [j].ticks;
+						ent [i].tempo = old [j].tempo;
+					}
+					ent [i].soundfont = old [j].soundfont;
+					ent [i].loop [0] = old [j].loop [0];
+					ent [i].loop [1] = old [j].loop [1];
+				}
+			}
+		}
+		free_entries (old, (nb_old < 0) ? 0 : nb_old);
+
+		if (write_index (index, ent, nb) == EXIT_FAILURE) fprintf ( stderr, "Unable to write catalog %s.\n", index );
+	}
+
+	// replace catalog
+	pthread_mutex_lock (&lock);
+	free_entries (entry [kind], nb_entries [kind]);
+	entry [kind] = ent;
+	nb_entries [kind] = nb;
+	memset (lookup [kind], 0xFF, sizeof (lookup [kind]));
+	for (i = 0; i < nb; i++) lookup [kind][ent [i].bank][ent [i].number] = i;
+	pthread_mutex_unlock (&lock);
+
+	return nb;
+}
+
+
+// fill in information of songs analyzed by metadata scanner since catalog has been built, and write index again
+// called by scanner thread once it has written metadata cache; index is written with lock held, as main thread may rebuild it
+void catalog_refresh ()
+{
+	char index [PATH_LEN];
+	int i, changed = FALSE;
+
+	snprintf (index, PATH_LEN, "%s%s", directory [0], CATALOG_FILE);
+
+	pthread_mutex_lock (&lock);
+	for (i = 0; i < nb_entries [0]; i++) {
+		if (entry [0][i].division == 0) changed |= song_info (&entry [0][i]);
+	}
+	if (changed && (write_index (index, entry [0], nb_entries [0]) == EXIT_FAILURE)) fprintf ( stderr, "Unable to write catalog %s.\n", index );
+	pthread_mutex_unlock (&lock);
+}
+
+
+// get full name of file number in bank of catalog kind (0 for songs, 1 for soundfonts), and its entry if info is not NULL
+// returns FALSE if there is no such file
+int catalog_lookup (int kind, int bank, unsigned char number, char *name, catalog_entry_t *info)
+{
+	int i;
+
+	if ((bank < 0) || (bank >= MAX_BANKS)) return FALSE;
+
+	pthread_mutex_lock (&lock);
+	if ((i = lookup [kind][bank][number]) < 0) {
+		pthread_mutex_unlock (&lock);
+		return FALSE;
+	}
+	strcpy (name, entry [kind][i].path);
+	if (info != NULL) {
+		*info = entry [kind][i];
+		info->path = NULL;
+	}
+	pthread_mutex_unlock (&lock);
+
+	return TRUE;
+}
+
+
+// get full name of file i of catalog kind, to go through all files of catalog; returns FALSE if there is no file i
+int catalog_path (int kind, int i, char *name)
+{
+	int result = FALSE;
+
+	pthread_mutex_lock (&lock);
+	if ((i >= 0) && (i < nb_entries [kind])) {
+		strcpy (name, entry [kind][i].path);
+		result = TRUE;
+	}
+	pthread_mutex_unlock (&lock);
+
+	return result;
+}
@@ -0,0 +1,10 @@
+/** @file catalog.h
+ *
+ * @brief This file defines prototypes of functions inside catalog.c
+ *
+ */
+
+int catalog_build (int);
+void catalog_refresh ();
+int catalog_lookup (int, int, unsigned char, char *, catalog_entry_t *);
+int catalog_path (int, int, char *);
@@ -0,0 +1,125 @@
+/** @file click.c
+ *
+ * @brief Metronome click on its own audio port (click_output_1), independent of the mix, so that the drummer hears it
+ * alone. Beats of a compiled song are found by the sequencer in render thread, at the exact frame where their tick is
+ * reached: tempo map, tap tempo and tempo fader are followed. They are queued with their frame time, and process
+ * callback plays click samples, computed at startup, at these frames. Click is one period behind the mix, whatever
+ * the order in which jack runs synthi and fluidsynth: beats rendered in a cycle are played in the next one.
+ * Midi files not compiled yet are clicked by the tick callback of fluidsynth player, within a period.
+ *
+ */
+
+#include "types.h"
+#include "globals.h"
+#include "click.h"
+
+
+// click samples: accent on first beat of bar, and other beats
+static float *accent_sample, *beat_sample;
+static int sample_len;
+
+// clicks queued by render thread: [head, tail) of ring; head is moved by process callback, tail by render thread
+static click_t ring [CLICK_RING];
+static uint32_t head, tail;
+
+// frame time of the cycle rendered by render thread
+static jack_nframes_t render_frame;
+
+// click sample played by process callback, and position in it
+static float *voice;
+static int voice_pos;
+
+// last tick of fluidsynth player seen by tick callback
+static int last_tick = -1;
+
+
+// compute click samples at sample rate of jack: short sine bursts, with a 1 ms attack and a fast decay
+int click_init ()
+{
+	float t, env;
+	int i;
+
+	sample_len = (int) (sample_rate * CLICK_MS / 1000);
+	accent_sample = malloc (sample_len * sizeof (float));
+	beat_sample = malloc (sample_len * sizeof (float));
+	if ((accent_sample == NULL) || (beat_sample == NULL)) {
+		fprintf ( stderr, "Unable to allocate click samples.\n" );
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sample_len; i++) {
+		t = (float) i / (float) sample_rate;
+		env = expf (-t / 0.005f);
+		if (t < 0.001f) env *= t / 0.001f;
+		accent_sample [i] = env * sinf (2.0f * (float) M_PI * 1760.0f * t);
+		beat_sample [i] = 0.7f * env * sinf (2.0f * (float) M_PI * 1320.0f * t);
+	}
+	return EXIT_SUCCESS;
+}
+
+
+// start of a block rendered by render thread: frame time is the same for all clients of jack in a cycle
+void click_render_start ()
+{
+	render_frame = jack_last_frame_time (client);
+}
+
+
+// queue a click offset frames after the start of the block rendered; called by render thread
+void click_beat (int offset, int accent)
+{
+	if (tail - __atomic_load_n (&head, __ATOMIC_ACQUIRE) >= CLICK_RING) return;
+	ring [tail % CLICK_RING].frame = render_frame + (jack_nframes_t) offset;
+	ring [tail % CLICK_RING].accent = accent;
+	__atomic_store_n (&tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+// midi file played by fluidsynth player: click at each quarter note reached by tick callback, at start of block
+void click_tick (engine_t *eng, int tick)
+{
+	if ((last_tick >= 0) && (tick / eng->ppq != last_tick / eng->ppq)) click_beat (0, (tick % eng->ticks_per_bar) < eng->ppq);
+	last_tick = tick;
+}
+
+
+// play clicks queued by render thread on click port, one period after the cycle they were rendered in; called by process callback
+void click_process (jack_nframes_t nframes, float level)
+{
+	float *out;
+	click_t *next;
+	int32_t start;
+	int pos, end, n, i;
+
+	if (click_output_port == NULL) return;
+	out = jack_port_get_buffer (click_output_port, nframes);
+	memset (out, 0, nframes * sizeof (float));
+
+	for (pos = 0; pos < (int) nframes; pos = end) {
+		// next click, if it starts in this cycle; late clicks (xrun) start now
+		next = NULL;
+		end = nframes;
+		if (head != __atomic_load_n (&tail, __ATOMIC_ACQUIRE)) {
+			start = (int32_t) (ring [head % CLICK_RING].frame + nframes - jack_last_frame_time (client));
+			if (start < pos) start = pos;
+			if (start < (int32_t) nframes) {
+				next = &ring [head % CLICK_RING];
+				end = start;
+			}
+		}
+
+		// click played until next one
+		if (voice != NULL) {
+			n = (end - pos < sample_len - voice_pos) ? end - pos : sample_len - voice_pos;
+			for (i = 0; i < n; i++) out [pos + i] = level * voice [voice_pos + i];
+			voice_pos += n;
+			if (voice_pos >= sample_len) voice = NULL;
+		}
+
+		if (next != NULL) {
+			voice = next->accent ? accent_sample : beat_sample;
+			voice_pos = 0;
+			__atomic_store_n (&head, head + 1, __ATOMIC_RELEASE);
+		}
+	}
+}
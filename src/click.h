@@ -0,0 +1,11 @@
+/** @file click.h
+ *
+ * @brief This file defines prototypes of functions inside click.c
+ *
+ */
+
+int click_init ();
+void click_render_start ();
+void click_beat (int, int);
+void click_tick (engine_t *, int);
+void click_process (jack_nframes_t, float);
@@ -14,144 +14,18 @@
 #include "led.h"
 
 
-/* This example reads the configuration file 'example.cfg' and displays
- * some of its contents.
- */
-
-int read_config (char *name)
+// read filename settings of a surface : assign midi events to control filename of midi file and SF2 to be played
+// group is the "filename" group of the surface in the config file
+static int read_filename (config_setting_t *group, surface_t *surf)
 {
-	config_t cfg;
 	config_setting_t *setting;
-	const char *str;
-	int index;
-	int i;
 	config_setting_t *buffer;
+	int i;
 
-
-	config_init(&cfg);
-
-	/* Read the file. If there is an error, report it and exit. */
-	if(! config_read_file(&cfg,name))
-	{
-		fprintf(stderr, "%s:%d - %s\n", config_error_file(&cfg), config_error_line(&cfg), config_error_text(&cfg));
-		config_destroy(&cfg);
-		return(EXIT_FAILURE);
-	}
-
-	/* Read a dummy name; this is mostly to remember how to read a single config parameter */
-	if(!config_lookup_string(&cfg, "name", &str)) fprintf ( stderr, "Unable to read config name.\n" );
-
-	/****************************************************************************/
-	/* Read connection settings : connection of server port X to client port Y  */
-	/****************************************************************************/
-
-	index = 0;
-
-
-	// audio outputs for FLUIDSYNTH
-	setting = config_lookup(&cfg, "connections.output");
-	if(setting != NULL)
-	{
-		int count = config_setting_length(setting);
-
-		for(i = 0; i < count; ++i)
-		{
-			config_setting_t *book = config_setting_get_elem(setting, i);
-
-			// Only output the record if all of the expected fields are present.
-			const char *port_server, *port_client;
-
-			if(!(config_setting_lookup_string(book, "server", &port_server)
-					 && config_setting_lookup_string(book, "client", &port_client)))
-				continue;
-
-			// copy the ports found in config file to an array of string, and increment the index in the table
-			// for outputs, jack port is the output (destination) and shall be second in the array
-			// "server" should be the actual looper client
-			strcpy (ports_to_connect [index++], port_server);
-			strcpy (ports_to_connect [index++], port_client);
-		}
-	}
-
-	/* midi inputs */
-	setting = config_lookup(&cfg, "connections.midi_input");
-	if(setting != NULL)
-	{
-		int count = config_setting_length(setting);
-
-		for(i = 0; i < count; ++i)
-		{
-			config_setting_t *book = config_setting_get_elem(setting, i);
-
-			/* Only output the record if all of the expected fields are present. */
-			const char *port_server, *port_client;
-
-			if(!(config_setting_lookup_string(book, "server", &port_server)
-					 && config_setting_lookup_string(book, "client", &port_client)))
-				continue;
-
-			/* copy the ports found in config file to an array of string, and increment the index in the table */
-			/* for inputs, jack port is the input and shall be first in the array */
-			strcpy (ports_to_connect [index++], port_server);
-			strcpy (ports_to_connect [index++], port_client);
-		}
-	}
-
-	/* midi outputs */
-	setting = config_lookup(&cfg, "connections.midi_output");
-	if(setting != NULL)
-	{
-		int count = config_setting_length(setting);
-
-		for(i = 0; i < count; ++i)
-		{
-			config_setting_t *book = config_setting_get_elem(setting, i);
-
-			/* Only output the record if all of the expected fields are present. */
-			const char *port_server, *port_client;
-
-			if(!(config_setting_lookup_string(book, "server", &port_server)
-					 && config_setting_lookup_string(book, "client", &port_client)))
-				continue;
-
-			/* copy the ports found in config file to an array of string, and increment the index in the table */
-			/* for inputs, jack port is the input and shall be first in the array */
-			strcpy (ports_to_connect [index++], port_server);
-			strcpy (ports_to_connect [index++], port_client);
-		}
-	}
-
-	/* clock outputs */
-	setting = config_lookup(&cfg, "connections.clock_output");
-	if(setting != NULL)
-	{
-		int count = config_setting_length(setting);
-
-		for(i = 0; i < count; ++i)
-		{
-			config_setting_t *book = config_setting_get_elem(setting, i);
-
-			/* Only output the record if all of the expected fields are present. */
-			const char *port_server, *port_client;
-
-			if(!(config_setting_lookup_string(book, "server", &port_server)
-					 && config_setting_lookup_string(book, "client", &port_client)))
-				continue;
-
-			/* copy the ports found in config file to an array of string, and increment the index in the table */
-			/* for inputs, jack port is the input and shall be first in the array */
-			strcpy (ports_to_connect [index++], port_server);
-			strcpy (ports_to_connect [index++], port_client);
-		}
-	}
-
-
-	/*****************************************************************************************************/
-	/* Read filename settings : assign midi events to control filename of midi file and SF2 to be played */
-	/*****************************************************************************************************/
+	if (group == NULL) return (EXIT_FAILURE);
 
 	/* control inputs */
-	setting = config_lookup(&cfg, "filename.controls");
+	setting = config_setting_get_member (group, "controls");
 	if (setting != NULL)
 	{
 		int count = config_setting_length(setting);
@@ -170,86 +44,86 @@ int read_config (char *name)
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filename[i].ctrl[PLAY][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].ctrl[PLAY][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].ctrl[PLAY][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].ctrl[PLAY][1] = config_setting_get_int_elem (buffer, 1);
 
 			/* load pad */
 			buffer = config_setting_get_member (book, "load");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filename[i].ctrl[LOAD][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].ctrl[LOAD][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].ctrl[LOAD][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].ctrl[LOAD][1] = config_setting_get_int_elem (buffer, 1);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b7");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filename[i].ctrl[B7][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].ctrl[B7][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].ctrl[B7][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].ctrl[B7][1] = config_setting_get_int_elem (buffer, 1);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b6");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filename[i].ctrl[B6][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].ctrl[B6][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].ctrl[B6][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].ctrl[B6][1] = config_setting_get_int_elem (buffer, 1);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b5");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filename[i].ctrl[B5][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].ctrl[B5][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].ctrl[B5][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].ctrl[B5][1] = config_setting_get_int_elem (buffer, 1);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b4");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filename[i].ctrl[B4][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].ctrl[B4][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].ctrl[B4][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].ctrl[B4][1] = config_setting_get_int_elem (buffer, 1);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b3");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filename[i].ctrl[B3][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].ctrl[B3][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].ctrl[B3][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].ctrl[B3][1] = config_setting_get_int_elem (buffer, 1);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b2");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filename[i].ctrl[B2][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].ctrl[B2][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].ctrl[B2][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].ctrl[B2][1] = config_setting_get_int_elem (buffer, 1);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b1");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filename[i].ctrl[B1][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].ctrl[B1][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].ctrl[B1][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].ctrl[B1][1] = config_setting_get_int_elem (buffer, 1);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b0");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filename[i].ctrl[B0][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].ctrl[B0][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].ctrl[B0][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].ctrl[B0][1] = config_setting_get_int_elem (buffer, 1);
 		}
 	}
 
 
 	/* led on */
-	setting = config_lookup(&cfg, "filename.led_on");
+	setting = config_setting_get_member (group, "led_on");
 	if (setting != NULL)
 	{
 		int count = config_setting_length(setting);
@@ -268,96 +142,96 @@ int read_config (char *name)
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[PLAY][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[PLAY][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[PLAY][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[PLAY][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[PLAY][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[PLAY][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* load pad */
 			buffer = config_setting_get_member (book, "load");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[LOAD][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[LOAD][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[LOAD][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[LOAD][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[LOAD][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[LOAD][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b7");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B7][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B7][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B7][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B7][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B7][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B7][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b6");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B6][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B6][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B6][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B6][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B6][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B6][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b5");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B5][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B5][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B5][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B5][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B5][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B5][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b4");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B4][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B4][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B4][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B4][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B4][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B4][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b3");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B3][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B3][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B3][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B3][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B3][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B3][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b2");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B2][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B2][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B2][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B2][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B2][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B2][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b1");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B1][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B1][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B1][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B1][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B1][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B1][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b0");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B0][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B0][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B0][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B0][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B0][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B0][ON][2] = config_setting_get_int_elem (buffer, 2);
 		}
 	}
 
 
 	/* led off */
-	setting = config_lookup(&cfg, "filename.led_off");
+	setting = config_setting_get_member (group, "led_off");
 	if (setting != NULL)
 	{
 		int count = config_setting_length(setting);
@@ -376,100 +250,109 @@ int read_config (char *name)
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[PLAY][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[PLAY][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[PLAY][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[PLAY][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[PLAY][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[PLAY][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* load pad */
 			buffer = config_setting_get_member (book, "load");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[LOAD][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[LOAD][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[LOAD][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[LOAD][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[LOAD][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[LOAD][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b7");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B7][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B7][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B7][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B7][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B7][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B7][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b6");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B6][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B6][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B6][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B6][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B6][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B6][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b5");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B5][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B5][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B5][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B5][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B5][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B5][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b4");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B4][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B4][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B4][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B4][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B4][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B4][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b3");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B3][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B3][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B3][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B3][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B3][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B3][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b2");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B2][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B2][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B2][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B2][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B2][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B2][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b1");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B1][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B1][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B1][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B1][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B1][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B1][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			/* bit */
 			buffer = config_setting_get_member (book, "b0");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filename[i].led[B0][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filename[i].led[B0][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filename[i].led[B0][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filename[i].led[B0][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filename[i].led[B0][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filename[i].led[B0][OFF][2] = config_setting_get_int_elem (buffer, 2);
 		}
 	}
 
+	return (EXIT_SUCCESS);
+}
+
+
+// read functions settings of a surface : assign midi events to control vol -/+ and bpm -/+
+// group is the "functions" group of the surface in the config file
+static int read_functions (config_setting_t *group, surface_t *surf)
+{
+	config_setting_t *setting;
+	config_setting_t *buffer;
+	int i;
 
-	/*******************************************************************************/
-	/* Read functions settings : assign midi events to control vol -/+ and bpm -/+ */
-	/*******************************************************************************/
+	if (group == NULL) return (EXIT_FAILURE);
 
 	/* control inputs */
-	setting = config_lookup(&cfg, "functions.controls");
+	setting = config_setting_get_member (group, "controls");
 	if (setting != NULL)
 	{
 		int count = config_setting_length(setting);
@@ -488,42 +371,84 @@ int read_config (char *name)
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filefunct[i].ctrl[VOLDOWN][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].ctrl[VOLDOWN][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].ctrl[VOLDOWN][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[VOLDOWN][1] = config_setting_get_int_elem (buffer, 1);
 
 			buffer = config_setting_get_member (book, "volup");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filefunct[i].ctrl[VOLUP][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].ctrl[VOLUP][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].ctrl[VOLUP][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[VOLUP][1] = config_setting_get_int_elem (buffer, 1);
 
 			buffer = config_setting_get_member (book, "bpmdown");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filefunct[i].ctrl[BPMDOWN][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].ctrl[BPMDOWN][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].ctrl[BPMDOWN][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[BPMDOWN][1] = config_setting_get_int_elem (buffer, 1);
 
 			buffer = config_setting_get_member (book, "bpmup");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filefunct[i].ctrl[BPMUP][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].ctrl[BPMUP][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].ctrl[BPMUP][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[BPMUP][1] = config_setting_get_int_elem (buffer, 1);
 
 			buffer = config_setting_get_member (book, "beat");
 			/* check buffer is not empty, and has 2 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=2) continue;
-			filefunct[i].ctrl[BEAT][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].ctrl[BEAT][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].ctrl[BEAT][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[BEAT][1] = config_setting_get_int_elem (buffer, 1);
+
+			buffer = config_setting_get_member (book, "next");
+			/* check buffer is not empty, and has 2 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=2) continue;
+			surf->filefunct[i].ctrl[NEXT][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[NEXT][1] = config_setting_get_int_elem (buffer, 1);
+
+			buffer = config_setting_get_member (book, "prev");
+			/* check buffer is not empty, and has 2 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=2) continue;
+			surf->filefunct[i].ctrl[PREV][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[PREV][1] = config_setting_get_int_elem (buffer, 1);
+
+			buffer = config_setting_get_member (book, "back");
+			/* check buffer is not empty, and has 2 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=2) continue;
+			surf->filefunct[i].ctrl[BACK][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[BACK][1] = config_setting_get_int_elem (buffer, 1);
+
+			buffer = config_setting_get_member (book, "forward");
+			/* check buffer is not empty, and has 2 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=2) continue;
+			surf->filefunct[i].ctrl[FORWARD][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[FORWARD][1] = config_setting_get_int_elem (buffer, 1);
+
+			buffer = config_setting_get_member (book, "loop");
+			/* check buffer is not empty, and has 2 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=2) continue;
+			surf->filefunct[i].ctrl[LOOP][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[LOOP][1] = config_setting_get_int_elem (buffer, 1);
+
+			buffer = config_setting_get_member (book, "bank");
+			/* check buffer is not empty, and has 2 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=2) continue;
+			surf->filefunct[i].ctrl[BANK][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].ctrl[BANK][1] = config_setting_get_int_elem (buffer, 1);
 
 		}
 	}
 
 	/* led on */
-	setting = config_lookup(&cfg, "functions.led_on");
+	setting = config_setting_get_member (group, "led_on");
 	if (setting != NULL)
 	{
 		int count = config_setting_length(setting);
@@ -542,47 +467,95 @@ int read_config (char *name)
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[VOLDOWN][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[VOLDOWN][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[VOLDOWN][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[VOLDOWN][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[VOLDOWN][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[VOLDOWN][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "volup");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[VOLUP][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[VOLUP][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[VOLUP][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[VOLUP][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[VOLUP][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[VOLUP][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "bpmdown");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[BPMDOWN][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[BPMDOWN][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[BPMDOWN][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[BPMDOWN][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BPMDOWN][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BPMDOWN][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "bpmup");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[BPMUP][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[BPMUP][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[BPMUP][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[BPMUP][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BPMUP][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BPMUP][ON][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "beat");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[BEAT][ON][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[BEAT][ON][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[BEAT][ON][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[BEAT][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BEAT][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BEAT][ON][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "next");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[NEXT][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[NEXT][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[NEXT][ON][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "prev");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[PREV][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[PREV][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[PREV][ON][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "back");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[BACK][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BACK][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BACK][ON][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "forward");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[FORWARD][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[FORWARD][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[FORWARD][ON][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "loop");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[LOOP][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[LOOP][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[LOOP][ON][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "bank");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[BANK][ON][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BANK][ON][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BANK][ON][2] = config_setting_get_int_elem (buffer, 2);
 		}
 	}
 
 
 	/* led pending */
-	setting = config_lookup(&cfg, "functions.led_pending");
+	setting = config_setting_get_member (group, "led_pending");
 	if (setting != NULL)
 	{
 		int count = config_setting_length(setting);
@@ -601,47 +574,95 @@ int read_config (char *name)
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[VOLDOWN][PENDING][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[VOLDOWN][PENDING][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[VOLDOWN][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[VOLDOWN][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[VOLDOWN][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[VOLDOWN][PENDING][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "volup");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[VOLUP][PENDING][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[VOLUP][PENDING][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[VOLUP][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[VOLUP][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[VOLUP][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[VOLUP][PENDING][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "bpmdown");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[BPMDOWN][PENDING][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[BPMDOWN][PENDING][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[BPMDOWN][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[BPMDOWN][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BPMDOWN][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BPMDOWN][PENDING][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "bpmup");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[BPMUP][PENDING][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[BPMUP][PENDING][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[BPMUP][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[BPMUP][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BPMUP][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BPMUP][PENDING][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "beat");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[BEAT][PENDING][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[BEAT][PENDING][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[BEAT][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[BEAT][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BEAT][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BEAT][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "next");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[NEXT][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[NEXT][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[NEXT][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "prev");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[PREV][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[PREV][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[PREV][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "back");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[BACK][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BACK][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BACK][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "forward");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[FORWARD][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[FORWARD][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[FORWARD][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "loop");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[LOOP][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[LOOP][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[LOOP][PENDING][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "bank");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[BANK][PENDING][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BANK][PENDING][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BANK][PENDING][2] = config_setting_get_int_elem (buffer, 2);
 		}
 	}
 
 
 	/* led off */
-	setting = config_lookup(&cfg, "functions.led_off");
+	setting = config_setting_get_member (group, "led_off");
 	if (setting != NULL)
 	{
 		int count = config_setting_length(setting);
@@ -660,46 +681,970 @@ int read_config (char *name)
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[VOLDOWN][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[VOLDOWN][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[VOLDOWN][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[VOLDOWN][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[VOLDOWN][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[VOLDOWN][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "volup");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[VOLUP][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[VOLUP][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[VOLUP][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[VOLUP][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[VOLUP][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[VOLUP][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "bpmdown");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[BPMDOWN][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[BPMDOWN][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[BPMDOWN][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[BPMDOWN][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BPMDOWN][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BPMDOWN][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "bpmup");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[BPMUP][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[BPMUP][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[BPMUP][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[BPMUP][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BPMUP][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BPMUP][OFF][2] = config_setting_get_int_elem (buffer, 2);
 
 			buffer = config_setting_get_member (book, "beat");
 			/* check buffer is not empty, and has 3 elements */
 			if (!buffer) continue;
 			if (config_setting_length(buffer)!=3) continue;
-			filefunct[i].led[BEAT][OFF][0] = config_setting_get_int_elem (buffer, 0);
-			filefunct[i].led[BEAT][OFF][1] = config_setting_get_int_elem (buffer, 1);
-			filefunct[i].led[BEAT][OFF][2] = config_setting_get_int_elem (buffer, 2);
+			surf->filefunct[i].led[BEAT][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BEAT][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BEAT][OFF][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "next");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[NEXT][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[NEXT][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[NEXT][OFF][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "prev");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[PREV][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[PREV][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[PREV][OFF][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "back");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[BACK][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BACK][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BACK][OFF][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "forward");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[FORWARD][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[FORWARD][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[FORWARD][OFF][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "loop");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[LOOP][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[LOOP][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[LOOP][OFF][2] = config_setting_get_int_elem (buffer, 2);
+
+			buffer = config_setting_get_member (book, "bank");
+			/* check buffer is not empty, and has 3 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=3) continue;
+			surf->filefunct[i].led[BANK][OFF][0] = config_setting_get_int_elem (buffer, 0);
+			surf->filefunct[i].led[BANK][OFF][1] = config_setting_get_int_elem (buffer, 1);
+			surf->filefunct[i].led[BANK][OFF][2] = config_setting_get_int_elem (buffer, 2);
 		}
 	}
 
 
-	/* successful reading, exit */
-	config_destroy(&cfg);
-	return(EXIT_SUCCESS);
+	/* faders */
+	setting = config_setting_get_member (group, "faders");
+	if (setting != NULL)
+	{
+		int count = config_setting_length(setting);
+
+		/* Check we don't have a too large number of tracks defined, in which case we set to the maximum */
+		if (count > 1) count = 1;
+
+		 /* read element by element */
+		 /* only 1 element in our case */
+		for (i = 0; i < count; ++i)
+		{
+			config_setting_t *book = config_setting_get_elem (setting, i);
+
+			/* read member by member */
+			buffer = config_setting_get_member (book, "volume");
+			/* check buffer is not empty, and has 2 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=2) continue;
+			surf->fader.ctrl[FADER_VOLUME][0] = config_setting_get_int_elem (buffer, 0);
+			surf->fader.ctrl[FADER_VOLUME][1] = config_setting_get_int_elem (buffer, 1);
+
+			buffer = config_setting_get_member (book, "tempo");
+			/* check buffer is not empty, and has 2 elements */
+			if (!buffer) continue;
+			if (config_setting_length(buffer)!=2) continue;
+			surf->fader.ctrl[FADER_TEMPO][0] = config_setting_get_int_elem (buffer, 0);
+			surf->fader.ctrl[FADER_TEMPO][1] = config_setting_get_int_elem (buffer, 1);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+
+// read output settings of a surface : how led messages are sent to the midi control surface
+// group is the surface group in the config file
+static int read_output (config_setting_t *group, surface_t *surf)
+{
+	config_setting_t *buffer;
+	const char *str;
+	int i;
+
+	if (group == NULL) return (EXIT_FAILURE);
+
+	/* type of surface: "generic" (individual led messages) or "sysex" (bulk led sysex messages) */
+	if (config_setting_lookup_string (group, "type", &str)) {
+		if (strcmp (str, "sysex") == 0) surf->type = SURFACE_SYSEX;
+		else surf->type = SURFACE_GENERIC;
+	}
+
+	/* bandwidth of the midi link to the surface, in bytes per ms */
+	if (config_setting_lookup_int (group, "bytes_per_ms", &surf->bytes_per_ms)) {
+		if (surf->bytes_per_ms < 1) surf->bytes_per_ms = 1;
+	}
+
+	/* header of the bulk led sysex message */
+	buffer = config_setting_get_member (group, "sysex_header");
+	if (buffer) {
+		int count = config_setting_length(buffer);
+
+		/* Check we don't have a too long header, in which case we set to the maximum */
+		if (count > SYSEX_HEADER_MAX) count = SYSEX_HEADER_MAX;
+		for (i = 0; i < count; ++i) surf->sysex [i] = config_setting_get_int_elem (buffer, i);
+		surf->sysex_len = count;
+	}
+
+	/* a sysex surface without a valid sysex header falls back to individual led messages */
+	if ((surf->type == SURFACE_SYSEX) && ((surf->sysex_len == 0) || (surf->sysex [0] != 0xF0))) {
+		fprintf ( stderr, "invalid surface sysex header, using individual led messages.\n" );
+		surf->type = SURFACE_GENERIC;
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+
+// build the lookup table of a surface: for each midi event (status byte, 1st data byte), the table gives
+// the function (filename, function or fader) it controls; this allows dispatching midi in events in O(1)
+static void build_dispatch (surface_t *surf)
+{
+	int row, col;
+
+	/* no function for any midi event by default */
+	memset (surf->dispatch, 0xFF, sizeof (surf->dispatch));
+
+	/* filename pads; a control without status byte, eg. (0x00, 0x00), means no pad */
+	for (row = 0; row < NB_NAMES; row++) {
+		for (col = FIRST_ELT; col < LAST_ELT; col++) {
+			if (!(surf->filename[row].ctrl[col][0] & 0x80)) continue;
+			surf->dispatch [surf->filename[row].ctrl[col][0] & 0x7F][surf->filename[row].ctrl[col][1] & 0x7F] = FUNCTION_CODE (NAMES, row, col);
+		}
+	}
+
+	/* function pads */
+	for (row = 0; row < NB_FCT; row++) {
+		for (col = FIRST_ELT_FCT; col < LAST_ELT_FCT; col++) {
+			if (!(surf->filefunct[row].ctrl[col][0] & 0x80)) continue;
+			surf->dispatch [surf->filefunct[row].ctrl[col][0] & 0x7F][surf->filefunct[row].ctrl[col][1] & 0x7F] = FUNCTION_CODE (FCT, row, col);
+		}
+	}
+
+	/* faders */
+	for (col = FIRST_ELT_FADER; col < LAST_ELT_FADER; col++) {
+		if (!(surf->fader.ctrl[col][0] & 0x80)) continue;
+		surf->dispatch [surf->fader.ctrl[col][0] & 0x7F][surf->fader.ctrl[col][1] & 0x7F] = FUNCTION_CODE (FADERS, 0, col);
+	}
+}
+
+
+// read realtime settings : memory locking, cores and priorities of threads
+// group is the realtime group in the config file
+static int read_realtime (config_setting_t *group, realtime_t *rt)
+{
+	static const char *thread_name [RT_NB_THREADS] = { "process", "render", "control", "loader", "gpio", "part1", "part2", "part3" };
+	config_setting_t *thread;
+	int i;
+
+	if (group == NULL) return (EXIT_FAILURE);
+
+	config_setting_lookup_bool (group, "lock_memory", &rt->lock_memory);
+	if (config_setting_lookup_int (group, "memory_budget_mb", &rt->memory_budget_mb)) {
+		if (rt->memory_budget_mb < 0) rt->memory_budget_mb = 0;
+	}
+	if (config_setting_lookup_int (group, "stack_kb", &rt->stack_kb)) {
+		if (rt->stack_kb < 0) rt->stack_kb = 0;
+	}
+
+	/* core and priority of each thread */
+	for (i = 0; i < RT_NB_THREADS; i++) {
+		thread = config_setting_get_member (group, thread_name [i]);
+		if (thread == NULL) continue;
+		config_setting_lookup_int (thread, "core", &rt->core [i]);
+		if (config_setting_lookup_int (thread, "priority", &rt->priority [i])) {
+			if (rt->priority [i] < 0) rt->priority [i] = 0;
+			if (rt->priority [i] > 99) rt->priority [i] = 99;
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+
+// read load governor settings of group into gov; settings which are not given keep their default value
+static int read_governor (config_setting_t *group, governor_t *gov)
+{
+	config_setting_t *list;
+	double value;
+	int i;
+
+	if (group == NULL) return (EXIT_FAILURE);
+
+	config_setting_lookup_bool (group, "enabled", &gov->enabled);
+	if (config_setting_lookup_float (group, "high", &value) && (value > 0.0) && (value <= 1.0)) gov->high = (float) value;
+	if (config_setting_lookup_float (group, "low", &value) && (value >= 0.0) && (value < gov->high)) gov->low = (float) value;
+	config_setting_lookup_int (group, "min_polyphony", &gov->min_polyphony);
+	config_setting_lookup_int (group, "max_polyphony", &gov->max_polyphony);
+	if (gov->min_polyphony < 1) gov->min_polyphony = 1;
+	if (gov->max_polyphony < gov->min_polyphony) gov->max_polyphony = gov->min_polyphony;
+
+	/* channels (1 to 16) which notes are released last, after drums */
+	list = config_setting_get_member (group, "important_channels");
+	if (list != NULL) {
+		gov->nb_important = 0;
+		for (i = 0; (i < config_setting_length (list)) && (gov->nb_important < 16); i++) {
+			value = config_setting_get_int_elem (list, i);
+			if ((value >= 1) && (value <= 16)) gov->important [gov->nb_important++] = (int) value - 1;
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+
+// add a pair of ports (server, client) to the list of ports to connect of a mapping
+static void add_connection (mapping_t *map, const char *port_server, const char *port_client)
+{
+	/* Check we don't have a too large number of connections defined */
+	if (map->nb_connections >= MAX_CONNECTIONS) {
+		fprintf ( stderr, "too many connections defined in config file.\n" );
+		return;
+	}
+
+	strncpy (map->connection [map->nb_connections][0], port_server, PORT_NAME_LEN - 1);
+	strncpy (map->connection [map->nb_connections][1], port_client, PORT_NAME_LEN - 1);
+	map->nb_connections++;
+}
+
+
+/* This example reads the configuration file 'example.cfg' and displays
+ * some of its contents.
+ */
+
+int read_config (char *name, mapping_t *map)
+{
+	config_t cfg;
+	config_setting_t *setting;
+	const char *str;
+	int i, j;
+
+
+	config_init(&cfg);
+
+	/* Read the file. If there is an error, report it and exit. */
+	if(! config_read_file(&cfg,name))
+	{
+		fprintf(stderr, "%s:%d - %s\n", config_error_file(&cfg), config_error_line(&cfg), config_error_text(&cfg));
+		config_destroy(&cfg);
+		return(EXIT_FAILURE);
+	}
+
+	/* Read a dummy name; this is mostly to remember how to read a single config parameter */
+	if(!config_lookup_string(&cfg, "name", &str)) fprintf ( stderr, "Unable to read config name.\n" );
+
+	/****************************************************************************/
+	/* Read connection settings : connection of server port X to client port Y  */
+	/****************************************************************************/
+
+
+
+	// audio outputs for FLUIDSYNTH
+	setting = config_lookup(&cfg, "connections.output");
+	if(setting != NULL)
+	{
+		int count = config_setting_length(setting);
+
+		for(i = 0; i < count; ++i)
+		{
+			config_setting_t *book = config_setting_get_elem(setting, i);
+
+			// Only output the record if all of the expected fields are present.
+			const char *port_server, *port_client;
+
+			if(!(config_setting_lookup_string(book, "server", &port_server)
+					 && config_setting_lookup_string(book, "client", &port_client)))
+				continue;
+
+			// add the ports found in config file to the list of ports to connect
+			// for outputs, jack port is the output (destination) and shall be second in the array
+			// "server" should be the actual looper client
+			add_connection (map, port_server, port_client);
+		}
+	}
+
+	/* midi inputs */
+	setting = config_lookup(&cfg, "connections.midi_input");
+	if(setting != NULL)
+	{
+		int count = config_setting_length(setting);
+
+		for(i = 0; i < count; ++i)
+		{
+			config_setting_t *book = config_setting_get_elem(setting, i);
+
+			/* Only output the record if all of the expected fields are present. */
+			const char *port_server, *port_client;
+
+			if(!(config_setting_lookup_string(book, "server", &port_server)
+					 && config_setting_lookup_string(book, "client", &port_client)))
+				continue;
+
+			/* add the ports found in config file to the list of ports to connect */
+			/* for inputs, jack port is the input and shall be first in the array */
+			add_connection (map, port_server, port_client);
+		}
+	}
+
+	/* midi outputs */
+	setting = config_lookup(&cfg, "connections.midi_output");
+	if(setting != NULL)
+	{
+		int count = config_setting_length(setting);
+
+		for(i = 0; i < count; ++i)
+		{
+			config_setting_t *book = config_setting_get_elem(setting, i);
+
+			/* Only output the record if all of the expected fields are present. */
+			const char *port_server, *port_client;
+
+			if(!(config_setting_lookup_string(book, "server", &port_server)
+					 && config_setting_lookup_string(book, "client", &port_client)))
+				continue;
+
+			/* add the ports found in config file to the list of ports to connect */
+			/* for inputs, jack port is the input and shall be first in the array */
+			add_connection (map, port_server, port_client);
+		}
+	}
+
+	/* clock outputs */
+	setting = config_lookup(&cfg, "connections.clock_output");
+	if(setting != NULL)
+	{
+		int count = config_setting_length(setting);
+
+		for(i = 0; i < count; ++i)
+		{
+			config_setting_t *book = config_setting_get_elem(setting, i);
+
+			/* Only output the record if all of the expected fields are present. */
+			const char *port_server, *port_client;
+
+			if(!(config_setting_lookup_string(book, "server", &port_server)
+					 && config_setting_lookup_string(book, "client", &port_client)))
+				continue;
+
+			/* add the ports found in config file to the list of ports to connect */
+			/* for inputs, jack port is the input and shall be first in the array */
+			add_connection (map, port_server, port_client);
+		}
+	}
+
+	/* click outputs: audio port of metronome click */
+	setting = config_lookup(&cfg, "connections.click_output");
+	if(setting != NULL)
+	{
+		int count = config_setting_length(setting);
+
+		for(i = 0; i < count; ++i)
+		{
+			config_setting_t *book = config_setting_get_elem(setting, i);
+
+			/* Only output the record if all of the expected fields are present. */
+			const char *port_server, *port_client;
+
+			if(!(config_setting_lookup_string(book, "server", &port_server)
+					 && config_setting_lookup_string(book, "client", &port_client)))
+				continue;
+
+			/* add the ports found in config file to the list of ports to connect */
+			/* for inputs, jack port is the input and shall be first in the array */
+			add_connection (map, port_server, port_client);
+		}
+	}
+
+
+	/*********************************************************************************************************/
+	/* Read surfaces settings : controls, leds and output of each midi control surface connected to synthi  */
+	/*********************************************************************************************************/
+
+	setting = config_lookup(&cfg, "surfaces");
+	if (setting != NULL)
+	{
+		int count = config_setting_length(setting);
+
+		/* Check we don't have a too large number of surfaces defined, in which case we set to the maximum */
+		if (count > MAX_SURFACES) count = MAX_SURFACES;
+
+		/* read element by element: each surface has its own filename and functions groups */
+		for (i = 0; i < count; ++i)
+		{
+			config_setting_t *book = config_setting_get_elem (setting, i);
+
+			read_filename (config_setting_get_member (book, "filename"), &map->surface [i]);
+			read_functions (config_setting_get_member (book, "functions"), &map->surface [i]);
+			read_output (book, &map->surface [i]);
+		}
+		map->nb_surfaces = (count > 0) ? count : 1;
+	}
+	else
+	{
+		/* no surfaces list: a single surface is defined by the filename, functions and surface groups */
+		read_filename (config_lookup(&cfg, "filename"), &map->surface [0]);
+		read_functions (config_lookup(&cfg, "functions"), &map->surface [0]);
+		read_output (config_lookup(&cfg, "surface"), &map->surface [0]);
+		map->nb_surfaces = 1;
+	}
+
+	/* build lookup tables used to dispatch midi in events of each surface */
+	for (i = 0; i < map->nb_surfaces; i++) build_dispatch (&map->surface [i]);
+
+
+	/*****************************************************************/
+	/* Read global functions settings : tempo fader range, smoothing */
+	/*****************************************************************/
+
+	/* bpm range of tempo fader */
+	setting = config_lookup(&cfg, "functions.tempo_range");
+	if ((setting != NULL) && (config_setting_length(setting) == 2))
+	{
+		map->fader.tempo_min = config_setting_get_int_elem (setting, 0);
+		map->fader.tempo_max = config_setting_get_int_elem (setting, 1);
+	}
+
+	/* smoothing time constant of volume and tempo changes, in ms */
+	setting = config_lookup(&cfg, "functions.smoothing_ms");
+	if (setting != NULL)
+	{
+		map->fader.smoothing_ms = (float) config_setting_get_int (setting);
+		if (map->fader.smoothing_ms < 1.0f) map->fader.smoothing_ms = 1.0f;
+	}
+
+
+	/********************************************************/
+	/* Read control endpoint settings : address, udp port  */
+	/********************************************************/
+
+	setting = config_lookup(&cfg, "control");
+	if (setting != NULL)
+	{
+		if (config_setting_lookup_string (setting, "address", &str)) {
+			strncpy (map->control_address, str, CONTROL_ADDRESS_LEN - 1);
+		}
+		if (!config_setting_lookup_int (setting, "port", &map->control_port)) {
+			fprintf ( stderr, "Unable to read control port.\n" );
+			map->control_port = 0;
+		}
+	}
+
+
+	/* load samples of the presets played by the song only, instead of the whole soundfont */
+	setting = config_lookup(&cfg, "soundfont.lazy_loading");
+	if (setting != NULL) map->lazy_loading = config_setting_get_bool (setting);
+
+	/* file where session state is saved, and restored at startup */
+	if (config_lookup_string(&cfg, "session.file", &str)) {
+		strncpy (map->session_file, str, PATH_LEN - 1);
+		map->session_file [PATH_LEN - 1] = 0;
+	}
+
+	/* pre-rendered audio of heavy songs: songs with peak polyphony from min_polyphony are rendered in cache directory */
+	setting = config_lookup(&cfg, "prerender.min_polyphony");
+	if (setting != NULL) map->prerender_polyphony = config_setting_get_int (setting);
+	if (config_lookup_string(&cfg, "prerender.directory", &str)) {
+		strncpy (map->prerender_dir, str, PATH_LEN - 2);
+		map->prerender_dir [PATH_LEN - 2] = 0;
+		if ((map->prerender_dir [0] != 0) && (map->prerender_dir [strlen (map->prerender_dir) - 1] != '/')) strcat (map->prerender_dir, "/");
+	}
+
+	/* metronome click: count-in bars before the song starts (0 to 2), and level of click on its audio port */
+	setting = config_lookup(&cfg, "click.count_in");
+	if (setting != NULL) map->count_in = config_setting_get_int (setting);
+	if (map->count_in < 0) map->count_in = 0;
+	if (map->count_in > MAX_COUNT_IN) map->count_in = MAX_COUNT_IN;
+	setting = config_lookup(&cfg, "click.level");
+	if (setting != NULL) map->click_level = (float) config_setting_get_float (setting);
+
+	/* number of bars jumped by back and forward pads */
+	setting = config_lookup(&cfg, "seek.bars");
+	if (setting != NULL) map->seek_bars = config_setting_get_int (setting);
+
+	/* file where calibration profile (synthesis settings measured on device) is written, and loaded at startup */
+	if (config_lookup_string(&cfg, "calibration.profile", &str)) {
+		strncpy (map->profile_file, str, PATH_LEN - 1);
+		map->profile_file [PATH_LEN - 1] = 0;
+	}
+
+	/* soundfont changed while playing: programs are re-bound to the new soundfont at next "beat" or "bar" */
+	setting = config_lookup(&cfg, "soundfont.swap_at");
+	if ((setting != NULL) && (config_setting_get_string (setting) != NULL)) {
+		if (strcmp (config_setting_get_string (setting), "beat") == 0) map->swap_at = SWAP_BEAT;
+		else map->swap_at = SWAP_BAR;
+	}
+
+	/* setlist: ordered list of songs, stepped through with next and prev pads */
+	setting = config_lookup(&cfg, "setlist");
+	if (setting != NULL)
+	{
+		int count = config_setting_length(setting);
+
+		/* Check we don't have a too large number of entries defined, in which case we set to the maximum */
+		if (count > MAX_SETLIST) count = MAX_SETLIST;
+
+		for (i = 0; i < count; ++i)
+		{
+			config_setting_t *book = config_setting_get_elem (setting, i);
+			int song, soundfont, bank;
+
+			if(!(config_setting_lookup_int(book, "song", &song)
+					 && config_setting_lookup_int(book, "soundfont", &soundfont)))
+				continue;
+			map->setlist [map->nb_setlist][0] = song & 0xFF;
+			map->setlist [map->nb_setlist][1] = soundfont & 0xFF;
+			/* banks of song and of soundfont are optional: bank 0 by default */
+			if (!config_setting_lookup_int(book, "bank", &bank) || (bank < 0) || (bank >= MAX_BANKS)) bank = 0;
+			map->setlist_bank [map->nb_setlist][0] = bank;
+			if (!config_setting_lookup_int(book, "soundfont_bank", &bank) || (bank < 0) || (bank >= MAX_BANKS)) bank = 0;
+			map->setlist_bank [map->nb_setlist][1] = bank;
+			map->nb_setlist++;
+		}
+	}
+
+	/* parts: channels (1 to 16) rendered by each part, in parallel with main synth which renders the other channels */
+	setting = config_lookup(&cfg, "parts.split");
+	if (setting != NULL)
+	{
+		config_setting_t *part;
+		int count = config_setting_length(setting);
+		int channel;
+
+		if (count > MAX_PARTS - 1) {
+			fprintf ( stderr, "too many parts defined in config file: %d parts used.\n", MAX_PARTS - 1 );
+			count = MAX_PARTS - 1;
+		}
+		for (i = 0; i < count; i++) {
+			part = config_setting_get_elem(setting, i);
+			for (j = 0; j < config_setting_length(part); j++) {
+				channel = config_setting_get_int_elem(part, j);
+				if ((channel >= 1) && (channel <= 16)) map->channel_part [channel - 1] = i + 1;
+			}
+		}
+		map->nb_parts = count + 1;
+	}
+
+	/* realtime setup: memory locking, cores and priorities of threads */
+	read_realtime (config_lookup(&cfg, "realtime"), &map->realtime);
+
+	/* load governor: polyphony lowered and notes released when DSP load is high */
+	read_governor (config_lookup(&cfg, "governor"), &map->governor);
+
+
+	/* successful reading, exit */
+	config_destroy(&cfg);
+	return(EXIT_SUCCESS);
+}
+
+
+// create a new mapping, with default settings; the mapping is then filled by read_config ()
+mapping_t *new_mapping ()
+{
+	mapping_t *map;
+	int i;
+
+	map = calloc (1, sizeof (mapping_t));
+	if (map == NULL) return NULL;
+
+	/* by default, surfaces get individual led messages */
+	for (i = 0; i < MAX_SURFACES; i++) {
+		map->surface[i].type = SURFACE_GENERIC;
+		map->surface[i].bytes_per_ms = DEFAULT_BYTES_PER_MS;
+	}
+	map->nb_surfaces = 1;
+
+	/* set default tempo range and smoothing */
+	map->fader.tempo_min = DEFAULT_TEMPO_MIN;
+	map->fader.tempo_max = DEFAULT_TEMPO_MAX;
+	map->fader.smoothing_ms = DEFAULT_SMOOTHING_MS;
+
+	/* by default, control endpoint only listens to local clients, if a port is given */
+	strcpy (map->control_address, "127.0.0.1");
+	map->control_port = 0;
+
+	/* by default, soundfont is swapped on a bar boundary while playing */
+	map->swap_at = SWAP_BAR;
+
+	/* by default, memory is locked within budget, and threads run on any core with the priority they are given */
+	map->realtime.lock_memory = TRUE;
+	map->realtime.memory_budget_mb = DEFAULT_MEMORY_BUDGET_MB;
+	map->realtime.stack_kb = DEFAULT_STACK_KB;
+	for (i = 0; i < RT_NB_THREADS; i++) map->realtime.core [i] = -1;
+	for (i = RT_PART; i < RT_NB_THREADS; i++) map->realtime.priority [i] = DEFAULT_PART_PRIORITY;
+
+	/* by default, all channels are rendered by main synth */
+	map->nb_parts = 1;
+
+	/* by default, no song is pre-rendered */
+	map->prerender_polyphony = 0;
+	strcpy (map->prerender_dir, DEFAULT_PRERENDER_DIR);
+
+	/* by default, a bar of count-in */
+	map->count_in = DEFAULT_COUNT_IN;
+	map->click_level = DEFAULT_CLICK_LEVEL;
+
+	/* by default, back and forward pads jump 4 bars */
+	map->seek_bars = DEFAULT_SEEK_BARS;
+
+	/* by default, calibration profile is in synthi directory */
+	strcpy (map->profile_file, DEFAULT_PROFILE_FILE);
+
+	/* by default, governor watches load; bass (channel 2) is released last after drums */
+	map->governor.enabled = TRUE;
+	map->governor.high = DEFAULT_GOVERNOR_HIGH;
+	map->governor.low = DEFAULT_GOVERNOR_LOW;
+	map->governor.min_polyphony = DEFAULT_MIN_POLYPHONY;
+	map->governor.max_polyphony = DEFAULT_MAX_POLYPHONY;
+	map->governor.important [0] = 1;
+	map->governor.nb_important = 1;
+
+	return map;
+}
+
+
+// register midi in and midi out ports of the surfaces of a mapping
+// ports of the surfaces already existing in old mapping are reused; old may be NULL
+int register_ports (mapping_t *map, mapping_t *old)
+{
+	char name [PORT_NAME_LEN];
+	int i;
+
+	for (i = 0; i < map->nb_surfaces; i++) {
+		/* surface already exists: keep its ports (and its connections) */
+		if ((old != NULL) && (i < old->nb_surfaces)) {
+			map->surface[i].input_port = old->surface[i].input_port;
+			map->surface[i].output_port = old->surface[i].output_port;
+			continue;
+		}
+
+		/* register midi-in port: this port will get the midi keys notification (from UI) */
+		sprintf (name, "midi_input_%d", i + 1);
+		map->surface[i].input_port = jack_port_register (client, name, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+		if (map->surface[i].input_port == NULL ) {
+			fprintf ( stderr, "no more JACK MIDI ports available.\n" );
+			return (EXIT_FAILURE);
+		}
+
+		/* register midi-out port: this port will send the midi notifications to light on/off pad leds */
+		sprintf (name, "midi_output_%d", i + 1);
+		map->surface[i].output_port = jack_port_register (client, name, JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+		if (map->surface[i].output_port == NULL ) {
+			fprintf ( stderr, "no more JACK MIDI ports available.\n" );
+			return (EXIT_FAILURE);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+
+// unregister midi ports of the surfaces of a mapping, starting from surface number first
+static void unregister_ports (mapping_t *map, int first)
+{
+	int i;
+
+	for (i = first; i < map->nb_surfaces; i++) {
+		if (map->surface[i].input_port != NULL) jack_port_unregister (client, map->surface[i].input_port);
+		if (map->surface[i].output_port != NULL) jack_port_unregister (client, map->surface[i].output_port);
+		map->surface[i].input_port = NULL;
+		map->surface[i].output_port = NULL;
+	}
+}
+
+
+// check whether a pair of ports (server, client) is in the list of ports to connect of a mapping
+static int has_connection (mapping_t *map, char *port_server, char *port_client)
+{
+	int i;
+
+	for (i = 0; i < map->nb_connections; i++) {
+		if ((strcmp (map->connection[i][0], port_server) == 0) && (strcmp (map->connection[i][1], port_client) == 0)) return TRUE;
+	}
+	return FALSE;
+}
+
+
+// get the list of jack ports matching a port name of config file
+// port name is either an exact name, a wildcard pattern (* and ?) or a regular expression between slashes (/regex/)
+// returns a NULL-terminated list to be freed with jack_free (), or NULL if no port matches (yet)
+static const char **match_ports (char *name, unsigned long flags)
+{
+	char regex [(2 * PORT_NAME_LEN) + 3];
+	int len, i, j;
+
+	len = strlen (name);
+
+	/* regular expression: use it as is */
+	if ((len > 2) && (name [0] == '/') && (name [len - 1] == '/')) {
+		strncpy (regex, &name [1], len - 2);
+		regex [len - 2] = '\0';
+		return jack_get_ports (client, regex, NULL, flags);
+	}
+
+	/* exact name or wildcard pattern: convert to an anchored regular expression */
+	j = 0;
+	regex [j++] = '^';
+	for (i = 0; i < len; i++) {
+		if (name [i] == '*') {
+			regex [j++] = '.';
+			regex [j++] = '*';
+		}
+		else if (name [i] == '?') regex [j++] = '.';
+		else {
+			/* escape characters which have a meaning in regular expressions, such as () in a2j port names */
+			if (strchr (".[]()\\^$+{}|", name [i]) != NULL) regex [j++] = '\\';
+			regex [j++] = name [i];
+		}
+	}
+	regex [j++] = '$';
+	regex [j] = '\0';
+
+	return jack_get_ports (client, regex, NULL, flags);
+}
+
+
+// connect (or disconnect) all the ports matching a pair (server, client) of port names of config file
+// if both server and client names match several ports, ports are connected in order, pair by pair (eg. left to 1, right to 2);
+// otherwise, each port of one side is connected to the port(s) of the other side
+// ports already connected are left untouched; verbose reports port names that don't match any port yet
+// returns the number of connections made
+static int connect_pair (char *port_server, char *port_client, int connect, int verbose)
+{
+	const char **servers, **clients;
+	int nb_servers, nb_clients;
+	int i, j, connected;
+	int nb_made = 0;
+
+	/* server ports are outputs, client ports are inputs */
+	servers = match_ports (port_server, JackPortIsOutput);
+	clients = match_ports (port_client, JackPortIsInput);
+
+	if ((servers == NULL) || (clients == NULL)) {
+		if (verbose) fprintf (stderr, "ports not available yet, will connect when they appear: %s , %s\n", port_server, port_client);
+		if (servers != NULL) jack_free (servers);
+		if (clients != NULL) jack_free (clients);
+		return 0;
+	}
+
+	for (nb_servers = 0; servers [nb_servers] != NULL; nb_servers++);
+	for (nb_clients = 0; clients [nb_clients] != NULL; nb_clients++);
+
+	for (i = 0; i < nb_servers; i++) {
+		for (j = 0; j < nb_clients; j++) {
+			/* several ports on both sides: connect them pair by pair */
+			if ((nb_servers > 1) && (nb_clients > 1) && (i != j)) continue;
+
+			connected = jack_port_connected_to (jack_port_by_name (client, servers [i]), clients [j]);
+
+			if (connect && !connected) {
+				fprintf (stderr, "server: %s , client: %s\n", servers [i], clients [j]);
+				if ( jack_connect ( client, servers [i], clients [j]) ) {
+					fprintf ( stderr, "cannot connect ports (between client and server).\n" );
+				}
+				else nb_made++;
+			}
+
+			if (!connect && connected) {
+				fprintf (stderr, "disconnect server: %s , client: %s\n", servers [i], clients [j]);
+				jack_disconnect (client, servers [i], clients [j]);
+			}
+		}
+	}
+
+	jack_free (servers);
+	jack_free (clients);
+	return nb_made;
+}
+
+
+// connect the ports of a mapping by pair (server, client)
+// if old mapping is given, only the differences are applied: connections of old mapping which are not in new
+// mapping are removed, and only connections which are not in old mapping are made; old may be NULL
+void connect_ports (mapping_t *map, mapping_t *old)
+{
+	int i;
+
+	fprintf (stderr, "attempt to connect input-output ports together.\n");
+
+	/* remove connections which are not in new mapping any more */
+	if (old != NULL) {
+		for (i = 0; i < old->nb_connections; i++) {
+			if (has_connection (map, old->connection[i][0], old->connection[i][1])) continue;
+			connect_pair (old->connection[i][0], old->connection[i][1], FALSE, FALSE);
+		}
+	}
+
+	/* make new connections */
+	for (i = 0; i < map->nb_connections; i++) {
+		if ((old != NULL) && has_connection (old, map->connection[i][0], map->connection[i][1])) continue;
+		connect_pair (map->connection[i][0], map->connection[i][1], TRUE, TRUE);
+	}
+}
+
+
+// make again the connections of a mapping which are missing; called when ports appear or get disconnected
+// (hotplug of a surface, restart of a2jmidid or boocli...), so that connections are re-established straight away
+// returns the number of connections made
+int reconnect_ports (mapping_t *map)
+{
+	int i;
+	int nb_made = 0;
+
+	for (i = 0; i < map->nb_connections; i++) {
+		nb_made += connect_pair (map->connection[i][0], map->connection[i][1], TRUE, FALSE);
+	}
+	return nb_made;
+}
+
+
+// mappings replaced by a reloaded one while process callback was stalled, waiting for the end of the cycles that may still use them
+static mapping_t *retired;
+
+
+// wait until the process callback has completed nb cycles since start: an old mapping can't be used any more after that
+// give up after 1 sec, as process callback is not called when jack is stopped; returns TRUE if cycles have completed
+static int wait_process_cycles (uint32_t start, uint32_t nb)
+{
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		if ((uint32_t) (__atomic_load_n (&process_cycle, __ATOMIC_ACQUIRE) - start) >= nb) return TRUE;
+		usleep (1000);
+	}
+	return FALSE;
+}
+
+
+// free the retired mappings which can't be used by process callback any more; returns number of mappings still retired
+// ports of the surfaces gone with a mapping are unregistered with it; if force is TRUE, all of them are freed without
+// unregistering ports: jack client must be closed
+int mapping_reclaim (int force)
+{
+	mapping_t **prev, *map;
+	uint32_t cycle;
+	int nb = 0;
+
+	cycle = __atomic_load_n (&process_cycle, __ATOMIC_ACQUIRE);
+
+	prev = &retired;
+	while ((map = *prev) != NULL) {
+		// 2 cycles have completed since retirement: the cycle that may have read the mapping is over
+		if (force || ((uint32_t) (cycle - map->retired_cycle) >= 2)) {
+			*prev = map->next;
+			if (!force) unregister_ports (map, 0);
+			free (map);
+		}
+		else {
+			prev = &map->next;
+			nb++;
+		}
+	}
+
+	return nb;
+}
+
+
+// reload config file without stopping: the file is read into a fresh mapping, away from the process callback
+// the new mapping is swapped with the current one between 2 process cycles, then port connections are updated
+// called from main thread only; current mapping is kept if config file can't be read
+int reload_config (char *name)
+{
+	mapping_t *old, *map;
+	int i;
+
+	fprintf (stderr, "reloading config file.\n");
+
+	old = mapping;
+	map = new_mapping ();
+	if (map == NULL) return (EXIT_FAILURE);
+
+	/* read config file into new mapping */
+	if (read_config (name, map) == EXIT_FAILURE) {
+		fprintf ( stderr, "error in reading config file, keeping current config.\n" );
+		free (map);
+		return (EXIT_FAILURE);
+	}
+
+	/* get ports of surfaces: existing ports are reused, ports of new surfaces are registered */
+	if (register_ports (map, old) == EXIT_FAILURE) {
+		unregister_ports (map, old->nb_surfaces);
+		free (map);
+		return (EXIT_FAILURE);
+	}
+
+	/* all leds shall be sent to the surfaces of new mapping */
+	led_repaint (map);
+
+	/* swap mappings; then wait for process callback to complete the cycle which may still use old mapping */
+	__atomic_store_n (&mapping, map, __ATOMIC_RELEASE);
+	old->retired_cycle = __atomic_load_n (&process_cycle, __ATOMIC_ACQUIRE);
+	connect_ports (map, old);
+	if (!wait_process_cycles (old->retired_cycle, 2)) {
+		/* process callback is stalled or jack is stopped: old mapping may still be used, it is freed by mapping_reclaim () */
+		fprintf ( stderr, "process cycles not completed, old config is freed later.\n" );
+		/* ports reused by new mapping are not owned by old mapping any more: only those of surfaces gone are unregistered with it */
+		for (i = 0; (i < map->nb_surfaces) && (i < old->nb_surfaces); i++) {
+			old->surface[i].input_port = NULL;
+			old->surface[i].output_port = NULL;
+		}
+		old->next = retired;
+		retired = old;
+		return (EXIT_SUCCESS);
+	}
+
+	/* old mapping is not used any more: remove ports of surfaces which are gone, free it */
+	unregister_ports (old, map->nb_surfaces);
+	free (old);
+
+	return (EXIT_SUCCESS);
 }
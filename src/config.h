@@ -4,4 +4,10 @@
  *
  */
 
-int read_config (char *);
+int read_config (char *, mapping_t *);
+mapping_t *new_mapping ();
+int register_ports (mapping_t *, mapping_t *);
+void connect_ports (mapping_t *, mapping_t *);
+int reconnect_ports (mapping_t *);
+int mapping_reclaim (int);
+int reload_config (char *);
@@ -0,0 +1,536 @@
+/** @file control.c
+ *
+ * @brief Control endpoint: OSC messages over UDP, to drive synthi from a tablet or scripts
+ * without emulating a midi control surface. Messages are received by a non-realtime thread,
+ * and sent to the process callback as commands, through a lock-free ring.
+ *
+ * Messages understood (all under /synthi):
+ *   /synthi/load [song [soundfont [bank [sf_bank]]]]	load files; names not given are the ones set by pads, banks are the ones selected
+ *   /synthi/bank bank [sf_bank]		select bank of songs, and bank of soundfonts
+ *   /synthi/play [0|1]					toggle play, or play (1) or stop (0)
+ *   /synthi/stop						stop
+ *   /synthi/tempo bpm					set tempo (smoothed)
+ *   /synthi/volume level				set volume, from 0 to 1.0 (smoothed)
+ *   /synthi/seek tick					move to tick in song
+ *   /synthi/bar bar					move to start of bar (1 for first bar)
+ *   /synthi/back, /synthi/forward		jump some bars back or forward (same as back and forward pads)
+ *   /synthi/loop [first last]			loop bars first to last (1 for first bar) until released; no argument: same as loop pad
+ *   /synthi/beat						same as beat pad
+ *   /synthi/next, /synthi/prev			load next or previous entry of setlist (same as next and prev pads)
+ *   /synthi/state						reply with a bundle giving the whole state
+ *   /synthi/subscribe					get a state bundle each time state changes
+ *   /synthi/unsubscribe
+ * Numeric arguments may be int (i), float (f), double (d) or boolean (T, F).
+ */
+
+#include <pthread.h>
+#include <poll.h>
+#include <limits.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "types.h"
+#include "globals.h"
+#include "control.h"
+#include "player.h"
+#include "utils.h"
+#include "rt.h"
+
+
+// ring of commands sent to process callback: producers (control thread, main thread) are serialized by a lock,
+// single consumer (process callback) reads without lock
+static command_t command_ring [COMMAND_RING_SIZE];
+static uint32_t command_write;
+static uint32_t command_read;
+static pthread_mutex_t command_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// state published by process callback, protected by a sequence number (odd while state is being written)
+static state_t state;
+static uint32_t state_seq;
+
+// socket and clients getting notifications
+static int control_socket = -1;
+static struct sockaddr_in subscriber [MAX_SUBSCRIBERS];
+static int nb_subscribers;
+
+
+/***************************************************/
+/* command ring: control and main threads to process callback */
+/***************************************************/
+
+// add a command to the ring; returns FALSE if ring is full; never called by process callback
+int command_push (command_t *cmd)
+{
+	uint32_t w;
+
+	pthread_mutex_lock (&command_lock);
+	w = __atomic_load_n (&command_write, __ATOMIC_RELAXED);
+	if (w - __atomic_load_n (&command_read, __ATOMIC_ACQUIRE) >= COMMAND_RING_SIZE) {
+		pthread_mutex_unlock (&command_lock);
+		return FALSE;
+	}
+
+	command_ring [w & (COMMAND_RING_SIZE - 1)] = *cmd;
+	__atomic_store_n (&command_write, w + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock (&command_lock);
+	return TRUE;
+}
+
+// get next command from the ring; returns FALSE if there is no command; called by process callback only
+int command_pull (command_t *cmd)
+{
+	uint32_t r;
+
+	r = __atomic_load_n (&command_read, __ATOMIC_RELAXED);
+	if (r == __atomic_load_n (&command_write, __ATOMIC_ACQUIRE)) return FALSE;
+
+	*cmd = command_ring [r & (COMMAND_RING_SIZE - 1)];
+	__atomic_store_n (&command_read, r + 1, __ATOMIC_RELEASE);
+	return TRUE;
+}
+
+
+/*****************************************************/
+/* state: process callback to control thread         */
+/*****************************************************/
+
+// publish state of the player of engine; called by process callback once per cycle (read by control endpoint and session)
+void state_publish (engine_t *eng)
+{
+	uint32_t seq;
+	int value;
+
+	// player not created yet
+	if (eng == NULL) return;
+
+	seq = __atomic_load_n (&state_seq, __ATOMIC_RELAXED);
+	__atomic_store_n (&state_seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+
+	state.song = name_to_byte (&filename [0]);
+	state.soundfont = name_to_byte (&filename [1]);
+	state.bank = song_bank;
+	state.sf2_bank = sf2_bank;
+	state.play = is_play;
+	state.load = is_load;
+	state.volume = gain_target;
+	// tempo set by pads or fader; else tempo of the file
+	state.is_tempo = (tempo > 0.0f);
+	if (tempo > 0.0f) state.tempo = tempo;
+	else {
+		value = player_get_bpm (eng);
+		state.tempo = (value == FLUID_FAILED) ? 0.0f : (float) value;
+	}
+	state.tick = player_get_current_tick (eng);
+	state.total_ticks = player_get_total_ticks (eng);
+	state.bar = player_bar_at (eng, state.tick);
+	state.nb_bars = player_get_nb_bars (eng);
+
+	__atomic_store_n (&state_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// get a consistent copy of the state published by process callback; used by control thread, and by main thread to save session
+void state_read (state_t *st)
+{
+	uint32_t seq1, seq2;
+
+	do {
+		seq1 = __atomic_load_n (&state_seq, __ATOMIC_ACQUIRE);
+		memcpy (st, &state, sizeof (state_t));
+		__atomic_thread_fence (__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n (&state_seq, __ATOMIC_RELAXED);
+	} while ((seq1 != seq2) || (seq1 & 1));
+}
+
+
+/*****************************************************/
+/* OSC encoding and decoding                         */
+/*****************************************************/
+
+// size of an OSC string, including terminating 0 and padding to 4 bytes
+static int osc_string_size (const char *str, int max)
+{
+	int len;
+
+	len = strnlen (str, max);
+	if (len == max) return -1;		// string is not terminated inside the packet
+	return (len + 4) & ~3;
+}
+
+// write an OSC message with a single int or float argument (type is 'i' or 'f') at buf; returns size of message
+static int osc_write (char *buf, const char *address, char type, int i, float f)
+{
+	int size;
+	uint32_t value;
+
+	size = osc_string_size (address, OSC_BUFFER_LEN);
+	memset (buf, 0, size + 4);
+	strcpy (buf, address);
+	buf [size] = ',';
+	buf [size + 1] = type;
+	size += 4;
+
+	if (type == 'f') memcpy (&value, &f, 4);
+	else value = (uint32_t) i;
+	value = htonl (value);
+	memcpy (&buf [size], &value, 4);
+
+	return size + 4;
+}
+
+// append an OSC message to a bundle; returns new size of bundle
+static int osc_bundle_add (char *buf, int size, const char *address, char type, int i, float f)
+{
+	uint32_t len;
+
+	len = osc_write (&buf [size + 4], address, type, i, f);
+	len = htonl (len);
+	memcpy (&buf [size], &len, 4);
+	return size + 4 + ntohl (len);
+}
+
+// write state as an OSC bundle (to be executed immediately); returns size of bundle
+static int osc_state_bundle (char *buf, state_t *st)
+{
+	int size;
+
+	memcpy (buf, "#bundle\0", 8);
+	memset (&buf [8], 0, 8);
+	buf [15] = 1;			// time tag 1 means immediately
+	size = 16;
+
+	size = osc_bundle_add (buf, size, "/synthi/song", 'i', st->song, 0.0f);
+	size = osc_bundle_add (buf, size, "/synthi/soundfont", 'i', st->soundfont, 0.0f);
+	size = osc_bundle_add (buf, size, "/synthi/bank", 'i', st->bank, 0.0f);
+	size = osc_bundle_add (buf, size, "/synthi/sf_bank", 'i', st->sf2_bank, 0.0f);
+	size = osc_bundle_add (buf, size, "/synthi/play", 'i', st->play, 0.0f);
+	size = osc_bundle_add (buf, size, "/synthi/load", 'i', st->load, 0.0f);
+	size = osc_bundle_add (buf, size, "/synthi/tempo", 'f', 0, st->tempo);
+	size = osc_bundle_add (buf, size, "/synthi/volume", 'f', 0, st->volume);
+	size = osc_bundle_add (buf, size, "/synthi/tick", 'i', st->tick, 0.0f);
+	size = osc_bundle_add (buf, size, "/synthi/ticks", 'i', st->total_ticks, 0.0f);
+	size = osc_bundle_add (buf, size, "/synthi/bar", 'i', st->bar + 1, 0.0f);
+	size = osc_bundle_add (buf, size, "/synthi/bars", 'i', st->nb_bars, 0.0f);
+
+	return size;
+}
+
+// read numeric arguments of an OSC message; returns number of arguments read, -1 if message is malformed
+static int osc_read_args (char *buf, int len, double *arg)
+{
+	int pos, size, nb = 0;
+	char *types;
+	uint32_t u32;
+	uint64_t u64;
+	float f;
+	double d;
+
+	// skip address
+	pos = osc_string_size (buf, len);
+	if (pos < 0) return -1;
+
+	// no type tag string: no argument
+	if ((pos >= len) || (buf [pos] != ',')) return 0;
+	types = &buf [pos + 1];
+	size = osc_string_size (&buf [pos], len - pos);
+	if (size < 0) return -1;
+	pos += size;
+
+	for (; (*types != 0) && (nb < OSC_MAX_ARGS); types++) {
+		switch (*types) {
+			case 'i':
+			case 'f':
+				if (pos + 4 > len) return -1;
+				memcpy (&u32, &buf [pos], 4);
+				u32 = ntohl (u32);
+				if (*types == 'i') arg [nb++] = (double) (int32_t) u32;
+				else {
+					memcpy (&f, &u32, 4);
+					arg [nb++] = (double) f;
+				}
+				pos += 4;
+				break;
+			case 'd':
+			case 'h':
+				if (pos + 8 > len) return -1;
+				memcpy (&u64, &buf [pos], 8);
+				u64 = be64toh (u64);
+				if (*types == 'h') arg [nb++] = (double) (int64_t) u64;
+				else {
+					memcpy (&d, &u64, 8);
+					arg [nb++] = d;
+				}
+				pos += 8;
+				break;
+			case 'T':
+				arg [nb++] = 1.0;
+				break;
+			case 'F':
+				arg [nb++] = 0.0;
+				break;
+			case 's':
+				// string arguments are skipped
+				size = osc_string_size (&buf [pos], len - pos);
+				if (size < 0) return -1;
+				pos += size;
+				break;
+			default:
+				// other types: size is unknown, stop reading
+				return nb;
+		}
+	}
+
+	return nb;
+}
+
+
+/*****************************************************/
+/* handling of messages                              */
+/*****************************************************/
+
+// send state to a client
+static void send_state (struct sockaddr_in *to, state_t *st)
+{
+	char buf [OSC_BUFFER_LEN];
+	int size;
+
+	size = osc_state_bundle (buf, st);
+	sendto (control_socket, buf, size, 0, (struct sockaddr *) to, sizeof (struct sockaddr_in));
+}
+
+// add or remove a client from the list of subscribers
+static void subscribe (struct sockaddr_in *from, int add)
+{
+	int i;
+
+	for (i = 0; i < nb_subscribers; i++) {
+		if ((subscriber[i].sin_addr.s_addr == from->sin_addr.s_addr) && (subscriber[i].sin_port == from->sin_port)) break;
+	}
+
+	// remove client by replacing it with the last one
+	if (!add) {
+		if (i < nb_subscribers) subscriber [i] = subscriber [--nb_subscribers];
+		return;
+	}
+
+	// add client, if not already in the list
+	if (i < nb_subscribers) return;
+	if (nb_subscribers == MAX_SUBSCRIBERS) {
+		fprintf ( stderr, "Too many control subscribers.\n" );
+		return;
+	}
+	subscriber [nb_subscribers++] = *from;
+}
+
+// send a command to process callback
+static void send_command (int dest, int row, int col, int value)
+{
+	command_t cmd;
+
+	cmd.dest = dest;
+	cmd.row = row;
+	cmd.col = col;
+	cmd.value = value;
+	if (!command_push (&cmd)) fprintf ( stderr, "Control command lost.\n" );
+}
+
+// OSC argument as an int, clamped to [min, max]: numbers sent by clients may be out of the range of int
+static int arg_int (double arg, int min, int max)
+{
+	return (int) fmin (fmax (arg, (double) min), (double) max);
+}
+
+// process an OSC message received from a client
+static void message_process (char *buf, int len, struct sockaddr_in *from)
+{
+	double arg [OSC_MAX_ARGS];
+	int nb, first;
+	state_t st;
+
+	nb = osc_read_args (buf, len, arg);
+	if (nb < 0) return;
+
+	if (!strcmp (buf, "/synthi/load")) {
+		// names are given: load them; else load the names set by pads
+		if (nb >= 4) send_command (COMMANDS, 4, CMD_LOAD, arg_int (arg [0], 0, 0xFF) | (arg_int (arg [1], 0, 0xFF) << 8) | (arg_int (arg [2], 0, 0xFF) << 16) | (arg_int (arg [3], 0, 0x7F) << 24));
+		else if (nb >= 3) send_command (COMMANDS, 3, CMD_LOAD, arg_int (arg [0], 0, 0xFF) | (arg_int (arg [1], 0, 0xFF) << 8) | (arg_int (arg [2], 0, 0xFF) << 16));
+		else if (nb >= 2) send_command (COMMANDS, 2, CMD_LOAD, arg_int (arg [0], 0, 0xFF) | (arg_int (arg [1], 0, 0xFF) << 8));
+		else if (nb == 1) send_command (COMMANDS, 1, CMD_LOAD, arg_int (arg [0], 0, 0xFF));
+		else send_command (NAMES, 0, LOAD, 0);
+	}
+	else if (!strcmp (buf, "/synthi/play")) {
+		// no argument: same as play pad
+		if (nb >= 1) send_command (COMMANDS, 0, CMD_PLAY, (arg [0] != 0.0) ? TRUE : FALSE);
+		else send_command (NAMES, 0, PLAY, 0);
+	}
+	else if (!strcmp (buf, "/synthi/stop")) {
+		send_command (COMMANDS, 0, CMD_PLAY, FALSE);
+	}
+	else if (!strcmp (buf, "/synthi/tempo")) {
+		if ((nb >= 1) && (arg [0] > 0.0)) send_command (COMMANDS, 0, CMD_TEMPO, (int) lround (fmin (arg [0], OSC_MAX_BPM) * 100.0));
+	}
+	else if (!strcmp (buf, "/synthi/volume")) {
+		// same as volume fader
+		if (nb >= 1) send_command (FADERS, 0, FADER_VOLUME, (int) lround (fmin (fmax (arg [0], 0.0), 1.0) * 127.0));
+	}
+	else if (!strcmp (buf, "/synthi/bank")) {
+		if (nb >= 1) send_command (COMMANDS, 0, CMD_BANK, arg_int (arg [0], -1, MAX_BANKS));
+		if (nb >= 2) send_command (COMMANDS, 1, CMD_BANK, arg_int (arg [1], -1, MAX_BANKS));
+	}
+	else if (!strcmp (buf, "/synthi/seek")) {
+		if ((nb >= 1) && (arg [0] >= 0.0)) send_command (COMMANDS, 0, CMD_SEEK, arg_int (arg [0], 0, INT_MAX));
+	}
+	else if (!strcmp (buf, "/synthi/bar")) {
+		if ((nb >= 1) && (arg [0] >= 1.0)) send_command (COMMANDS, 0, CMD_BAR, arg_int (arg [0], 1, INT_MAX) - 1);
+	}
+	else if (!strcmp (buf, "/synthi/back")) {
+		send_command (FCT, 0, BACK, 0);
+	}
+	else if (!strcmp (buf, "/synthi/forward")) {
+		send_command (FCT, 0, FORWARD, 0);
+	}
+	else if (!strcmp (buf, "/synthi/loop")) {
+		// first bar and number of bars are packed in 15 and 16 bits
+		if ((nb >= 2) && (arg [0] >= 1.0) && (arg [1] >= arg [0])) {
+			first = arg_int (arg [0], 1, 0x8000);
+			send_command (COMMANDS, 0, CMD_LOOP, ((first - 1) << 16) | (arg_int (arg [1], first, first + 0xFFFE) - first + 1));
+		}
+		else send_command (FCT, 0, LOOP, 0);
+	}
+	else if (!strcmp (buf, "/synthi/beat")) {
+		send_command (FCT, 0, BEAT, 0);
+	}
+	else if (!strcmp (buf, "/synthi/next")) {
+		send_command (FCT, 0, NEXT, 0);
+	}
+	else if (!strcmp (buf, "/synthi/prev")) {
+		send_command (FCT, 0, PREV, 0);
+	}
+	else if (!strcmp (buf, "/synthi/state")) {
+		state_read (&st);
+		send_state (from, &st);
+	}
+	else if (!strcmp (buf, "/synthi/subscribe")) {
+		subscribe (from, TRUE);
+		state_read (&st);
+		send_state (from, &st);
+	}
+	else if (!strcmp (buf, "/synthi/unsubscribe")) {
+		subscribe (from, FALSE);
+	}
+}
+
+// process an OSC packet: a message, or a bundle of messages (and bundles)
+static void packet_process (char *buf, int len, struct sockaddr_in *from)
+{
+	int pos;
+	uint32_t size;
+
+	if ((len < 8) || (len & 3)) return;
+
+	// single message
+	if (buf [0] == '/') {
+		message_process (buf, len, from);
+		return;
+	}
+
+	// bundle: messages are processed straight away, whatever their time tag
+	if ((len < 16) || memcmp (buf, "#bundle\0", 8)) return;
+	for (pos = 16; pos + 4 <= len; pos += size) {
+		memcpy (&size, &buf [pos], 4);
+		size = ntohl (size);
+		pos += 4;
+		if ((size > (uint32_t) (len - pos)) || (size & 3)) return;
+		packet_process (&buf [pos], size, from);
+	}
+}
+
+
+/*****************************************************/
+/* control thread                                    */
+/*****************************************************/
+
+// control thread: receive messages and notify subscribers of state changes
+static void *control_thread (void *arg)
+{
+	char buf [OSC_BUFFER_LEN];
+	struct sockaddr_in from;
+	socklen_t from_len;
+	struct pollfd pfd;
+	state_t st, last, same;
+	uint64_t last_push = 0;
+	int len, i;
+
+	rt_setup_thread (RT_CONTROL);
+
+	memset (&last, 0, sizeof (state_t));
+	pfd.fd = control_socket;
+	pfd.events = POLLIN;
+
+	while (1) {
+		// wait for a message, or for notification period if there are subscribers
+		if (poll (&pfd, 1, (nb_subscribers > 0) ? CONTROL_PUSH_MS : -1) > 0) {
+			from_len = sizeof (from);
+			len = recvfrom (control_socket, buf, sizeof (buf), 0, (struct sockaddr *) &from, &from_len);
+			if (len > 0) packet_process (buf, len, &from);
+		}
+
+		// notify subscribers when state has changed
+		if (nb_subscribers == 0) continue;
+		state_read (&st);
+		// position changes all the time while playing: if only position has changed, it is notified once per period
+		same = st;
+		same.tick = last.tick;
+		same.bar = last.bar;
+		if (!memcmp (&same, &last, sizeof (state_t))) {
+			if ((st.tick == last.tick) || ((micros () - last_push) < (CONTROL_PUSH_MS * 1000))) continue;
+		}
+		last_push = micros ();
+		last = st;
+		for (i = 0; i < nb_subscribers; i++) send_state (&subscriber [i], &st);
+	}
+
+	return NULL;
+}
+
+// open control endpoint at address and port given in mapping, and start control thread
+// returns EXIT_FAILURE if the endpoint cannot be opened
+int control_start (mapping_t *map)
+{
+	struct sockaddr_in addr;
+	pthread_t thread;
+
+	// no control endpoint
+	if (map->control_port == 0) return EXIT_SUCCESS;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons (map->control_port);
+	if (inet_pton (AF_INET, map->control_address, &addr.sin_addr) != 1) {
+		fprintf ( stderr, "Invalid control address %s.\n", map->control_address );
+		return EXIT_FAILURE;
+	}
+
+	control_socket = socket (AF_INET, SOCK_DGRAM, 0);
+	if (control_socket < 0) {
+		fprintf ( stderr, "Unable to create control socket.\n" );
+		return EXIT_FAILURE;
+	}
+	if (bind (control_socket, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+		fprintf ( stderr, "Unable to bind control socket to %s:%d.\n", map->control_address, map->control_port );
+		close (control_socket);
+		control_socket = -1;
+		return EXIT_FAILURE;
+	}
+
+	if (pthread_create (&thread, NULL, control_thread, NULL) != 0) {
+		fprintf ( stderr, "Unable to start control thread.\n" );
+		close (control_socket);
+		control_socket = -1;
+		return EXIT_FAILURE;
+	}
+	pthread_detach (thread);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,11 @@
+/** @file control.h
+ *
+ * @brief This file defines prototypes of functions inside control.c
+ *
+ */
+
+int command_push (command_t *);
+int command_pull (command_t *);
+void state_publish (engine_t *);
+void state_read (state_t *);
+int control_start (mapping_t *);
@@ -0,0 +1,295 @@
+/** @file engine.c
+ *
+ * @brief Engine: midi player, soundfont and song details used by the realtime threads.
+ * A new engine is published by the main thread with an atomic pointer swap; the old engine
+ * is retired, and only freed when the process callback can't use it any more (deferred reclamation).
+ * This way, loading a song never makes process callback wait, and never gives it a freed player.
+ * When channels are split across parts, soundfonts and programs of main synth are mirrored in the synths of parts.
+ *
+ */
+
+#include "types.h"
+#include "globals.h"
+#include "engine.h"
+#include "process.h"
+#include "parts.h"
+#include "player.h"
+
+
+// engines retired by main thread, waiting for the end of the cycles that may still use them
+static engine_t *retired;
+
+// soundfont swap in progress, and soundfont to unload once programs are re-bound to the new one
+static int is_swap = FALSE;
+static int swap_old_id;
+
+
+// synth p of main synth: main synth itself, then synths of parts
+static fluid_synth_t *part (fluid_synth_t *synth, int p)
+{
+	return (p == 0) ? synth : part_synth [p];
+}
+
+
+// create a new engine with an empty player; soundfont of the old engine is kept; old may be NULL
+// the engine is only used by realtime threads once published
+engine_t *new_engine (fluid_synth_t *synth, engine_t *old)
+{
+	engine_t *eng;
+
+	eng = calloc (1, sizeof (engine_t));
+	if (eng == NULL) return NULL;
+
+	eng->player = new_fluid_player (synth);
+	if (eng->player == NULL) {
+		free (eng);
+		return NULL;
+	}
+	// set player callback at tick: it gets the engine of the player
+	fluid_player_set_tick_callback (eng->player, handle_tick, (void *) eng);
+	// events of player go to synth; channels split across parts: they are routed to the synth of their channel
+	if (nb_parts > 1) player_set_playback_callback (eng, parts_route, NULL);
+	else player_set_playback_callback (eng, fluid_synth_handle_midi_event, synth);
+
+	// standard midi clock division, until a file is loaded
+	eng->ppq = 24;
+	eng->ticks_per_bar = 4 * 24;
+	eng->sf2_id = (old == NULL) ? 0 : old->sf2_id;
+	if (old != NULL) strcpy (eng->sf2, old->sf2);
+	eng->pinned_sf2_id = -1;
+	eng->punch_bar = -1;
+
+	return eng;
+}
+
+
+// delete an engine and its player
+static void delete_engine (engine_t *eng)
+{
+	player_delete (eng);
+	delete_fluid_player (eng->player);
+	free (eng);
+}
+
+
+// publish a new engine to realtime threads; the previous engine is retired, to be freed by engine_reclaim ()
+// only main thread publishes engines
+void engine_publish (engine_t *eng)
+{
+	engine_t *old;
+
+	old = __atomic_exchange_n (&engine, eng, __ATOMIC_ACQ_REL);
+	if (old == NULL) return;
+
+	// process callback reads engine once per cycle: old engine may be used until the end of the current cycle
+	old->retired_cycle = __atomic_load_n (&process_cycle, __ATOMIC_ACQUIRE);
+	old->next = retired;
+	retired = old;
+}
+
+
+// free the retired engines which can't be used by process callback any more; returns number of engines still retired
+// if force is TRUE, all of them are freed: process callback must not be running any more
+int engine_reclaim (int force)
+{
+	engine_t **prev, *eng;
+	uint32_t cycle;
+	int nb = 0;
+
+	cycle = __atomic_load_n (&process_cycle, __ATOMIC_ACQUIRE);
+
+	prev = &retired;
+	while ((eng = *prev) != NULL) {
+		// 2 cycles have completed since retirement: the cycle that may have read the engine is over
+		if (force || ((uint32_t) (cycle - eng->retired_cycle) >= 2)) {
+			*prev = eng->next;
+			delete_engine (eng);
+		}
+		else {
+			prev = &eng->next;
+			nb++;
+		}
+	}
+
+	return nb;
+}
+
+
+// return TRUE if preset (bank, program) is played by the song of engine
+static int has_preset (engine_t *eng, int bank, int prog)
+{
+	int i;
+
+	for (i = 0; i < eng->nb_presets; i++) {
+		if ((eng->preset [i][0] == bank) && (eng->preset [i][1] == prog)) return TRUE;
+	}
+	return FALSE;
+}
+
+
+// with lazy loading of samples, pin the presets played by the song of engine in its soundfont (or in default soundfont
+// if soundfont does not have the preset): their samples are loaded now by main thread, and not by render thread when
+// the player changes program; presets of old engine not played by the new song are unpinned, and their samples freed
+// old is the engine replaced by eng; NULL if song has not changed
+void engine_pin_presets (fluid_synth_t *synth, engine_t *eng, engine_t *old)
+{
+	int i, p;
+
+	// unpin presets of previous song which are not used any more
+	if ((old != NULL) && (old->pinned_sf2_id != -1)) {
+		for (i = 0; i < old->nb_presets; i++) {
+			if (has_preset (eng, old->preset [i][0], old->preset [i][1])) continue;
+			for (p = 0; p < nb_parts; p++) {
+				fluid_synth_unpin_preset (part (synth, p), old->pinned_sf2_id, old->preset [i][0], old->preset [i][1]);
+				fluid_synth_unpin_preset (part (synth, p), default_sf2_id, old->preset [i][0], old->preset [i][1]);
+			}
+		}
+		old->pinned_sf2_id = -1;
+	}
+
+	// presets of the song are already pinned in its soundfont
+	if (eng->pinned_sf2_id == eng->sf2_id) return;
+
+	for (i = 0; i < eng->nb_presets; i++) {
+		for (p = 0; p < nb_parts; p++) {
+			if (fluid_synth_pin_preset (part (synth, p), eng->sf2_id, eng->preset [i][0], eng->preset [i][1]) == FLUID_OK) continue;
+			if (fluid_synth_pin_preset (part (synth, p), default_sf2_id, eng->preset [i][0], eng->preset [i][1]) == FLUID_OK) continue;
+			if (p == 0) fprintf ( stderr, "preset %d:%d of song not found in soundfonts.\n", eng->preset [i][0], eng->preset [i][1] );
+		}
+	}
+	eng->pinned_sf2_id = eng->sf2_id;
+}
+
+
+// load a SF2 file in synth without stalling audio: file is loaded by the loader synth, which is not rendering, then moved to synth
+// with lazy loading, presets played by the song of engine are pinned in loader synth: their samples are read now too
+// (presets the soundfont does not have are pinned in default soundfont by engine_pin_presets ())
+// returns id of soundfont in synth, FLUID_FAILED on error
+static int load_sf2 (fluid_synth_t *synth, engine_t *eng, char *name, int lazy)
+{
+	fluid_sfont_t *sfont;
+	int id, i;
+
+	id = fluid_synth_sfload (loader_synth, name, FALSE);
+	if (id == FLUID_FAILED) return FLUID_FAILED;
+
+	if (lazy) {
+		for (i = 0; i < eng->nb_presets; i++) fluid_synth_pin_preset (loader_synth, id, eng->preset [i][0], eng->preset [i][1]);
+	}
+
+	// move soundfont to synth: this only adds it to the list of soundfonts of synth
+	sfont = fluid_synth_get_sfont_by_id (loader_synth, id);
+	fluid_synth_remove_sfont (loader_synth, sfont);
+	id = fluid_synth_add_sfont (synth, sfont);
+	if (id == FLUID_FAILED) {
+		fluid_synth_add_sfont (loader_synth, sfont);
+		fluid_synth_sfunload (loader_synth, fluid_sfont_get_id (sfont), FALSE);
+		return FLUID_FAILED;
+	}
+
+	return id;
+}
+
+
+// load a SF2 file in main synth and in synths of parts, without stalling audio
+// soundfont gets the same id in all synths, as they load and unload the same soundfonts in the same order
+// returns id of soundfont, FLUID_FAILED on error
+int engine_load_sf2 (fluid_synth_t *synth, engine_t *eng, char *name, int lazy)
+{
+	int id, part_id, p, q;
+
+	id = load_sf2 (synth, eng, name, lazy);
+	if (id == FLUID_FAILED) return FLUID_FAILED;
+
+	for (p = 1; p < nb_parts; p++) {
+		part_id = load_sf2 (part (synth, p), eng, name, lazy);
+		if (part_id == id) continue;
+		// ids are not the same any more (file can't be read again...): soundfont is not used
+		fprintf ( stderr, "Unable to load %s in part %d.\n", name, p );
+		for (q = 0; q <= p; q++) fluid_synth_sfunload (part (synth, q), (q == p) ? part_id : id, FALSE);
+		return FLUID_FAILED;
+	}
+
+	// presets are only pinned in the new soundfont: engine_pin_presets () still pins those it lacks in default soundfont
+	return id;
+}
+
+
+// re-bind programs of all channels of synth s to soundfont sfid; channels which preset is not in the soundfont keep
+// their preset; voices already playing go on with the samples of the previous soundfont
+void engine_rebind_synth (fluid_synth_t *s, int sfid)
+{
+	int chan, sf, bank, prog;
+
+	for (chan = 0; chan < fluid_synth_count_midi_channels (s); chan++) {
+		if (fluid_synth_get_program (s, chan, &sf, &bank, &prog) != FLUID_OK) continue;
+		if (sf == sfid) continue;
+		fluid_synth_program_select (s, chan, sfid, bank, prog);
+	}
+}
+
+
+// re-bind programs of all synths to soundfont sfid; called by main thread (render thread queues it, see parts_rebind ())
+void engine_rebind_programs (fluid_synth_t *synth, int sfid)
+{
+	int p;
+
+	for (p = 0; p < nb_parts; p++) engine_rebind_synth (part (synth, p), sfid);
+}
+
+
+// unload soundfont replaced by a swap, unless it is the default soundfont
+// soundfont is freed by fluidsynth once no voice uses it any more
+static void unload_old ()
+{
+	int p;
+
+	if ((swap_old_id > 0) && (swap_old_id != default_sf2_id)) {
+		for (p = 0; p < nb_parts; p++) fluid_synth_sfunload (part (synth, p), swap_old_id, FALSE);
+	}
+	is_swap = FALSE;
+}
+
+
+// swap soundfont of engine for new_id: programs are re-bound at once if at_once is TRUE (player stopped), else
+// by tick callback at next boundary of ticks (beat or bar); old soundfont is unloaded once programs are re-bound
+void engine_swap_sf2 (fluid_synth_t *synth, engine_t *eng, int new_id, int at_once, int ticks)
+{
+	// a previous swap is still pending: complete it now
+	engine_swap_check (synth, TRUE);
+
+	is_swap = TRUE;
+	swap_old_id = eng->sf2_id;
+	eng->sf2_id = new_id;
+
+	if (at_once) {
+		engine_rebind_programs (synth, new_id);
+		unload_old ();
+		return;
+	}
+
+	// tick callback re-binds programs at next boundary
+	sf2_swap_ticks = (ticks > 0) ? ticks : 1;
+	__atomic_store_n (&sf2_swap, new_id, __ATOMIC_RELEASE);
+}
+
+
+// check soundfont swap in progress: once tick callback has re-bound programs, old soundfont is unloaded
+// if force is TRUE (eg. player has stopped, so there is no tick), programs are re-bound now
+// returns SWAP_NONE, SWAP_PENDING, or SWAP_DONE if swap has just been completed
+int engine_swap_check (fluid_synth_t *synth, int force)
+{
+	int id;
+
+	if (!is_swap) return SWAP_NONE;
+
+	if (__atomic_load_n (&sf2_swap, __ATOMIC_ACQUIRE) != -1) {
+		if (!force) return SWAP_PENDING;
+		// take swap from tick callback, unless it is doing it right now
+		id = __atomic_exchange_n (&sf2_swap, -1, __ATOMIC_ACQ_REL);
+		if (id != -1) engine_rebind_programs (synth, id);
+	}
+
+	unload_old ();
+	return SWAP_DONE;
+}
@@ -0,0 +1,15 @@
+/** @file engine.h
+ *
+ * @brief This file defines prototypes of functions inside engine.c
+ *
+ */
+
+engine_t *new_engine (fluid_synth_t *, engine_t *);
+void engine_publish (engine_t *);
+int engine_reclaim (int);
+void engine_pin_presets (fluid_synth_t *, engine_t *, engine_t *);
+int engine_load_sf2 (fluid_synth_t *, engine_t *, char *, int);
+void engine_rebind_synth (fluid_synth_t *, int);
+void engine_rebind_programs (fluid_synth_t *, int);
+void engine_swap_sf2 (fluid_synth_t *, engine_t *, int, int, int);
+int engine_swap_check (fluid_synth_t *, int);
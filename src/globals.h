@@ -10,12 +10,11 @@
 extern int gpio_state;      // OFF = gpio OFF: ON = GPIO ON 
 extern int gpio_deamon;     // deamon id for pigpiod 
 extern uint64_t previous_led;  // time when switch was set as on
+extern int gpio_beat;			// set by gpio thread when switch is pressed; reset by process callback
 
-// define midi ports
-extern jack_port_t *midi_input_port;
-extern jack_port_t *midi_output_port;
+// define midi ports (midi in and out ports of surfaces are in surface structure)
 extern jack_port_t *clock_output_port;
-extern char **ports_to_connect;
+extern jack_port_t *click_output_port;		// audio port of metronome click
 
 // define JACKD client : this is this program
 extern jack_client_t *client;
@@ -23,23 +22,39 @@ extern jack_client_t *client;
 // number of frames per Jack packet and sample-rate
 extern uint32_t nb_frames_per_packet, sample_rate;
 
-// FLUIDSYNTH player
-extern fluid_player_t* player;
+// FLUIDSYNTH synth; player and soundfont are in engine
 extern fluid_settings_t* settings;
 extern fluid_synth_t* synth;
+extern fluid_synth_t* loader_synth;	// synth not rendering, used to load soundfonts without stalling synth
+extern fluid_synth_t* part_synth [MAX_PARTS];	// synths channels are split across: main synth, then parts rendered by their own thread
+extern int nb_parts;			// number of synths in part_synth
 extern fluid_audio_driver_t* adriver;
 
+// engine used by realtime threads (player, soundfont, song details); swapped with a new one when a song is loaded
+// process callback reads it once per cycle; old engines are freed once process callback can't use them any more
+extern engine_t *engine;
+extern int default_sf2_id;		// id of default soundfont, always in memory
+extern int sf2_swap;			// soundfont which programs shall be re-bound to by tick callback at next boundary; -1 if none
+extern int sf2_swap_ticks;		// boundary of soundfont swap, in ticks: a beat or a bar
+
 // determine if midi clock shall be sent or not
 extern int send_clock;
 
 // define filename structure for each file name: midi file and SF2 file
+// controls and leds of the structure are not used: each surface has its own
 extern filename_t filename [];
-// define function structure
+// define function structure (controls and leds are not used: each surface has its own)
 extern filefunct_t filefunct [];
 
-// define the structures for managing leds of midi control surface
-extern unsigned char list_buffer[LIST_ELT][4];	// list buffer of LIST_ELT led request
-extern unsigned char list_index;			// index where to write led request to
+// define the mapping read from config file: midi control surfaces (controls and leds), fader settings and connections
+// the mapping is swapped with a new one when config file is reloaded: process callback uses it through this pointer only
+extern mapping_t *mapping;
+extern uint32_t process_cycle;			// number of process cycles completed; used to know when an old mapping is not used any more
+
+// wake up of main thread, and requests it handles
+extern int wakeup_fd;						// eventfd written to wake up main thread as soon as there is a request to handle
+extern volatile int is_reconnect;			// set when jack ports appear or get disconnected, to re-establish connections
+extern volatile int is_shutdown;			// set when jack server shuts down, to stop main thread
 
 // status of leds for filenames
 extern unsigned char led_status_filename [NB_NAMES][LAST_ELT]; 	// this table will contain whether each light is on/off at a time; this is to avoid sending led requests which are not required
@@ -48,16 +63,18 @@ extern unsigned char led_status_filefunct [NB_FCT][LAST_ELT_FCT]; 	// this table
 /* load (midi and SF2 files) & play (midi file) globals */
 extern int is_load;
 extern int is_play;
-extern int sf2_id;		// id of sf2 file currently loaded
+extern int setlist_index;	// entry of setlist currently loaded; -1 if none
+extern int song_bank;			// bank of songs selected; set by process callback
+extern int sf2_bank;			// bank of soundfonts selected; set by process callback
 
 /* volume and BPM */
 extern int bpm;
 extern int initial_bpm;
 extern int volume;
-extern int is_volume;
-
-/* PPQ */
-extern int ppq;
+extern float gain;				// gain currently applied to the synth
+extern float gain_target;		// gain requested by volume pads or fader; gain is smoothed towards it in process callback
+extern float tempo;			// bpm currently applied to the player; -1 if file tempo is used
+extern float tempo_target;		// bpm requested by tempo fader; tempo is smoothed towards it in process callback
 
 /* beat */
 extern uint64_t now;       // time now
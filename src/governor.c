@@ -0,0 +1,179 @@
+/** @file governor.c
+ *
+ * @brief Load governor: DSP load (jack_cpu_load, and render time of each block of fluidsynth) is watched by main thread.
+ * When headroom shrinks, polyphony is lowered and the notes of lowest priority are released by the render thread
+ * (released and quiet notes first, then older ones; drums and important channels such as bass last), so that the
+ * sound degrades gracefully instead of giving xruns. Polyphony is given back step by step when load falls.
+ * When channels are split across synths (see parts.c), each synth renders on its own core: polyphony is limited in
+ * each of them, and each one releases its own notes, in the thread rendering it. Load is only watched while playing.
+ *
+ */
+
+#include "types.h"
+#include "globals.h"
+#include "governor.h"
+
+
+// governor settings, copied from mapping at startup
+static governor_t gov;
+
+// polyphony allowed by governor
+static int polyphony;
+
+// peak render time of a block since last check by governor, in ns (render thread to main thread)
+static uint64_t render_peak;
+
+// number of voices the thread rendering each synth shall release (main thread to render thread and part threads)
+static int shed [MAX_PARTS];
+
+// TRUE while polyphony is lowered, for logging
+static int is_degraded = FALSE;
+
+
+// set governor settings, and fluidsynth settings giving the priority of voices when fluidsynth itself steals voices
+// called before synth is created
+void governor_init (mapping_t *map, fluid_settings_t *settings)
+{
+	char channels [4 * 16];
+	int i;
+
+	gov = map->governor;
+	polyphony = gov.max_polyphony;
+	fluid_settings_setint (settings, "synth.polyphony", gov.max_polyphony);
+
+	// voices of percussion and important channels (1-based numbers) are stolen last
+	channels [0] = 0;
+	for (i = 0; i < gov.nb_important; i++) {
+		snprintf (&channels [strlen (channels)], sizeof (channels) - strlen (channels), (i == 0) ? "%d" : ",%d", gov.important [i] + 1);
+	}
+	if (gov.nb_important > 0) fluid_settings_setstr (settings, "synth.overflow.important-channels", channels);
+}
+
+
+// record render time of a block, in ns; called by render thread
+void governor_render_time (uint64_t ns)
+{
+	uint64_t peak;
+
+	peak = __atomic_load_n (&render_peak, __ATOMIC_RELAXED);
+	while ((ns > peak) && !__atomic_compare_exchange_n (&render_peak, &peak, ns, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+
+// priority of a voice: voices of lowest priority are released first
+static long priority (fluid_voice_t *voice)
+{
+	long prio;
+	int chan, i;
+
+	chan = fluid_voice_get_channel (voice);
+
+	// drums, then important channels (bass...), are released last
+	prio = 0;
+	if (chan == 9) prio = 3000000;
+	for (i = 0; i < gov.nb_important; i++) {
+		if (gov.important [i] == chan) prio = 2000000;
+	}
+
+	// notes held by a key or a pedal before notes already released; louder before quieter; newer before older
+	if (fluid_voice_is_on (voice) || fluid_voice_is_sustained (voice) || fluid_voice_is_sostenuto (voice)) prio += 1000000;
+	prio += fluid_voice_get_actual_velocity (voice) * 4096;
+	prio += fluid_voice_get_id (voice) & 0xFFF;
+	return prio;
+}
+
+
+// release notes of lowest priority of synth of part p (0 for main synth), if governor has asked for it
+// called by the thread rendering the synth before rendering a block
+// this only sends note off: voices end with their natural release, without clicks
+void governor_shed (fluid_synth_t *synth, int p)
+{
+	fluid_voice_t *voice [MAX_VOICES];
+	long prio [MAX_VOICES];
+	int nb, n, i, low;
+
+	if (__atomic_load_n (&shed [p], __ATOMIC_RELAXED) == 0) return;
+	n = __atomic_exchange_n (&shed [p], 0, __ATOMIC_ACQUIRE);
+
+	fluid_synth_get_voicelist (synth, voice, MAX_VOICES, -1);
+	for (nb = 0; (nb < MAX_VOICES) && (voice [nb] != NULL); nb++) prio [nb] = priority (voice [nb]);
+
+	// release n notes of lowest priority, among notes still held
+	while (n-- > 0) {
+		low = -1;
+		for (i = 0; i < nb; i++) {
+			if ((voice [i] != NULL) && fluid_voice_is_on (voice [i]) && ((low < 0) || (prio [i] < prio [low]))) low = i;
+		}
+		if (low < 0) break;
+		fluid_synth_noteoff (synth, fluid_voice_get_channel (voice [low]), fluid_voice_get_key (voice [low]));
+		voice [low] = NULL;
+	}
+}
+
+
+// TRUE if load is watched by governor
+int governor_is_enabled ()
+{
+	return gov.enabled;
+}
+
+
+// set polyphony of all synths, without cutting the voices playing: they are released by the threads rendering synths
+static void set_polyphony (int active [])
+{
+	int p;
+
+	for (p = 0; p < nb_parts; p++) {
+		if (active [p] > polyphony) __atomic_store_n (&shed [p], active [p] - polyphony, __ATOMIC_RELEASE);
+		fluid_synth_set_polyphony (part_synth [p], (active [p] > polyphony) ? active [p] : polyphony);
+	}
+}
+
+
+// check DSP load, and adjust polyphony; called by main thread every GOVERNOR_MS while playing
+void governor_update ()
+{
+	float load, render;
+	uint64_t peak;
+	int active [MAX_PARTS], p;
+
+	if (!gov.enabled || (part_synth [0] == NULL)) return;
+
+	// load: the highest of jack load (all clients, averaged by jack) and of peak render time of fluidsynth over a period
+	peak = __atomic_exchange_n (&render_peak, 0, __ATOMIC_RELAXED);
+	render = (sample_rate == 0) ? 0.0f : (float) peak / (1.0e9f * (float) nb_frames_per_packet / (float) sample_rate);
+	load = jack_cpu_load (client) / 100.0f;
+	if (render > load) load = render;
+	for (p = 0; p < nb_parts; p++) active [p] = fluid_synth_get_active_voice_count (part_synth [p]);
+
+	// headroom shrinks: lower polyphony, and release voices beyond it
+	if (load > gov.high) {
+		polyphony = (polyphony * 3) / 4;
+		if (polyphony < gov.min_polyphony) polyphony = gov.min_polyphony;
+		if (!is_degraded) fprintf ( stderr, "governor: load %d%%, polyphony lowered to %d.\n", (int) (load * 100.0f), polyphony );
+		is_degraded = TRUE;
+	}
+	// load has fallen: give polyphony back step by step
+	else if ((load < gov.low) && (polyphony < gov.max_polyphony)) {
+		polyphony += (gov.max_polyphony + 15) / 16;
+		if (polyphony >= gov.max_polyphony) {
+			polyphony = gov.max_polyphony;
+			fprintf ( stderr, "governor: load %d%%, polyphony restored to %d.\n", (int) (load * 100.0f), polyphony );
+			is_degraded = FALSE;
+		}
+	}
+
+	set_polyphony (active);
+}
+
+
+// give all polyphony back at once, as load is not watched any more (player stopped); called by main thread
+void governor_reset ()
+{
+	int active [MAX_PARTS] = { 0 };
+
+	if (!gov.enabled || (part_synth [0] == NULL) || (polyphony == gov.max_polyphony)) return;
+	polyphony = gov.max_polyphony;
+	is_degraded = FALSE;
+	set_polyphony (active);
+}
@@ -0,0 +1,12 @@
+/** @file governor.h
+ *
+ * @brief This file defines prototypes of functions inside governor.c
+ *
+ */
+
+void governor_init (mapping_t *, fluid_settings_t *);
+void governor_render_time (uint64_t);
+void governor_shed (fluid_synth_t *, int);
+int governor_is_enabled ();
+void governor_update ();
+void governor_reset ();
@@ -15,14 +15,19 @@
 // function called to turn pad led on/off for a given row/col for filename
 int led_filename (int row, int col, int on_off) {
 
+	mapping_t *map;
+	int s;
+
 	// check if the light is already ON, OFF, PENDING according to what we want
 	// this will allow to determine whether we take the request into account or not
 	if (led_status_filename [row][col] != on_off) {
 
-		// push to list of led requests to be processed
-		push_to_list (NAMES, row, col, on_off);
 		// update led status so it matches with request
 		led_status_filename [row][col] = (unsigned char) on_off;
+		// mark led as pending on all surfaces: its status will be sent to each surface showing it by the led scheduler
+		// the led scheduler always sends the latest status, so a request can never be lost
+		map = __atomic_load_n (&mapping, __ATOMIC_ACQUIRE);
+		for (s = 0; s < map->nb_surfaces; s++) __atomic_store_n (&map->surface [s].pending_filename [row][col], TRUE, __ATOMIC_RELEASE);
 
 	}
 }
@@ -31,14 +36,18 @@ int led_filename (int row, int col, int on_off) {
 // function called to turn function rows pad led on/off
 int led_filefunct (int row, int col, int on_off) {
 
+	mapping_t *map;
+	int s;
+
 	// check if the light is already ON, OFF, PENDING according to what we want
 	// this will allow to determine wether we take the request into account or not
 	if (led_status_filefunct [row][col] != on_off) {
 		
-		// push to list of led requests to be processed
-		push_to_list (FCT, row, col, on_off);
 		// update led status so it matches with request
 		led_status_filefunct [row][col] = (unsigned char) on_off;
+		// mark led as pending on all surfaces: its status will be sent to each surface showing it by the led scheduler
+		map = __atomic_load_n (&mapping, __ATOMIC_ACQUIRE);
+		for (s = 0; s < map->nb_surfaces; s++) __atomic_store_n (&map->surface [s].pending_filefunct [row][col], TRUE, __ATOMIC_RELEASE);
 
 	}
 }
@@ -71,3 +80,141 @@ int i;
 	led_filefunct (row, BPMUP, OFF);
 }
 
+
+
+// mark all the leds of all the surfaces of a mapping as pending, so that their status is sent to the surfaces
+int led_repaint (mapping_t *map) {
+
+	int s;
+
+	for (s = 0; s < map->nb_surfaces; s++) {
+		memset (map->surface [s].pending_filename, TRUE, sizeof (map->surface [s].pending_filename));
+		memset (map->surface [s].pending_filefunct, TRUE, sizeof (map->surface [s].pending_filefunct));
+	}
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+
+// get the midi message lighting a pending led, and clear the pending flag
+// returns FALSE if the led is not pending
+static int take_pending (surface_t *surf, int dest, int row, int col, unsigned char *buffer) {
+
+	if (dest == NAMES) {
+		if (!__atomic_exchange_n (&surf->pending_filename [row][col], FALSE, __ATOMIC_ACQUIRE)) return FALSE;
+		memcpy (buffer, &surf->filename[row].led [col][led_status_filename [row][col]][0], 3);
+	}
+	else {
+		if (!__atomic_exchange_n (&surf->pending_filefunct [row][col], FALSE, __ATOMIC_ACQUIRE)) return FALSE;
+		memcpy (buffer, &surf->filefunct[row].led [col][led_status_filefunct [row][col]][0], 3);
+	}
+	return TRUE;
+}
+
+
+// set the led back to pending, in case its midi message could not be sent
+static void give_back_pending (surface_t *surf, int dest, int row, int col) {
+
+	if (dest == NAMES) __atomic_store_n (&surf->pending_filename [row][col], TRUE, __ATOMIC_RELEASE);
+	else __atomic_store_n (&surf->pending_filefunct [row][col], TRUE, __ATOMIC_RELEASE);
+}
+
+
+// led scheduler: called once per period and per surface by the process callback to send pending leds to the surface
+// the number of bytes sent is limited by the bandwidth of the surface (bytes_per_ms); leds which do not fit
+// in the period remain pending for the next period. Messages are spread over the period at the pace of the
+// midi link, instead of being all sent at frame 0; if the surface supports it, leds lit by a note on of the first channel
+// are grouped in a bulk sysex message, which only carries (note, velocity) pairs; other leds are sent individually
+int led_schedule (surface_t *surf, void *midiout, jack_nframes_t nframes) {
+
+	int dest, row, col, nb_row, nb_col;
+	unsigned char buffer [3];
+	unsigned char bulk [SYSEX_HEADER_MAX + (2 * SYSEX_BULK_MAX) + 1];	// bulk sysex message
+	unsigned char bulk_led [SYSEX_BULK_MAX][3];							// leds (dest, row, col) in bulk message
+	int bulk_len, nb_bulk;
+	float period_ms, frames_per_byte, max_credit, time, reserved;
+	int i;
+
+	// surface not configured yet
+	if (surf->bytes_per_ms <= 0) return 0;
+
+	// refill the byte credit according to the duration of the period
+	// credit is capped to avoid sending a large burst after an idle time; cap is at least one bulk message, so that
+	// a slow surface with short periods can still receive its messages over several periods
+	period_ms = (float) nframes * 1000.0f / (float) sample_rate;
+	max_credit = (surf->bytes_per_ms * period_ms) + surf->sysex_len + (2 * SYSEX_BULK_MAX) + 1;
+	surf->credit += surf->bytes_per_ms * period_ms;
+	if (surf->credit > max_credit) surf->credit = max_credit;
+
+	// number of frames required to send a byte to the surface
+	frames_per_byte = (float) sample_rate / (1000.0f * surf->bytes_per_ms);
+	time = 0.0f;
+	nb_bulk = 0;
+
+	// go through all the leds of filenames and functions
+	for (dest = NAMES; dest <= FCT; dest++) {
+		nb_row = (dest == NAMES) ? NB_NAMES : NB_FCT;
+		nb_col = (dest == NAMES) ? LAST_ELT : LAST_ELT_FCT;
+
+		for (row = 0; row < nb_row; row++) {
+			for (col = 0; col < nb_col; col++) {
+
+				if (!take_pending (surf, dest, row, col, buffer)) continue;
+
+				// if buffer is empty, there is no midi message defined for the led: nothing to send
+				if (!(buffer [0] | buffer [1] | buffer [2])) continue;
+
+				// bytes of credit taken by the bulk message built so far
+				reserved = (nb_bulk > 0) ? (float) (surf->sysex_len + (2 * nb_bulk) + 1) : 0.0f;
+
+				if ((surf->type == SURFACE_SYSEX) && (buffer [0] == 0x90)) {
+					// bulk message is full, or does not fit in the credit: stop here, it is sent below; led remains pending
+					if ((nb_bulk == SYSEX_BULK_MAX) || (surf->credit < (float) (surf->sysex_len + (2 * nb_bulk) + 3))) {
+						give_back_pending (surf, dest, row, col);
+						goto send_bulk;
+					}
+					// add led (note, velocity) to the bulk message; message will be sent once complete
+					bulk [surf->sysex_len + (2 * nb_bulk)] = buffer [1];
+					bulk [surf->sysex_len + (2 * nb_bulk) + 1] = buffer [2];
+					bulk_led [nb_bulk][0] = dest;
+					bulk_led [nb_bulk][1] = row;
+					bulk_led [nb_bulk][2] = col;
+					nb_bulk++;
+					continue;
+				}
+
+				// not enough credit for an individual led message: leave remaining leds pending for next period
+				if (surf->credit - reserved < 3.0f) {
+					give_back_pending (surf, dest, row, col);
+					goto send_bulk;
+				}
+
+				// send individual led message at the time the midi link is ready for it
+				// if midi out buffer is full, keep led pending for next period
+				if (jack_midi_event_write (midiout, (jack_nframes_t) time, buffer, 3) != 0) {
+					give_back_pending (surf, dest, row, col);
+					goto send_bulk;
+				}
+				surf->credit -= 3.0f;
+				time += 3.0f * frames_per_byte;
+				if (time > (float) (nframes - 1)) time = (float) (nframes - 1);
+			}
+		}
+	}
+
+send_bulk:
+	// send the bulk sysex message, if any
+	if (nb_bulk) {
+		memcpy (bulk, surf->sysex, surf->sysex_len);
+		bulk_len = surf->sysex_len + (2 * nb_bulk);
+		bulk [bulk_len++] = 0xF7;
+
+		if (jack_midi_event_write (midiout, (jack_nframes_t) time, bulk, bulk_len) != 0) {
+			// midi out buffer is full: keep all the leds of the message pending for next period
+			for (i = 0; i < nb_bulk; i++) give_back_pending (surf, bulk_led [i][0], bulk_led [i][1], bulk_led [i][2]);
+			return 0;
+		}
+		surf->credit -= (float) bulk_len;
+	}
+
+	return 0;
+}
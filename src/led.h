@@ -8,3 +8,5 @@ int led_filename (int, int, int);
 int filename_led_off (int);
 int led_filefunct (int, int, int);
 int filefunct_led_off (int);
+int led_repaint (mapping_t *);
+int led_schedule (surface_t *, void *, jack_nframes_t);
@@ -4,12 +4,31 @@
  *
  */
 
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include "types.h"
 #include "main.h"
 #include "config.h"
 #include "process.h"
 #include "utils.h"
 #include "led.h"
+#include "control.h"
+#include "engine.h"
+#include "rt.h"
+#include "prefetch.h"
+#include "boot.h"
+#include "session.h"
+#include "catalog.h"
+#include "metadata.h"
+#include "governor.h"
+#include "profile.h"
+#include "parts.h"
+#include "prerender.h"
+#include "player.h"
+#include "click.h"
 
 
 /*************/
@@ -66,6 +85,42 @@ static int kill_gpio ()
 }
 
 
+// light volume pads the same way as when volume pads are pressed
+static void led_volume ()
+{
+	if (volume == 0) {
+		led_filefunct (0, VOLDOWN, ON);
+		led_filefunct (0, VOLUP, OFF);
+	}
+	else if (volume == 10) {
+		led_filefunct (0, VOLDOWN, OFF);
+		led_filefunct (0, VOLUP, ON);
+	}
+	// volume == 2 (default value): both pads in PENDING mode
+	else if (volume == 2) {
+		led_filefunct (0, VOLDOWN, PENDING);
+		led_filefunct (0, VOLUP, PENDING);
+	}
+	else {
+		led_filefunct (0, VOLDOWN, OFF);
+		led_filefunct (0, VOLUP, OFF);
+	}
+}
+
+
+// send a command to process callback, as control endpoint does
+static void send_command (int dest, int row, int col, int value)
+{
+	command_t cmd;
+
+	cmd.dest = dest;
+	cmd.row = row;
+	cmd.col = col;
+	cmd.value = value;
+	if (!command_push (&cmd)) fprintf ( stderr, "Command lost.\n" );
+}
+
+
 static void init_globals ( )
 {
 	int i;
@@ -74,11 +129,6 @@ static void init_globals ( )
 	/* INIT SOME GLOBAL VARIABLES */
 	/******************************/
 
-	/* allocate memory to read parameter table: client/server input-output automated connection */
-	/* let's make it 255 strings of 255 characters */
-	ports_to_connect = calloc (255, sizeof(char*));
-	for (i=0; i<255; i++) ports_to_connect[i] = calloc (255,sizeof(char));
-
 	/* clear structure that will get midi file and SF2 file name details, ie. filename structure */
 	for (i = 0; i<NB_NAMES; i++) {
 		memset (&filename[i], 0, sizeof (filename_t));
@@ -89,6 +139,14 @@ static void init_globals ( )
 		memset (&filefunct[i], 0, sizeof (filefunct_t));
 	}
 	
+	/* no config read yet; config will be read in a new mapping */
+	mapping = NULL;
+	process_cycle = 0;
+	nb_parts = 1;
+	is_reconnect = FALSE;
+	is_shutdown = FALSE;
+	wakeup_fd = -1;
+
 	// init clock sending
 	send_clock = NO_CLOCK;
 
@@ -96,11 +154,17 @@ static void init_globals ( )
 	// is_load = TRUE allows to load default files (00_*) at startup
 	is_load = TRUE;
 	is_play = FALSE;
-	sf2_id = 0;			// set arbitrary value for sf2_id (current loaded soundfile id)
+	setlist_index = -1;	// no entry of setlist loaded yet
+	engine = NULL;		// no player yet
+	default_sf2_id = -1;
+	sf2_swap = -1;
 	
 	// function flags
 	volume = 2;
-	is_volume = TRUE;	// force setting the volume at startup
+	gain = 0.0f;		// gain is smoothed from 0 to default volume at startup
+	gain_target = (float) volume / 10.0f;
+	tempo = -1.0f;		// no tempo set by fader: file tempo is used
+	tempo_target = -1.0f;
 	bpm = 0	;			// bpm is only set when file is playing
 	initial_bpm = -1;
 	now = 0;			// used for automated tempo adjustment (at press of switch)
@@ -109,20 +173,95 @@ static void init_globals ( )
 }
 
 
-static void signal_handler ( int sig )
+// open the file descriptors the main thread waits on: signals, wake up requests, housekeeping and load governor timers
+// signals are blocked in all threads, and only received by main thread through signal_fd:
+// this must be called before any thread is created (jack, fluidsynth, control endpoint...)
+static int init_events (int *epoll_fd, int *signal_fd, int *timer_fd, int *governor_fd)
 {
-	kill_gpio ();
-	// JACK client close
-	jack_client_close ( client );
+	sigset_t mask;
+	struct itimerspec period;
+	struct epoll_event event;
+
+	/* block signals: they are read from signal_fd instead of interrupting any thread */
+	sigemptyset (&mask);
+	sigaddset (&mask, SIGINT);
+	sigaddset (&mask, SIGTERM);
+	sigaddset (&mask, SIGQUIT);
+	sigaddset (&mask, SIGHUP);
+	if (pthread_sigmask (SIG_BLOCK, &mask, NULL) != 0) return EXIT_FAILURE;
+	*signal_fd = signalfd (-1, &mask, SFD_CLOEXEC);
+
+	/* wake up requests from process callback and jack callbacks */
+	wakeup_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	/* periodic housekeeping */
+	*timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+	memset (&period, 0, sizeof (period));
+	period.it_value.tv_sec = HOUSEKEEPING_S;
+	period.it_interval.tv_sec = HOUSEKEEPING_S;
+
+	/* load governor: armed while playing (see arm_governor ()) */
+	*governor_fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+
+	*epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+	if ((*signal_fd < 0) || (wakeup_fd < 0) || (*timer_fd < 0) || (*governor_fd < 0) || (*epoll_fd < 0)) return EXIT_FAILURE;
+	if (timerfd_settime (*timer_fd, 0, &period, NULL) < 0) return EXIT_FAILURE;
+
+	event.events = EPOLLIN;
+	event.data.fd = *signal_fd;
+	if (epoll_ctl (*epoll_fd, EPOLL_CTL_ADD, *signal_fd, &event) < 0) return EXIT_FAILURE;
+	event.data.fd = wakeup_fd;
+	if (epoll_ctl (*epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &event) < 0) return EXIT_FAILURE;
+	event.data.fd = *timer_fd;
+	if (epoll_ctl (*epoll_fd, EPOLL_CTL_ADD, *timer_fd, &event) < 0) return EXIT_FAILURE;
+	event.data.fd = *governor_fd;
+	if (epoll_ctl (*epoll_fd, EPOLL_CTL_ADD, *governor_fd, &event) < 0) return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
+
+
+// arm timer of load governor while playing, if governor is enabled; disarm it otherwise, giving all polyphony back
+// main thread sleeps while player is stopped, instead of checking load every GOVERNOR_MS
+static void arm_governor (int governor_fd, int is_playing)
+{
+	static int is_armed = FALSE;
+	struct itimerspec check;
+
+	is_playing = is_playing && governor_is_enabled ();
+	if (is_playing == is_armed) return;
+
+	memset (&check, 0, sizeof (check));
+	if (is_playing) {
+		check.it_value.tv_nsec = GOVERNOR_MS * 1000000;
+		check.it_interval.tv_nsec = GOVERNOR_MS * 1000000;
+	}
+	if (timerfd_settime (governor_fd, 0, &check, NULL) < 0) return;
+	is_armed = is_playing;
+	if (!is_armed) governor_reset ();
+}
 
-	// Fluidsynth cleanup
-	delete_fluid_player(player);
-	delete_fluid_audio_driver(adriver);
-	delete_fluid_synth(synth);
-	delete_fluid_settings(settings);
 
-	fprintf ( stderr, "signal received, exiting ...\n" );
-	exit ( 0 );
+// JACK calls this callback when a port is registered or unregistered, for any client
+// a new port may be one of the ports to connect (surface plugged in, a2jmidid or boocli restarted...)
+// connections can't be made from a jack callback: main thread is woken up to make them
+static void port_registration ( jack_port_id_t port, int reg, void *arg )
+{
+	if (reg) {
+		is_reconnect = TRUE;
+		wakeup_main ();
+	}
+}
+
+
+// JACK calls this callback when ports are connected or disconnected
+// a connection that has been removed is re-established by main thread, if it is part of the config
+static void port_connect ( jack_port_id_t a, jack_port_id_t b, int connect, void *arg )
+{
+	if (!connect) {
+		is_reconnect = TRUE;
+		wakeup_main ();
+	}
 }
 
 
@@ -132,18 +271,9 @@ static void signal_handler ( int sig )
  */
 void jack_shutdown ( void *arg )
 {
-	free (midi_input_port);
-	free (midi_output_port);
-	free (clock_output_port);
-	kill_gpio ();
-
-	// Fluidsynth cleanup
-	delete_fluid_player(player);
-	delete_fluid_audio_driver(adriver);
-	delete_fluid_synth(synth);
-	delete_fluid_settings(settings);
-
-	exit ( 1 );
+	// cleanup is done by main thread
+	is_shutdown = TRUE;
+	wakeup_main ();
 }
 
 /* usage: synthi (config_file) (jack client name) (jack server name)*/
@@ -151,6 +281,16 @@ void jack_shutdown ( void *arg )
 int main ( int argc, char *argv[] )
 {
 	int i,j;
+	engine_t *eng, *old;
+	pthread_t gpio;
+	int lazy_loading;
+	int interpolation;
+	int is_stopped, sf2_id;
+	metadata_t song_md;
+	prefetch_t song_file, sf2_file;
+	session_t session;
+	catalog_entry_t song_info;
+	int soundfont;
 	
 	// JACK variables
 	const char *client_name;
@@ -160,8 +300,22 @@ int main ( int argc, char *argv[] )
 	jack_status_t status;
 
 	// string containing : directory + filename
-	char name [1000];
+	char name [PATH_LEN];
+
+	// events the main loop waits for: signals, wake up requests, housekeeping timer, load governor timer
+	int epoll_fd, signal_fd, timer_fd, governor_fd;
+	struct epoll_event events [4];
+	struct signalfd_siginfo siginfo;
+	uint64_t counter;
+	int nb_events;
+	int is_reload = FALSE;
+	int is_running = TRUE;
+	int is_booting = TRUE;		// default soundfont is loading in background
+	int is_startup = TRUE;		// startup song is not loaded yet
+
 
+	/* time each phase of startup */
+	boot_trace_start ();
 
 	/* use basename of argv[0] */
 	client_name = strrchr ( argv[0], '/' );
@@ -187,6 +341,47 @@ int main ( int argc, char *argv[] )
 		}
 	}
 
+	// init global variables
+	init_globals();
+
+	// open events of main loop; signals are blocked from now on, so threads created later never get them
+	if (init_events (&epoll_fd, &signal_fd, &timer_fd, &governor_fd) == EXIT_FAILURE) {
+		fprintf ( stderr, "unable to create events of main loop.\n" );
+		exit ( 1 );
+	}
+
+	/* read config file to get all the parameters; this gives the number of surfaces, hence of midi ports to register */
+	mapping = new_mapping ();
+	if ((mapping == NULL) || (read_config (config_name, mapping)==EXIT_FAILURE)) {
+		fprintf ( stderr, "error in reading config file.\n" );
+		exit ( 1 );
+	}
+	boot_trace ("config");
+
+	/* catalogs of songs and soundfonts: read from their index, or index is rebuilt if files have changed */
+	/* analysis of songs is taken from metadata cache, mapped in memory first; songs not analyzed yet are filled in by metadata scanner */
+	metadata_init ();
+	catalog_build (0);
+	catalog_build (1);
+	boot_trace ("catalog");
+
+	/* restore session saved before synthi stopped (crash, power cycle...): names to load at startup, volume, setlist entry */
+	/* tempo and position are restored once startup song is loaded */
+	if (session_restore (mapping->session_file, &session) == EXIT_SUCCESS) {
+		for (i = 0; i < NB_NAMES; i++) {
+			for (j = B0; j <= B7; j++) filename[i].status[j] = ((((i == 0) ? session.song : session.soundfont) >> j) & 1) ? ON : OFF;
+		}
+		gain_target = session.volume;
+		volume = (int) lroundf (session.volume * 10.0f);
+		if (session.setlist_index < mapping->nb_setlist) setlist_index = session.setlist_index;
+		song_bank = session.bank;
+		sf2_bank = session.sf2_bank;
+		boot_trace ("session restored");
+	}
+
+	/* limit locked memory to budget, before fluidsynth locks samples */
+	rt_init (mapping);
+
 	/* open a client connection to the JACK server */
 
 	client = jack_client_open ( client_name, options, &status, server_name );
@@ -209,6 +404,7 @@ int main ( int argc, char *argv[] )
 		client_name = jack_get_client_name ( client );
 		fprintf ( stderr, "unique name `%s' assigned.\n", client_name );
 	}
+	boot_trace ("jack client");
 
 	/* tell the JACK server to call `process()' whenever
 	   there is work to be done.
@@ -227,24 +423,20 @@ int main ( int argc, char *argv[] )
 	*/
 	jack_on_shutdown ( client, jack_shutdown, 0 );
 
-	/* register midi-in port: this port will get the midi keys notification (from UI) */
-	midi_input_port = jack_port_register (client, "midi_input_1", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
-	if (midi_input_port == NULL ) {
-		fprintf ( stderr, "no more JACK MIDI ports available.\n" );
+	/* tell the JACK server to call `port_registration()' and `port_connect()' when ports
+	   appear or get disconnected, so that connections of config file are re-established
+	*/
+	jack_set_port_registration_callback ( client, port_registration, 0 );
+	jack_set_port_connect_callback ( client, port_connect, 0 );
+
+	/* register midi-in and midi-out ports of each surface */
+	if (register_ports (mapping, NULL) == EXIT_FAILURE) {
 		kill_gpio ();
 		// JACK client close
 		jack_client_close ( client );
 		exit ( 1 );
 	}
 
-	/* register midi-out port: this port will send the midi notifications to light on/off pad leds */
-	midi_output_port = jack_port_register (client, "midi_output_1", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
-	if (midi_output_port == NULL ) {
-		fprintf ( stderr, "no more JACK MIDI ports available.\n" );
-		kill_gpio ();
-		exit ( 1 );
-	}
-
 	/* register clock-out port: this port will send the clock notifications to exteral system (eg. boocli) */
 	clock_output_port = jack_port_register (client, "clock_output_1", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
 	if (clock_output_port == NULL ) {
@@ -256,6 +448,11 @@ int main ( int argc, char *argv[] )
 		exit ( 1 );
 	}
 
+	/* register click-out port: metronome click, independent of the mix (eg. for the headphones of the drummer) */
+	click_output_port = jack_port_register (client, "click_output_1", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+	if ((click_output_port == NULL) || (click_init () == EXIT_FAILURE)) fprintf ( stderr, "no click: JACK audio port or memory not available.\n" );
+	boot_trace ("ports registered");
+
 
 	/* Tell the JACK server that we are ready to roll.  Our
 	 * process() callback will start running now. */
@@ -268,32 +465,65 @@ int main ( int argc, char *argv[] )
 		jack_client_close ( client );
 		exit ( 1 );
 	}
+	boot_trace ("jack activated");
 
 	// init GPIO to enable external "beat" switch
 	gpio_state = init_gpio ();
-
-	// init global variables
-	init_globals();
+	// switch is read by its own thread, not by process callback
+	if (gpio_state == ON) {
+		if (pthread_create (&gpio, NULL, gpio_thread, NULL) != 0) {
+			fprintf ( stderr, "unable to start gpio thread.\n" );
+			kill_gpio ();
+		}
+		else pthread_detach (gpio);
+	}
+	boot_trace ("gpio");
 
 	// init fluidsynth
 	settings = new_fluid_settings();
+	// lock samples in memory, within budget, so that playing never waits for the SD card
+	fluid_settings_setint(settings, "synth.lock-memory", rt_lock_samples ());
+	// load samples of a preset when it is used (pinned by song at load time), instead of the whole soundfont
+	// (this is set at startup only: reloading config file does not change it)
+	lazy_loading = mapping->lazy_loading;
+	fluid_settings_setint(settings, "synth.dynamic-sample-loading", lazy_loading);
+	// synths render at the sample rate of jack: synths of parts are mixed as they are, in the output of main synth
+	fluid_settings_setnum(settings, "synth.sample-rate", (double) sample_rate);
+	// settings measured on this device by calibration, if profile matches sample rate and period of jack
+	interpolation = profile_apply (mapping, settings);
+	// polyphony, and channels which voices are stolen last, as set for load governor
+	governor_init (mapping, settings);
 	synth = new_fluid_synth(settings);
+	// channels split across parts: synths of parts are created, with their render threads (set at startup only)
+	parts_init (mapping, settings);
+	if (interpolation >= 0) {
+		for (i = 0; i < nb_parts; i++) fluid_synth_set_interp_method (part_synth [i], -1, interpolation);
+	}
+	// soundfonts are loaded by a synth which does not render, and then moved to synth: synth is never locked while a file is read
+	loader_synth = new_fluid_synth(settings);
 	// jack as audio driver
 	// sample rate as the one defined in jack
 	fluid_settings_setstr(settings, "audio.driver", "jack");
 
 	// start the synthesizer thread
-	adriver = new_fluid_audio_driver(settings, synth);
+	// render callback sets up render thread (core, stack) at its first cycle
+	adriver = new_fluid_audio_driver2(settings, render_process, (void *) synth);
 
-	// load default soundfont
-	// default soundfont will always be in memory and will never be unloaded
-	// to avoid sound issues
-	if (fluid_is_soundfont(DEFAULT_SF2)) {
-		fluid_synth_sfload(synth, DEFAULT_SF2, TRUE);
-	}
+	// load default soundfont in background: surface and ports are made ready meanwhile
+	// default soundfont is moved to synth by main loop once loaded; songs are loaded after it
+	boot_start ();
 
 	// create new player, but don't load anything for now
-	player = new_fluid_player(synth);
+	eng = new_engine (synth, NULL);
+	if (eng == NULL) {
+		fprintf ( stderr, "unable to create player.\n" );
+		kill_gpio ();
+		// JACK client close
+		jack_client_close ( client );
+		exit ( 1 );
+	}
+	engine_publish (eng);
+	boot_trace ("synth");
 
 
 
@@ -301,22 +531,6 @@ int main ( int argc, char *argv[] )
 	/* MAIN START */
 	/**************/
 
-	/* read config file to get all the parameters */
-	if (read_config (config_name)==EXIT_FAILURE) {
-		fprintf ( stderr, "error in reading config file.\n" );
-		kill_gpio ();
-		// JACK client close
-		jack_client_close ( client );
-
-		// Fluidsynth cleanup
-		delete_fluid_player(player);
-		delete_fluid_audio_driver(adriver);
-		delete_fluid_synth(synth);
-		delete_fluid_settings(settings);
-
-		exit ( 1 );
-	}
-
 	/* Connect the ports.  You can't do this before the client is
 	 * activated, because we can't make connections to clients
 	 * that aren't running.  Note the confusing (but necessary)
@@ -326,38 +540,23 @@ int main ( int argc, char *argv[] )
 	 */
 
 	/* go through the list of ports to be connected and connect them by pair (server, client) */
-	i=0;
-	fprintf (stderr, "attempt to connect input-output ports together.\n");
-
-	while ((ports_to_connect[i][0]!='\x0') && (ports_to_connect[i+1][0]!='\x0')) {
-		fprintf (stderr, "server: %s , client: %s\n", ports_to_connect[i], ports_to_connect[i+1]);
-		if ( jack_connect ( client, ports_to_connect [i], ports_to_connect [i+1]) ) {
-			fprintf ( stderr, "cannot connect ports (between client and server).\n" );
-// removed the below 2 lines to so synthi is run in standalone without connection to boocli
-//			kill_gpio ();
-//			exit (1);
-		}
-		/* increment index of 2 position to move to next (server, client) port couple */
-		i+=2;
-	}
+	connect_ports (mapping, NULL);
+	boot_trace ("ports connected");
 
-	/* clear memory allocated to connect client/server input-output */
-	for (i=0; i<255; i++) free (ports_to_connect[i]);
-	free (ports_to_connect);
+	/* start background loader, prefetching next song of setlist */
+	prefetch_start ();
+	/* start scanner of songs, analyzing songs which are new or have changed since last run */
+	metadata_start ();
+	/* start renderer of heavy songs in cache, and streamer of cached songs */
+	prerender_start ();
+	/* files of startup song (00_*, or song of restored session) are read while default soundfont is loading */
+	prefetch_request (song_bank, session.song, sf2_bank, session.soundfont);
 
+	/* open control endpoint (OSC over UDP), if any; synthi can still be used with surfaces if it fails */
+	control_start (mapping);
+	boot_trace ("control endpoint");
 
 
-	/* install a signal handler to properly quits jack client */
-#ifdef WIN32
-	signal ( SIGINT, signal_handler );
-	signal ( SIGABRT, signal_handler );
-	signal ( SIGTERM, signal_handler );
-#else
-	signal ( SIGQUIT, signal_handler );
-	signal ( SIGTERM, signal_handler );
-	signal ( SIGHUP, signal_handler );
-	signal ( SIGINT, signal_handler );
-#endif
 
 	/* switch all leds off for all filenames */
 	for (i = 0; i<NB_NAMES; i++) {
@@ -379,16 +578,49 @@ int main ( int argc, char *argv[] )
 		memset (&led_status_filefunct[i][0], OFF, LAST_ELT_FCT);
 	}
 
-	// at start, we use default volume (2); light on the volume pads to indicate this to the user
-	led_filefunct (0, VOLDOWN, PENDING);
-	led_filefunct (0, VOLUP, PENDING);
+	// at start, we use default volume (2) or volume of restored session; light on the volume pads to indicate this to the user
+	led_volume ();
+	// light name pads of the files to load at startup
+	for (i = 0; i<NB_NAMES; i++) {
+		for (j = B0; j <= B7; j++) led_filename (i, j, filename[i].status[j]);
+	}
+	// load pad shows loading state until startup song is loaded
+	led_filename (0, LOAD, PENDING);
+	boot_trace ("surface lit");
 
+	/* realtime setup of main thread (loader), once all other threads are created; lock code in memory */
+	rt_setup_thread (RT_LOADER);
+	if (rt_lock_code () == EXIT_FAILURE) fprintf ( stderr, "realtime: code could not be locked in memory (budget or RLIMIT_MEMLOCK too low).\n" );
+	rt_report ();
+	boot_trace ("ready");
 
-	/* keep running until the transport stops */
-	while (1)
+
+	/* keep running until a signal asks to stop, or jack server shuts down */
+	while (is_running)
 	{
+		// check if ports have appeared or have been disconnected: make missing connections again
+		// a surface which has been (re)connected has lost its leds: send all leds again
+		if (is_reconnect) {
+			is_reconnect = FALSE;
+			if (reconnect_ports (mapping)) led_repaint (mapping);
+		}
+
+		// check if SIGHUP has been received to reload config file (mapping of surfaces, connections)
+		// catalogs are checked too: files may have been added to the library
+		if (is_reload) {
+			is_reload = FALSE;
+			reload_config (config_name);
+			catalog_build (0);
+			catalog_build (1);
+			metadata_rescan ();
+		}
+
+		// check if default soundfont has been loaded by boot thread
+		if (is_booting && boot_done (synth)) is_booting = FALSE;
+
 		// check if user has loaded the LOAD button to load midi and SF2 file
-		if (is_load) {
+		// files are loaded once default soundfont is in memory (at startup, load pad shows loading state meanwhile)
+		if (is_load && !is_booting) {
 
 
 /* for debug purpose only
@@ -402,30 +634,61 @@ if (name_to_byte (&filename [0]) == 01) {
 }
 */
 			
+			// engine replaced by the one of the new song, if any
+			old = NULL;
+			// files of the song prefetched in memory by background loader, if any
+			memset (&song_file, 0, sizeof (prefetch_t));
+			memset (&sf2_file, 0, sizeof (prefetch_t));
+
 			// make sure no file is playing to allow load of new file !
-			if ((fluid_player_get_status (player)== FLUID_PLAYER_DONE) || (fluid_player_get_status (player)== FLUID_PLAYER_READY)) {
+			// soundfont may be changed while playing: programs are re-bound to the new soundfont at next beat or bar
+			is_stopped = (player_get_status (engine)== FLUID_PLAYER_DONE) || (player_get_status (engine)== FLUID_PLAYER_READY);
+			if (is_stopped) {
 			
 				// get name of requested midi file from directory
-				if (get_full_filename (name, name_to_byte (&filename [0]), "./songs/") == TRUE) {
-					// if a file exists
-					if (fluid_is_midifile(name)) {
+				if (catalog_lookup (0, song_bank, name_to_byte (&filename [0]), name, &song_info) == TRUE) {
+					// take file from memory if it has been prefetched: it is not read from SD card again
+					prefetch_take (0, name, &song_file);
+					// if a file exists, create new engine (player) for the file
+					// current engine is used by realtime threads until new one is ready
+					if (fluid_is_midifile(name) && ((eng = new_engine (synth, engine)) != NULL)) {
 						
-						// delete current fluid player
-						delete_fluid_player (player);
-						// create new player
-						player = new_fluid_player(synth);
-						// set player callback at tick
-						fluid_player_set_tick_callback (player, handle_tick, (void *) player);
+						// get analysis of the song from metadata cache; song is analyzed now if it has changed since last scan
+						if (!metadata_get (name, &song_md)) {
+							if (metadata_analyze (name, &song_md) == EXIT_FAILURE) {
+								memset (&song_md, 0, sizeof (metadata_t));
+								song_md.time_sig [0] = 4;
+								song_md.time_sig [1] = 2;
+							}
+							metadata_rescan ();
+						}
 
 						// get new ppq value
-						ppq = get_division (name); 
-						// load midi file
-						fluid_player_add(player, name);
+						eng->ppq = (song_md.division > 0) ? song_md.division : get_division (name);
+						strcpy (eng->song, name);
+						// get presets played by the song, to load only their samples
+						eng->nb_presets = song_md.nb_presets;
+						for (i = 0; i < song_md.nb_presets; i++) {
+							eng->preset [i][0] = song_md.preset [i][0];
+							eng->preset [i][1] = song_md.preset [i][1];
+						}
+						// length of a bar, used to swap soundfont on a bar boundary
+						eng->ticks_per_bar = (eng->ppq * 4 * song_md.time_sig [0]) >> song_md.time_sig [1];
+						// load song: compiled song if it is up to date (mapped in memory, without any parsing), otherwise midi file
+						player_load (eng, name, song_file.data, song_file.size);
 						// set endless looping of current file
-						fluid_player_set_loop (player, -1);
+						player_set_loop (eng, -1);
+						// loop region of the song, if set in its catalog: played again until released by loop pad
+						if ((song_info.loop [0] > 0) && (song_info.loop [1] >= song_info.loop [0])) player_set_region (eng, song_info.loop [0] - 1, song_info.loop [1] - song_info.loop [0] + 1);
+						// replace current engine; current engine is freed later, once process callback can't use it any more
+						old = engine;
+						engine_publish (eng);
 
 						// initial bpm of the file is set to -1 to force reading of initial bpm if bpm pads are pressed
 						initial_bpm = -1;
+						// new player uses file tempo, until tempo fader is moved
+						tempo_target = -1.0f;
+						tempo = -1.0f;
 						now = 0;			// used for automated tempo adjustment (at press of switch)
 						previous = 0;
 
@@ -435,56 +698,145 @@ if (name_to_byte (&filename [0]) == 01) {
 
 					}
 				}
+			}
 
-				// get name of requested SF2 file from directory
-				if (get_full_filename (name, name_to_byte (&filename [1]), "./soundfonts/") == TRUE) {
-					// if a file exists
-					if (fluid_is_soundfont(name)) {
-						// unload previously loaded soundfont
-						// this is to prevent memory issues (lack of memory)
-						// however make sure we don't unload the only soundfont in memory
-						// in theory we should have at least 1 soundfont all the time in memory (default SF2)
-						if (fluid_synth_sfcount (synth) > 1) fluid_synth_sfunload (synth, sf2_id, TRUE);
-						// load new sf2 file
-						sf2_id = fluid_synth_sfload(synth, name, TRUE);
+			// get name of requested SF2 file from directory
+			// a song may be linked to a soundfont in its catalog: it is loaded when soundfont 00 is selected
+			soundfont = (sf2_bank << 8) | name_to_byte (&filename [1]);
+			if ((old != NULL) && ((soundfont & 0xFF) == 0) && (song_info.soundfont > 0)) soundfont = song_info.soundfont;
+			if (catalog_lookup (1, (soundfont >> 8) & 0xFF, soundfont & 0xFF, name, NULL) == TRUE) {
+				// keep prefetched file in memory while loading: fluidsynth reads it from memory, not from SD card
+				prefetch_take (1, name, &sf2_file);
+				// if a file exists, and is not the soundfont in use
+				if (fluid_is_soundfont(name) && strcmp (name, engine->sf2)) {
+					// load new sf2 file aside, with the samples of the presets played by the song
+					// soundfont id is only used by main thread: it is changed in the current engine
+					sf2_id = engine_load_sf2 (synth, engine, name, lazy_loading);
+					if (sf2_id != FLUID_FAILED) {
+						strcpy (engine->sf2, name);
+						// re-bind programs to new soundfont, now or at next beat or bar if playing
+						// previous soundfont is then unloaded, and freed once its voices have ended
+						// however make sure we never unload default soundfont: it is always in memory
+						engine_swap_sf2 (synth, engine, sf2_id, is_stopped, (mapping->swap_at == SWAP_BAR) ? engine->ticks_per_bar : engine->ppq);
 					}
 				}
 			}
 
+			// load samples of the presets played by the song, and free samples of presets not played any more
+			if (is_stopped && lazy_loading) engine_pin_presets (synth, engine, old);
+
+			// heavy song rendered in cache: it is played from there, events of the player are not sent to synth
+			if (is_stopped) {
+				if (prerender_play (engine->song, engine->sf2)) player_set_playback_callback (engine, prerender_mute, NULL);
+				else if (nb_parts > 1) player_set_playback_callback (engine, parts_route, NULL);
+				else player_set_playback_callback (engine, fluid_synth_handle_midi_event, synth);
+			}
+
+			// files are loaded: prefetched files are not needed any more
+			prefetch_free (&song_file);
+			prefetch_free (&sf2_file);
+
+			// prefetch next entry of setlist, while this one is played
+			if (setlist_index + 1 < mapping->nb_setlist) prefetch_request (mapping->setlist_bank [setlist_index + 1][0], mapping->setlist [setlist_index + 1][0], mapping->setlist_bank [setlist_index + 1][1], mapping->setlist [setlist_index + 1][1]);
+			// light next and previous pads if there is an entry to go to
+			led_filefunct (0, NEXT, (setlist_index + 1 < mapping->nb_setlist) ? ON : OFF);
+			led_filefunct (0, PREV, ((setlist_index > 0) && (setlist_index - 1 < mapping->nb_setlist)) ? ON : OFF);
+			// light back and forward pads if song has bars to jump to
+			led_filefunct (0, BACK, (player_get_nb_bars (engine) > 1) ? ON : OFF);
+			led_filefunct (0, FORWARD, (player_get_nb_bars (engine) > 1) ? ON : OFF);
+
+			if (is_startup) {
+				is_startup = FALSE;
+				// back to tempo and position of restored session
+				if (session.tempo > 0.0f) send_command (COMMANDS, 0, CMD_TEMPO, (int) lroundf (session.tempo * 100.0f));
+				if (session.tick > 0) send_command (COMMANDS, 0, CMD_SEEK, session.tick);
+				boot_trace ("startup song");
+			}
+
 			// load is done; set to FALSE
 			is_load = FALSE;
-			// load led OFF
-			led_filename (0, LOAD, is_load);
+			// load led OFF, or pending until soundfont swap is done
+			led_filename (0, LOAD, (engine_swap_check (synth, FALSE) == SWAP_PENDING) ? PENDING : OFF);
 		}
 
-		// check if user has pressed volume pads; this part is also executed at startup
-		if (is_volume) {
-			// set gain: 0 < gain < 1.0 (default = 0.2)
-			fluid_settings_setnum (settings, "synth.gain", (float) volume/10.0f);
-			// volume setting is done; set to FALSE
-			is_volume = FALSE;
-			// no need to light on/off the pads, this is done in the process thread
-		}
+		// soundfont swap: once programs are re-bound (at beat or bar boundary, or now if player has stopped), unload old soundfont
+		if (engine_swap_check (synth, (player_get_status (engine) != FLUID_PLAYER_PLAYING)) == SWAP_DONE) led_filename (0, LOAD, OFF);
+
+
+		// free engines replaced by a new one, and mappings replaced by a reloaded one, which are not used by process callback any more
+		engine_reclaim (FALSE);
+		mapping_reclaim (FALSE);
+
+		// check if jack server has shut down or disconnected us
+		if (is_shutdown) break;
 
+		// load governor runs while playing
+		arm_governor (governor_fd, (player_get_status (engine) == FLUID_PLAYER_PLAYING));
 
-#ifdef WIN32
-		Sleep ( 1000 );
-#else
-		sleep ( 1 );
-#endif
+		// wait for next request: nothing is done while there is no request
+		nb_events = epoll_wait (epoll_fd, events, 4, -1);
+		if ((nb_events < 0) && (errno != EINTR)) {
+			fprintf ( stderr, "error while waiting for events.\n" );
+			break;
+		}
+
+		for (i = 0; i < nb_events; i++) {
+			// SIGHUP reloads config file (mapping of surfaces, connections); other signals stop synthi
+			if (events[i].data.fd == signal_fd) {
+				if (read (signal_fd, &siginfo, sizeof (siginfo)) != sizeof (siginfo)) continue;
+				if (siginfo.ssi_signo == SIGHUP) is_reload = TRUE;
+				else {
+					fprintf ( stderr, "signal received, exiting ...\n" );
+					is_running = FALSE;
+				}
+			}
+			// request from process callback or jack callbacks: requests are given by flags; reset wake up counter
+			if (events[i].data.fd == wakeup_fd) {
+				while (read (wakeup_fd, &counter, sizeof (counter)) == sizeof (counter));
+			}
+			// housekeeping: check connections, in case an event from jack has been missed
+			if (events[i].data.fd == timer_fd) {
+				if (read (timer_fd, &counter, sizeof (counter)) == sizeof (counter)) is_reconnect = TRUE;
+				// report realtime setup of jack threads, done at their first cycle
+				rt_report ();
+				parts_report ();
+				prerender_report ();
+				// save session if it has changed, once session restored at startup has been applied
+				if (!is_startup) session_save (mapping->session_file);
+			}
+			// load governor: adjust polyphony to DSP load
+			if (events[i].data.fd == governor_fd) {
+				if (read (governor_fd, &counter, sizeof (counter)) == sizeof (counter)) governor_update ();
+			}
+		}
 	}
 
+	// save last session
+	if (!is_startup) session_save (mapping->session_file);
+
 	// terminate gpio support
 	kill_gpio ();
 
 	// JACK client close
 	jack_client_close ( client );
+	mapping_reclaim (TRUE);
 
-	// Fluidsynth cleanup
-	delete_fluid_player(player);
+	// Fluidsynth cleanup: process callback is not running any more, all engines can be freed
+	engine_publish (NULL);
+	engine_reclaim (TRUE);
 	delete_fluid_audio_driver(adriver);
+	// part threads only render when render thread asks for it: they are idle once audio driver is deleted
+	for (i = 1; i < nb_parts; i++) delete_fluid_synth(part_synth [i]);
 	delete_fluid_synth(synth);
+	delete_fluid_synth(loader_synth);
 	delete_fluid_settings(settings);
 
-	exit ( 0 );
+	close (timer_fd);
+	close (governor_fd);
+	close (signal_fd);
+	close (wakeup_fd);
+	close (epoll_fd);
+
+	// exit with error if jack server has stopped us
+	exit ( is_shutdown ? 1 : 0 );
 }
@@ -13,12 +13,11 @@
 int gpio_state;     // OFF = gpio OFF: ON = GPIO ON
 int gpio_deamon;    // deamon id for pigpiod
 uint64_t previous_led;  // time when switch was set as on
+int gpio_beat;			// set by gpio thread when switch is pressed; reset by process callback
 
-// define midi ports
-jack_port_t *midi_input_port;
-jack_port_t *midi_output_port;
+// define midi ports (midi in and out ports of surfaces are in surface structure)
 jack_port_t *clock_output_port;
-char **ports_to_connect;
+jack_port_t *click_output_port;			// audio port of metronome click
 
 // define JACKD client : this is this program
 jack_client_t *client;
@@ -26,23 +25,39 @@ jack_client_t *client;
 // number of frames per Jack packet and sample-rate
 uint32_t nb_frames_per_packet, sample_rate;
 
-// FLUIDSYNTH player
-fluid_player_t* player;
+// FLUIDSYNTH synth; player and soundfont are in engine
 fluid_settings_t* settings;
 fluid_synth_t* synth;
+fluid_synth_t* loader_synth;	// synth not rendering, used to load soundfonts without stalling synth
+fluid_synth_t* part_synth [MAX_PARTS];	// synths channels are split across: main synth, then parts rendered by their own thread
+int nb_parts;			// number of synths in part_synth
 fluid_audio_driver_t* adriver;
 
+// engine used by realtime threads (player, soundfont, song details); swapped with a new one when a song is loaded
+// process callback reads it once per cycle; old engines are freed once process callback can't use them any more
+engine_t *engine;
+int default_sf2_id;		// id of default soundfont, always in memory
+int sf2_swap;			// soundfont which programs shall be re-bound to by tick callback at next boundary; -1 if none
+int sf2_swap_ticks;		// boundary of soundfont swap, in ticks: a beat or a bar
+
 // determine if midi clock shall be sent or not
 int send_clock = NO_CLOCK;
 
 // define filename structure for each file name: midi file and SF2 file
+// controls and leds of the structure are not used: each surface has its own
 filename_t filename [NB_NAMES];
-// define function structure
+// define function structure (controls and leds are not used: each surface has its own)
 filefunct_t filefunct [NB_FCT];
 
-// define the structures for managing leds of midi control surface
-unsigned char list_buffer[LIST_ELT][4];	// list buffer of LIST_ELT led request
-unsigned char list_index;			// index where to write led request to
+// define the mapping read from config file: midi control surfaces (controls and leds), fader settings and connections
+// the mapping is swapped with a new one when config file is reloaded: process callback uses it through this pointer only
+mapping_t *mapping;
+uint32_t process_cycle;			// number of process cycles completed; used to know when an old mapping is not used any more
+
+// wake up of main thread, and requests it handles
+int wakeup_fd;						// eventfd written to wake up main thread as soon as there is a request to handle
+volatile int is_reconnect;			// set when jack ports appear or get disconnected, to re-establish connections
+volatile int is_shutdown;			// set when jack server shuts down, to stop main thread
 
 // status of leds for filenames
 unsigned char led_status_filename [NB_NAMES][LAST_ELT]; 	// this table will contain whether each light is on/off at a time; this is to avoid sending led requests which are not required
@@ -51,16 +66,18 @@ unsigned char led_status_filefunct [NB_FCT][LAST_ELT_FCT]; 	// this table will c
 /* load (midi and SF2 files) & play (midi file) globals */
 int is_load;
 int is_play;
-int sf2_id;		// id of sf2 file currently loaded
+int setlist_index;	// entry of setlist currently loaded; -1 if none
+int song_bank;			// bank of songs selected; set by process callback
+int sf2_bank;			// bank of soundfonts selected; set by process callback
 
 /* volume and BPM */
 int bpm;
 int initial_bpm;
 int volume;
-int is_volume;
-
-/* PPQ */
-int ppq;
+float gain;				// gain currently applied to the synth
+float gain_target;		// gain requested by volume pads or fader; gain is smoothed towards it in process callback
+float tempo;			// bpm currently applied to the player; -1 if file tempo is used
+float tempo_target;		// bpm requested by tempo fader; tempo is smoothed towards it in process callback
 
 /* beat */
 uint64_t now;       // time now
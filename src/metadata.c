@@ -0,0 +1,246 @@
+/** @file metadata.c
+ *
+ * @brief Metadata cache: analysis of songs (division, length, tempo map, time signature, presets played, peak polyphony)
+ * is kept in a binary file next to songs, keyed by full name, size and time of last modification of each file.
+ * Cache file is mapped in memory at startup; a scanner thread analyzes songs which are new or have changed, then writes
+ * the cache file again. A song is then only analyzed once per change of its file, not at each load.
+ * The scanner also compiles songs which are new or have changed (see song.c), so that they are loaded without parsing.
+ *
+ */
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "globals.h"
+#include "metadata.h"
+#include "catalog.h"
+#include "smf.h"
+#include "song.h"
+#include "rt.h"
+#include "utils.h"
+
+
+// cache file mapped in memory, and its metadata (ordered by key)
+static void *map;
+static size_t map_size;
+static metadata_t *cache;
+static int nb_cache;
+
+// mapping is read by main thread and replaced by scanner thread
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// scan requested to scanner thread
+static pthread_cond_t requested = PTHREAD_COND_INITIALIZER;
+static int is_request = FALSE;
+
+
+// order of metadata in cache: by key
+static int compare_keys (const void *a, const void *b)
+{
+	const metadata_t *ma = a, *mb = b;
+
+	if (ma->key == mb->key) return 0;
+	return (ma->key < mb->key) ? -1 : 1;
+}
+
+
+// find metadata of key in cache; called with lock held
+static metadata_t *find (uint64_t key)
+{
+	metadata_t md;
+
+	if (cache == NULL) return NULL;
+	md.key = key;
+	return bsearch (&md, cache, nb_cache, sizeof (metadata_t), compare_keys);
+}
+
+
+// map cache file in memory, replacing previous mapping; cache is empty if file is missing or has another format
+static void map_cache ()
+{
+	int fd;
+	struct stat st;
+	void *data = NULL;
+	size_t size = 0;
+	metadata_header_t *header;
+
+	if ((fd = open (METADATA_FILE, O_RDONLY)) >= 0) {
+		if ((fstat (fd, &st) == 0) && (st.st_size >= sizeof (metadata_header_t))) {
+			data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (data == MAP_FAILED) data = NULL;
+			else size = st.st_size;
+		}
+		close (fd);
+	}
+
+	// check format of cache file
+	header = data;
+	if ((header != NULL) && ((header->magic != METADATA_MAGIC) || (header->version != METADATA_VERSION) ||
+		(header->record_size != sizeof (metadata_t)) || (size < sizeof (metadata_header_t) + (size_t) header->nb * sizeof (metadata_t)))) {
+		munmap (data, size);
+		data = NULL;
+		size = 0;
+	}
+
+	pthread_mutex_lock (&lock);
+	if (map != NULL) munmap (map, map_size);
+	map = data;
+	map_size = size;
+	cache = (data == NULL) ? NULL : (metadata_t *) ((char *) data + sizeof (metadata_header_t));
+	nb_cache = (data == NULL) ? 0 : header->nb;
+	pthread_mutex_unlock (&lock);
+}
+
+
+// get metadata of file name in cache, if it is up to date; returns FALSE if file has not been analyzed since it changed
+int metadata_get (char *name, metadata_t *md)
+{
+	struct stat st;
+	metadata_t *found;
+	int result = FALSE;
+
+	if (stat (name, &st) < 0) return FALSE;
+
+	pthread_mutex_lock (&lock);
+	found = find (hash_string (name));
+	if ((found != NULL) && (found->size == st.st_size) && (found->mtime == (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec)) {
+		*md = *found;
+		result = TRUE;
+	}
+	pthread_mutex_unlock (&lock);
+
+	return result;
+}
+
+
+// analyze file name now, without cache (file is new, or has changed and has not been scanned yet)
+int metadata_analyze (char *name, metadata_t *md)
+{
+	struct stat st;
+
+	if (stat (name, &st) < 0) return EXIT_FAILURE;
+	if (smf_analyze (name, md) == EXIT_FAILURE) return EXIT_FAILURE;
+	md->key = hash_string (name);
+	md->size = st.st_size;
+	md->mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	return EXIT_SUCCESS;
+}
+
+
+// write cache file: written in a temporary file, synced, then renamed
+static int write_cache (metadata_t *md, int nb)
+{
+	char tmp [PATH_LEN];
+	metadata_header_t header;
+	FILE *f;
+	int result = EXIT_FAILURE;
+
+	header.magic = METADATA_MAGIC;
+	header.version = METADATA_VERSION;
+	header.record_size = sizeof (metadata_t);
+	header.nb = nb;
+
+	snprintf (tmp, PATH_LEN, "%s.tmp", METADATA_FILE);
+	if ((f = fopen (tmp, "wb")) != NULL) {
+		if ((fwrite (&header, sizeof (header), 1, f) == 1) && ((nb == 0) || (fwrite (md, sizeof (metadata_t), nb, f) == nb)) &&
+			(fflush (f) == 0) && (fsync (fileno (f)) == 0)) result = EXIT_SUCCESS;
+		if (fclose (f) != 0) result = EXIT_FAILURE;
+	}
+
+	if ((result == EXIT_FAILURE) || (rename (tmp, METADATA_FILE) < 0)) {
+		unlink (tmp);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+// scan songs of catalog: songs which are new or have changed are analyzed and compiled, and cache file is written if anything changed
+static void scan ()
+{
+	metadata_t *md = NULL, *bigger;
+	char name [PATH_LEN];
+	int nb = 0, size = 0, changed = FALSE;
+	int i;
+
+	for (i = 0; catalog_path (0, i, name); i++) {
+		if (nb == size) {
+			bigger = realloc (md, (size + 256) * sizeof (metadata_t));
+			if (bigger == NULL) break;
+			md = bigger;
+			size += 256;
+		}
+		if (metadata_get (name, &md [nb])) nb++;
+		else if (metadata_analyze (name, &md [nb]) == EXIT_SUCCESS) {
+			nb++;
+			changed = TRUE;
+		}
+		song_update (name);
+	}
+
+	// songs removed from catalog
+	if (nb != nb_cache) changed = TRUE;
+
+	if (changed) {
+		qsort (md, nb, sizeof (metadata_t), compare_keys);
+		if (write_cache (md, nb) == EXIT_SUCCESS) {
+			map_cache ();
+			// catalog gets information of songs analyzed by this scan
+			catalog_refresh ();
+		}
+		else fprintf ( stderr, "Unable to write metadata cache %s.\n", METADATA_FILE );
+	}
+	free (md);
+}
+
+
+// scanner thread: scan songs when requested by main thread
+static void *metadata_thread (void *arg)
+{
+	rt_setup_thread (RT_LOADER);
+
+	while (1) {
+		pthread_mutex_lock (&lock);
+		while (!is_request) pthread_cond_wait (&requested, &lock);
+		is_request = FALSE;
+		pthread_mutex_unlock (&lock);
+
+		scan ();
+	}
+
+	return NULL;
+}
+
+
+// map cache file in memory; called at startup, before catalog is built
+void metadata_init ()
+{
+	map_cache ();
+}
+
+
+// start scanner thread, and scan songs of catalog
+int metadata_start ()
+{
+	pthread_t thread;
+
+	if (pthread_create (&thread, NULL, metadata_thread, NULL) != 0) {
+		fprintf ( stderr, "Unable to start metadata scanner thread.\n" );
+		return EXIT_FAILURE;
+	}
+	pthread_detach (thread);
+	metadata_rescan ();
+	return EXIT_SUCCESS;
+}
+
+
+// ask scanner thread to scan songs again (catalog has been rebuilt, or a song has changed); this does not wait
+void metadata_rescan ()
+{
+	pthread_mutex_lock (&lock);
+	is_request = TRUE;
+	pthread_cond_signal (&requested);
+	pthread_mutex_unlock (&lock);
+}
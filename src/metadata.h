@@ -0,0 +1,11 @@
+/** @file metadata.h
+ *
+ * @brief This file defines prototypes of functions inside metadata.c
+ *
+ */
+
+void metadata_init ();
+int metadata_start ();
+void metadata_rescan ();
+int metadata_get (char *, metadata_t *);
+int metadata_analyze (char *, metadata_t *);
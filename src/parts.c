@@ -0,0 +1,446 @@
+/** @file parts.c
+ *
+ * @brief Parts: channels of the song are split across several synths, so that rendering uses several cores.
+ * Main synth (rendered by fluidsynth audio driver, with the player) renders the channels which are not split; each part
+ * is rendered by its own thread, pinned to its own core. Events of the player are routed to the synth of their channel.
+ * A synth is only driven by the thread rendering it: events, notes off and soundfont re-binds are queued for each synth
+ * (lock-free, single producer), with the frame of the block where they apply, and gain is set through an atomic value;
+ * the thread rendering a synth applies them between its chunks, so no realtime thread waits on the mutex of another synth.
+ * A compiled song is sequenced for the whole block before it is rendered: parts start rendering it before main synth
+ * does, in parallel. A midi file played by fluidsynth player sends its events while main synth renders, so parts
+ * render the block once main synth has. Parts are mixed in the output of main synth; a part which has not rendered
+ * its block by the deadline is left out of the mix for this block, instead of making audio late for all channels.
+ * Soundfonts are loaded in each synth in the same order, so that a soundfont has the same id in all synths; samples of
+ * a SF2 file are read once, as fluidsynth shares them between synths through its sample cache.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <semaphore.h>
+#include "types.h"
+#include "globals.h"
+#include "parts.h"
+#include "engine.h"
+#include "governor.h"
+#include "rt.h"
+
+
+// synth: main synth (part 0) or a part rendered by its own thread
+typedef struct {
+	pthread_t thread;
+	sem_t start;						// posted by render thread when a block shall be rendered
+	int state;							// PART_IDLE, PART_BUSY or PART_DONE
+	int is_started;						// block of this cycle has been given to part; only used by render thread
+	int len;							// number of frames of block
+	uint32_t block;						// block to render
+	uint32_t end;						// operations of the queue up to end (excluded) belong to block
+	part_op_t queue [PART_QUEUE];		// operations queued by render thread
+	uint32_t head;						// next operation to apply (thread rendering the synth)
+	uint32_t tail;						// next free entry (render thread)
+	int request;						// notes off requested by process callback (bit 0: release, bit 1: at once)
+	float gain;							// gain set on synth
+	fluid_midi_event_t *midi;			// event of operations applied to synth
+	float left [MAX_PART_FRAMES];		// output of last block
+	float right [MAX_PART_FRAMES];
+} part_t;
+
+static part_t part [MAX_PARTS];
+
+// part rendering each channel: 0 for main synth
+static int channel_part [16];
+
+// posted by a part each time it has rendered a block
+static sem_t finished;
+
+// block sequenced by render thread, and frame of the block operations are queued at
+static uint32_t block;
+static int block_offset;
+
+// TRUE while render thread sequences a whole block before main synth renders it: operations of main synth are queued too
+static int is_ahead;
+
+// gain of all synths (process callback to threads rendering synths)
+static float gain_all = -1.0f;
+
+// blocks left out of mix and operations dropped (queue full), since last report (render thread to main thread)
+static int nb_late;
+static int nb_dropped;
+
+
+// apply operation to synth s of part p
+static void apply (int p, fluid_synth_t *s, part_op_t *op)
+{
+	fluid_midi_event_t *midi = part [p].midi;
+
+	switch (op->op) {
+	case PART_EVENT:
+		if (op->type == 0xF0) fluid_midi_event_set_sysex (midi, op->data, op->size, FALSE);
+		else {
+			fluid_midi_event_set_type (midi, op->type);
+			fluid_midi_event_set_channel (midi, op->channel);
+			switch (op->type) {
+			case 0xB0:				// control change
+				fluid_midi_event_set_control (midi, op->param1);
+				fluid_midi_event_set_value (midi, op->param2);
+				break;
+			case 0xC0:				// program change, channel pressure
+			case 0xD0:
+				fluid_midi_event_set_program (midi, op->param1);
+				break;
+			case 0xE0:				// pitch bend
+				fluid_midi_event_set_pitch (midi, op->param1);
+				break;
+			default:				// note off, note on, key pressure
+				fluid_midi_event_set_key (midi, op->param1);
+				fluid_midi_event_set_velocity (midi, op->param2);
+				break;
+			}
+		}
+		fluid_synth_handle_midi_event (s, midi);
+		break;
+	case PART_NOTES_OFF:
+		fluid_synth_all_notes_off (s, -1);
+		break;
+	case PART_SOUNDS_OFF:
+		fluid_synth_all_sounds_off (s, -1);
+		break;
+	case PART_REBIND:
+		engine_rebind_synth (s, op->param1);
+		break;
+	}
+}
+
+
+// queue operation for synth of part p, at current frame of block; called by render thread
+// operations of main synth are applied at once, unless a whole block is sequenced before main synth renders it
+static void push (int p, part_op_t *op)
+{
+	uint32_t tail = part [p].tail;
+
+	if ((p == 0) && !is_ahead) {
+		apply (0, part_synth [0], op);
+		return;
+	}
+	if (tail - __atomic_load_n (&part [p].head, __ATOMIC_ACQUIRE) >= PART_QUEUE) {
+		__atomic_add_fetch (&nb_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	op->block = block;
+	op->offset = block_offset;
+	part [p].queue [tail % PART_QUEUE] = *op;
+	__atomic_store_n (&part [p].tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+// queue an operation without parameters for all synths
+static void push_all (int type, int param)
+{
+	part_op_t op;
+	int p;
+
+	op.op = type;
+	op.param1 = param;
+	for (p = 0; p < nb_parts; p++) push (p, &op);
+}
+
+
+// thread of a part: render a block each time render thread asks for it
+static void *part_thread (void *arg)
+{
+	int p = (int) (intptr_t) arg;
+	float *out [2] = { part [p].left, part [p].right };
+
+	rt_setup_thread (RT_PART + p - 1);
+
+	while (1) {
+		while (sem_wait (&part [p].start) != 0);
+		parts_sync (p, part_synth [p]);
+		governor_shed (part_synth [p], p);
+		memset (part [p].left, 0, part [p].len * sizeof (float));
+		memset (part [p].right, 0, part [p].len * sizeof (float));
+		parts_render (p, part_synth [p], part [p].len, 0, NULL, 2, out);
+		__atomic_store_n (&part [p].state, PART_DONE, __ATOMIC_RELEASE);
+		sem_post (&finished);
+	}
+
+	return NULL;
+}
+
+
+// create synths of parts and their threads, as set in map; main synth is part 0
+// called after main synth is created, and before audio driver is started
+int parts_init (mapping_t *map, fluid_settings_t *settings)
+{
+	int p, chan;
+
+	part_synth [0] = synth;
+	memcpy (channel_part, map->channel_part, sizeof (channel_part));
+	part [0].midi = new_fluid_midi_event ();
+	part [0].gain = -1.0f;
+	sem_init (&finished, 0, 0);
+
+	for (p = 1; p < map->nb_parts; p++) {
+		part_synth [p] = new_fluid_synth (settings);
+		part [p].midi = new_fluid_midi_event ();
+		if ((part_synth [p] == NULL) || (part [p].midi == NULL) || (sem_init (&part [p].start, 0, 0) != 0)) break;
+		part [p].state = PART_IDLE;
+		part [p].gain = -1.0f;
+		if (pthread_create (&part [p].thread, NULL, part_thread, (void *) (intptr_t) p) != 0) {
+			sem_destroy (&part [p].start);
+			break;
+		}
+		pthread_detach (part [p].thread);
+	}
+
+	// parts which could not be created: their channels are rendered by main synth
+	if (p < map->nb_parts) {
+		fprintf ( stderr, "Unable to create part %d: its channels are rendered by main synth.\n", p );
+		if (part_synth [p] != NULL) delete_fluid_synth (part_synth [p]);
+		part_synth [p] = NULL;
+		if (part [p].midi != NULL) delete_fluid_midi_event (part [p].midi);
+		part [p].midi = NULL;
+		for (chan = 0; chan < 16; chan++) {
+			if (channel_part [chan] >= p) channel_part [chan] = 0;
+		}
+	}
+	nb_parts = p;
+
+	return (nb_parts == map->nb_parts) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// player callback for each midi event: channel events are queued for the synth of their channel
+// system messages are only sent by fluidsynth player, while main synth renders: fluidsynth can't give their data
+// back, so they go to main synth only (sysex of compiled songs go to all synths, see parts_sysex ())
+int parts_route (void *data, fluid_midi_event_t *event)
+{
+	part_op_t op;
+	int p;
+
+	op.type = fluid_midi_event_get_type (event);
+	if (op.type >= 0xF0) return fluid_synth_handle_midi_event (part_synth [0], event);
+
+	op.channel = fluid_midi_event_get_channel (event) & 0x0F;
+	p = channel_part [op.channel];
+	// main synth is rendering: event is handled at once
+	if ((p == 0) && !is_ahead) return fluid_synth_handle_midi_event (part_synth [0], event);
+
+	op.op = PART_EVENT;
+	switch (op.type) {
+	case 0xB0:				// control change
+		op.param1 = fluid_midi_event_get_control (event);
+		op.param2 = fluid_midi_event_get_value (event);
+		break;
+	case 0xC0:				// program change, channel pressure
+	case 0xD0:
+		op.param1 = fluid_midi_event_get_program (event);
+		break;
+	case 0xE0:				// pitch bend
+		op.param1 = fluid_midi_event_get_pitch (event);
+		break;
+	default:				// note off, note on, key pressure
+		op.param1 = fluid_midi_event_get_key (event);
+		op.param2 = fluid_midi_event_get_velocity (event);
+		break;
+	}
+	push (p, &op);
+	return FLUID_OK;
+}
+
+
+// send sysex of compiled song to all synths; called by sequencer instead of playback callback
+// a sysex too long to be queued is sent to main synth only, at the start of the block
+void parts_sysex (void *data, int size)
+{
+	part_op_t op;
+	int p;
+
+	if (size > PART_SYSEX) {
+		fluid_midi_event_set_sysex (part [0].midi, data, size, FALSE);
+		fluid_synth_handle_midi_event (part_synth [0], part [0].midi);
+		return;
+	}
+	op.op = PART_EVENT;
+	op.type = 0xF0;
+	op.size = size;
+	memcpy (op.data, data, size);
+	for (p = 0; p < nb_parts; p++) push (p, &op);
+}
+
+
+// start a block: operations are queued at its first frame; if ahead is TRUE, the whole block is sequenced before
+// main synth renders it, so that its operations are queued too
+void parts_begin (int ahead)
+{
+	block++;
+	block_offset = 0;
+	is_ahead = ahead;
+}
+
+
+// frame of the block operations are queued at from now on
+void parts_at (int offset)
+{
+	block_offset = offset;
+}
+
+
+// start rendering of a block of len frames by parts; called by render thread, once operations of the block are queued
+// a part still rendering a late block is left out of this block (its operations are applied with the next block it
+// renders); output of a late block is never mixed
+void parts_start (int len)
+{
+	int p;
+
+	for (p = 1; p < nb_parts; p++) {
+		part [p].is_started = FALSE;
+		if ((len > MAX_PART_FRAMES) || (__atomic_load_n (&part [p].state, __ATOMIC_ACQUIRE) == PART_BUSY)) continue;
+		part [p].is_started = TRUE;
+		part [p].len = len;
+		part [p].block = block;
+		part [p].end = part [p].tail;
+		__atomic_store_n (&part [p].state, PART_BUSY, __ATOMIC_RELAXED);
+		sem_post (&part [p].start);
+	}
+}
+
+
+// render len frames of synth s of part p, applying operations queued for the block at their frame
+// operations of a block the part has been left out of are applied at the first frame
+// called by the thread rendering the synth: part thread, or render thread for main synth
+int parts_render (int p, fluid_synth_t *s, int len, int nfx, float *fx [], int nout, float *out [])
+{
+	float *chunk_fx [nfx + 1], *chunk_out [nout + 1];
+	uint32_t end, current;
+	part_op_t *op;
+	int done, n, i, result = FLUID_OK;
+
+	end = (p == 0) ? part [0].tail : part [p].end;
+	current = (p == 0) ? block : part [p].block;
+
+	for (done = 0; done < len; done += n) {
+		n = len - done;
+		while (part [p].head != end) {
+			op = &part [p].queue [part [p].head % PART_QUEUE];
+			if ((op->block == current) && (op->offset > done)) {
+				n = op->offset - done;
+				break;
+			}
+			apply (p, s, op);
+			__atomic_store_n (&part [p].head, part [p].head + 1, __ATOMIC_RELEASE);
+		}
+		for (i = 0; i < nfx; i++) chunk_fx [i] = fx [i] + done;
+		for (i = 0; i < nout; i++) chunk_out [i] = out [i] + done;
+		if (fluid_synth_process (s, n, nfx, chunk_fx, nout, chunk_out) != FLUID_OK) result = FLUID_FAILED;
+	}
+	return result;
+}
+
+
+// apply to synth s of part p what process callback has asked since its last block: gain, notes off
+// called by the thread rendering the synth, before it renders a block
+void parts_sync (int p, fluid_synth_t *s)
+{
+	float gain;
+	int request;
+
+	__atomic_load (&gain_all, &gain, __ATOMIC_RELAXED);
+	if ((gain >= 0.0f) && (gain != part [p].gain)) {
+		fluid_synth_set_gain (s, gain);
+		part [p].gain = gain;
+	}
+
+	request = __atomic_exchange_n (&part [p].request, 0, __ATOMIC_ACQUIRE);
+	if (request & 2) fluid_synth_all_sounds_off (s, -1);
+	else if (request & 1) fluid_synth_all_notes_off (s, -1);
+}
+
+
+// set gain of all synths; called by process callback, applied by each synth before its next block
+void parts_set_gain (float gain)
+{
+	__atomic_store (&gain_all, &gain, __ATOMIC_RELAXED);
+}
+
+
+// mix parts which have rendered their block in out (left, right pairs); returns the number of parts still rendering
+static int mix_done (int len, int nout, float *out [])
+{
+	int pending = 0, p, i;
+
+	for (p = 1; p < nb_parts; p++) {
+		if (!part [p].is_started) continue;
+		if (__atomic_load_n (&part [p].state, __ATOMIC_ACQUIRE) != PART_DONE) {
+			pending++;
+			continue;
+		}
+		// part done: mix it in first pair of outputs (left, right)
+		if (nout >= 2) {
+			for (i = 0; i < len; i++) {
+				out [0] [i] += part [p].left [i];
+				out [1] [i] += part [p].right [i];
+			}
+		}
+		part [p].is_started = FALSE;
+		__atomic_store_n (&part [p].state, PART_IDLE, __ATOMIC_RELAXED);
+	}
+	return pending;
+}
+
+
+// wait for parts to render their block, until deadline (CLOCK_MONOTONIC), and mix them in out (left, right pairs)
+// called by render thread after parts_start (); parts are mixed as soon as they are done, render thread sleeps meanwhile
+void parts_mix (int len, int nout, float *out [], struct timespec *deadline)
+{
+	int pending, p;
+
+	// woken up each time a part is done; a post left by a late block only makes one more check
+	while ((pending = mix_done (len, nout, out)) > 0) {
+		if ((sem_clockwait (&finished, CLOCK_MONOTONIC, deadline) != 0) && (errno == ETIMEDOUT)) {
+			pending = mix_done (len, nout, out);
+			break;
+		}
+	}
+	if (pending == 0) return;
+
+	// parts late: they are left out of the mix of this block, and their block is dropped once rendered
+	for (p = 1; p < nb_parts; p++) part [p].is_started = FALSE;
+	__atomic_add_fetch (&nb_late, pending, __ATOMIC_RELAXED);
+}
+
+
+// release all notes of parts (player stopped) or stop all their sounds at once (player seeking)
+// called by process callback: each part does it before its next block; player does it for main synth
+void parts_notes_off (int at_once)
+{
+	int p;
+
+	for (p = 1; p < nb_parts; p++) __atomic_or_fetch (&part [p].request, at_once ? 2 : 1, __ATOMIC_RELEASE);
+}
+
+
+// release all notes or stop all sounds at once of all synths, at current frame of block; called by render thread
+void parts_all_off (int at_once)
+{
+	push_all (at_once ? PART_SOUNDS_OFF : PART_NOTES_OFF, 0);
+}
+
+
+// re-bind programs of all synths to soundfont sfid, at current frame of block; called by render thread
+void parts_rebind (int sfid)
+{
+	push_all (PART_REBIND, sfid);
+}
+
+
+// report blocks of parts left out of the mix, and operations dropped, since last report; called by main thread periodically
+void parts_report ()
+{
+	int late, dropped;
+
+	late = __atomic_exchange_n (&nb_late, 0, __ATOMIC_RELAXED);
+	if (late > 0) fprintf ( stderr, "parts: %d block(s) rendered too late, left out of the mix.\n", late );
+	dropped = __atomic_exchange_n (&nb_dropped, 0, __ATOMIC_RELAXED);
+	if (dropped > 0) fprintf ( stderr, "parts: %d event(s) dropped, queue full.\n", dropped );
+}
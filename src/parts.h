@@ -0,0 +1,20 @@
+/** @file parts.h
+ *
+ * @brief This file defines prototypes of functions inside parts.c
+ *
+ */
+
+int parts_init (mapping_t *, fluid_settings_t *);
+int parts_route (void *, fluid_midi_event_t *);
+void parts_sysex (void *, int);
+void parts_begin (int);
+void parts_at (int);
+void parts_start (int);
+int parts_render (int, fluid_synth_t *, int, int, float *[], int, float *[]);
+void parts_sync (int, fluid_synth_t *);
+void parts_set_gain (float);
+void parts_mix (int, int, float *[], struct timespec *);
+void parts_notes_off (int);
+void parts_all_off (int);
+void parts_rebind (int);
+void parts_report ();
@@ -0,0 +1,655 @@
+/** @file player.c
+ *
+ * @brief Player of an engine: a compiled song (see song.c) is played by the sequencer of synthi, a midi file which is not
+ * compiled (yet) is played by fluidsynth player. Both are driven through the same functions, named after the functions
+ * of fluidsynth player, so that process callback does not need to know which one plays the song.
+ * The sequencer is stepped by render thread every SONG_BLOCK frames, as fluidsynth player is by the synth: events due
+ * are sent by a linear scan of the events of the song, and the position moves at the tempo of the file (tempo map),
+ * or at the tempo set by pads, fader or beat switch.
+ * A loop region (bars) is played again at its end until it is released: the sequencer wraps at the exact frame where
+ * the region ends, releasing notes of the song and keeping tick callback (midi clock, beat) running.
+ * Beats are clicked at their exact frame (see click.c), and count-in bars are clicked before the song starts.
+ *
+ */
+
+#include "types.h"
+#include "globals.h"
+#include "player.h"
+#include "process.h"
+#include "parts.h"
+#include "song.h"
+#include "click.h"
+
+
+// load midi file name in player of engine: compiled song if it is up to date, otherwise midi file (from data if it
+// has been prefetched in memory, or from file); called by main thread before engine is published
+int player_load (engine_t *eng, char *name, void *data, size_t size)
+{
+	seq_t *seq;
+
+	seq = calloc (1, sizeof (seq_t));
+	if ((seq != NULL) && (song_map (name, seq) == EXIT_SUCCESS)) {
+		seq->midi = new_fluid_midi_event ();
+		if (seq->midi != NULL) {
+			seq->status = FLUID_PLAYER_READY;
+			seq->seek_to = -1;
+			seq->multiplier = 1000;
+			seq->file_tempo = seq->tempo [0].tempo;
+			eng->seq = seq;
+			return FLUID_OK;
+		}
+		song_unmap (seq);
+	}
+	free (seq);
+
+	// midi file not compiled: parsed by fluidsynth player
+	if (data != NULL) return fluid_player_add_mem (eng->player, data, size);
+	return fluid_player_add (eng->player, name);
+}
+
+
+// free sequencer of engine, if any; called when engine is deleted
+void player_delete (engine_t *eng)
+{
+	if (eng->seq == NULL) return;
+	delete_fluid_midi_event (eng->seq->midi);
+	song_unmap (eng->seq);
+	free (eng->seq);
+	eng->seq = NULL;
+}
+
+
+// set playback callback, called for each midi event of the song
+int player_set_playback_callback (engine_t *eng, handle_midi_event_func_t callback, void *data)
+{
+	eng->callback = callback;
+	eng->callback_data = data;
+	return fluid_player_set_playback_callback (eng->player, callback, data);
+}
+
+
+// TRUE while count-in is played: song has not started yet; only used by render thread
+int player_is_count_in (engine_t *eng)
+{
+	return (eng != NULL) && (eng->seq != NULL) && (eng->seq->count_in > 0);
+}
+
+
+// set count-in bars played before the song starts, at next play; midi files not compiled yet start without count-in
+int player_count_in (engine_t *eng, int bars)
+{
+	if (eng->seq == NULL) return FLUID_FAILED;
+	__atomic_store_n (&eng->seq->count_bars, bars, __ATOMIC_RELAXED);
+	return FLUID_OK;
+}
+
+
+int player_play (engine_t *eng)
+{
+	if (eng->seq == NULL) return fluid_player_play (eng->player);
+	__atomic_store_n (&eng->seq->status, FLUID_PLAYER_PLAYING, __ATOMIC_RELEASE);
+	return FLUID_OK;
+}
+
+
+// stop player; notes of the song are released by render thread
+int player_stop (engine_t *eng)
+{
+	if (eng->seq == NULL) return fluid_player_stop (eng->player);
+	__atomic_store_n (&eng->seq->status, FLUID_PLAYER_DONE, __ATOMIC_RELEASE);
+	return FLUID_OK;
+}
+
+
+// move to tick; done by render thread at its next step while playing
+int player_seek (engine_t *eng, int tick)
+{
+	if (eng->seq == NULL) return fluid_player_seek (eng->player, tick);
+	if ((tick < 0) || (tick > eng->seq->header->ticks)) return FLUID_FAILED;
+	__atomic_store_n (&eng->seq->seek_to, tick, __ATOMIC_RELEASE);
+	return FLUID_OK;
+}
+
+
+// set number of times the song is played again at its end; -1 for ever
+int player_set_loop (engine_t *eng, int loop)
+{
+	if (eng->seq == NULL) return fluid_player_set_loop (eng->player, loop);
+	__atomic_store_n (&eng->seq->loop, loop, __ATOMIC_RELAXED);
+	return FLUID_OK;
+}
+
+
+int player_get_status (engine_t *eng)
+{
+	if (eng->seq == NULL) return fluid_player_get_status (eng->player);
+	return __atomic_load_n (&eng->seq->status, __ATOMIC_ACQUIRE);
+}
+
+
+int player_get_current_tick (engine_t *eng)
+{
+	int tick;
+
+	if (eng->seq == NULL) return fluid_player_get_current_tick (eng->player);
+	tick = __atomic_load_n (&eng->seq->tick, __ATOMIC_RELAXED);
+	return (tick < 0) ? 0 : tick;
+}
+
+
+int player_get_total_ticks (engine_t *eng)
+{
+	if (eng->seq == NULL) return fluid_player_get_total_ticks (eng->player);
+	return eng->seq->header->ticks;
+}
+
+
+// bar of compiled song at tick
+static uint32_t find_bar (seq_t *seq, int tick)
+{
+	uint32_t low = 0, high = seq->header->nb_bars - 1, mid;
+
+	while (low < high) {
+		mid = (low + high + 1) / 2;
+		if (seq->bar [mid].tick <= (uint32_t) tick) low = mid;
+		else high = mid - 1;
+	}
+	return low;
+}
+
+
+// number of bars of the song; bars of a midi file which is not compiled are given by the first time signature
+int player_get_nb_bars (engine_t *eng)
+{
+	int ticks;
+
+	if (eng->seq != NULL) return eng->seq->header->nb_bars;
+	ticks = player_get_total_ticks (eng);
+	return (ticks > 0) ? (ticks + eng->ticks_per_bar - 1) / eng->ticks_per_bar : 1;
+}
+
+
+// bar at tick (0 for first bar)
+int player_bar_at (engine_t *eng, int tick)
+{
+	if (eng->seq != NULL) return find_bar (eng->seq, tick);
+	return tick / eng->ticks_per_bar;
+}
+
+
+// tick of start of bar (0 for first bar); bar is clamped to the bars of the song
+int player_bar_tick (engine_t *eng, int bar)
+{
+	int nb_bars;
+
+	nb_bars = player_get_nb_bars (eng);
+	if (bar >= nb_bars) bar = nb_bars - 1;
+	if (bar < 0) bar = 0;
+	if (eng->seq != NULL) return eng->seq->bar [bar].tick;
+	return bar * eng->ticks_per_bar;
+}
+
+
+// set loop region from start of bar (0 for first bar), nb bars long, and play it again at its end until it is released
+// region ends at the end of the song at most; bars of a midi file which is not compiled are given by the first time signature
+int player_set_region (engine_t *eng, int bar, int nb)
+{
+	int nb_bars, start, end;
+
+	nb_bars = player_get_nb_bars (eng);
+	if ((bar < 0) || (nb < 1) || ((eng->seq != NULL) && (bar >= nb_bars))) return FLUID_FAILED;
+	start = (eng->seq != NULL) ? eng->seq->bar [bar].tick : bar * eng->ticks_per_bar;
+	if (eng->seq == NULL) end = (bar + nb) * eng->ticks_per_bar;
+	else end = (bar + nb < nb_bars) ? eng->seq->bar [bar + nb].tick : eng->seq->header->ticks;
+	if (end <= start) return FLUID_FAILED;
+
+	__atomic_store_n (&eng->region_state, REGION_OFF, __ATOMIC_RELEASE);
+	__atomic_store_n (&eng->region_start, start, __ATOMIC_RELAXED);
+	__atomic_store_n (&eng->region_end, end, __ATOMIC_RELAXED);
+	__atomic_store_n (&eng->region_state, REGION_ON, __ATOMIC_RELEASE);
+	return FLUID_OK;
+}
+
+
+// release loop region: song plays through at next region end; if is_release is FALSE, release is taken back
+void player_release_region (engine_t *eng, int is_release)
+{
+	int from;
+
+	from = is_release ? REGION_ON : REGION_RELEASE;
+	__atomic_compare_exchange_n (&eng->region_state, &from, is_release ? REGION_RELEASE : REGION_ON, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+
+// state of loop region: REGION_OFF, REGION_ON or REGION_RELEASE
+int player_get_region (engine_t *eng)
+{
+	return __atomic_load_n (&eng->region_state, __ATOMIC_ACQUIRE);
+}
+
+
+// end of loop region reached at tick: returns TRUE if region is played again, FALSE if there is no region or if it has
+// been released (song then plays through); called by render thread
+static int is_region_wrap (engine_t *eng)
+{
+	int state;
+
+	state = __atomic_load_n (&eng->region_state, __ATOMIC_ACQUIRE);
+	if (state == REGION_RELEASE) __atomic_compare_exchange_n (&eng->region_state, &state, REGION_OFF, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	return state == REGION_ON;
+}
+
+
+// loop region of a midi file played by fluidsynth player: player is moved back to region start at the first tick after
+// region end (not frame accurate, as a seek of fluidsynth player); a jump of the player over region end is not a crossing
+// returns TRUE if player has been moved; called by tick callback
+int player_region_tick (engine_t *eng, int tick)
+{
+	int last, end;
+
+	if (eng->seq != NULL) return FALSE;
+	last = eng->region_tick;
+	eng->region_tick = tick;
+	end = __atomic_load_n (&eng->region_end, __ATOMIC_RELAXED);
+	if ((end == 0) || (last >= end) || (tick < end) || (tick - last > eng->ppq)) return FALSE;
+	if (!is_region_wrap (eng)) return FALSE;
+
+	eng->region_tick = __atomic_load_n (&eng->region_start, __ATOMIC_RELAXED);
+	fluid_player_seek (eng->player, eng->region_tick);
+	return TRUE;
+}
+
+
+// tempo played, in microseconds per quarter note
+int player_get_midi_tempo (engine_t *eng)
+{
+	int external;
+
+	if (eng->seq == NULL) return fluid_player_get_midi_tempo (eng->player);
+	external = __atomic_load_n (&eng->seq->external_tempo, __ATOMIC_RELAXED);
+	if (external > 0) return external;
+	return (int) (((int64_t) __atomic_load_n (&eng->seq->file_tempo, __ATOMIC_RELAXED) * 1000) / __atomic_load_n (&eng->seq->multiplier, __ATOMIC_RELAXED));
+}
+
+
+// tempo played, in bpm
+int player_get_bpm (engine_t *eng)
+{
+	int tempo;
+
+	if (eng->seq == NULL) return fluid_player_get_bpm (eng->player);
+	tempo = player_get_midi_tempo (eng);
+	return (tempo > 0) ? 60000000 / tempo : FLUID_FAILED;
+}
+
+
+// set tempo: type is FLUID_PLAYER_TEMPO_INTERNAL (tempo of file, value is a multiplier), FLUID_PLAYER_TEMPO_EXTERNAL_BPM
+// (value in bpm) or FLUID_PLAYER_TEMPO_EXTERNAL_MIDI (value in microseconds per quarter note)
+int player_set_tempo (engine_t *eng, int type, double value)
+{
+	seq_t *seq = eng->seq;
+
+	if (seq == NULL) return fluid_player_set_tempo (eng->player, type, value);
+	if (value <= 0.0) return FLUID_FAILED;
+
+	switch (type) {
+	case FLUID_PLAYER_TEMPO_INTERNAL:
+		__atomic_store_n (&seq->multiplier, (int) lround (value * 1000.0), __ATOMIC_RELAXED);
+		__atomic_store_n (&seq->external_tempo, 0, __ATOMIC_RELAXED);
+		break;
+	case FLUID_PLAYER_TEMPO_EXTERNAL_BPM:
+		__atomic_store_n (&seq->external_tempo, (int) lround (60000000.0 / value), __ATOMIC_RELAXED);
+		break;
+	case FLUID_PLAYER_TEMPO_EXTERNAL_MIDI:
+		__atomic_store_n (&seq->external_tempo, (int) lround (value), __ATOMIC_RELAXED);
+		break;
+	default:
+		return FLUID_FAILED;
+	}
+	return FLUID_OK;
+}
+
+
+// send event of compiled song to playback callback
+static void send_event (engine_t *eng, song_event_t *event)
+{
+	fluid_midi_event_t *midi = eng->seq->midi;
+	song_sysex_t *sysex;
+	int type;
+
+	if (event->status == 0xF0) {
+		sysex = &eng->seq->sysex [event->data [0] | (event->data [1] << 8)];
+		// song split across synths: sysex is sent to all of them
+		if (eng->callback == parts_route) {
+			parts_sysex (eng->seq->sysex_data + sysex->offset, sysex->size);
+			return;
+		}
+		fluid_midi_event_set_sysex (midi, eng->seq->sysex_data + sysex->offset, sysex->size, FALSE);
+	}
+	else {
+		type = event->status & 0xF0;
+		fluid_midi_event_set_type (midi, type);
+		fluid_midi_event_set_channel (midi, event->status & 0x0F);
+		switch (type) {
+		case 0xB0:				// control change
+			fluid_midi_event_set_control (midi, event->data [0]);
+			fluid_midi_event_set_value (midi, event->data [1]);
+			break;
+		case 0xC0:				// program change, channel pressure
+		case 0xD0:
+			fluid_midi_event_set_program (midi, event->data [0]);
+			break;
+		case 0xE0:				// pitch bend
+			fluid_midi_event_set_pitch (midi, event->data [0] | (event->data [1] << 7));
+			break;
+		default:				// note off, note on, key pressure
+			fluid_midi_event_set_key (midi, event->data [0]);
+			fluid_midi_event_set_velocity (midi, event->data [1]);
+			break;
+		}
+	}
+	eng->callback (eng->callback_data, midi);
+}
+
+
+// send a channel message to playback callback
+static void send_channel (engine_t *eng, int status, int data1, int data2)
+{
+	song_event_t event;
+
+	event.tick = 0;
+	event.status = status;
+	event.data [0] = data1;
+	event.data [1] = data2;
+	send_event (eng, &event);
+}
+
+
+// restore state of channels at start of bar, from chase index: controllers are reset, then what the song has set
+// is sent again (bank and program first, RPNs last); channels get GM defaults for what the song has not set yet
+static void restore (engine_t *eng, song_bar_t *bar)
+{
+	song_chase_t *chase;
+	int chan, cc, k, is_rpn;
+
+	for (chan = 0; chan < 16; chan++) {
+		chase = &bar->channel [chan];
+		send_channel (eng, 0xB0 | chan, 121, 0);
+		if ((chase->cc [0] != 0xFF) || (chan != 9)) send_channel (eng, 0xB0 | chan, 0, (chase->cc [0] != 0xFF) ? chase->cc [0] : 0);
+		if ((chase->cc [32] != 0xFF) || (chan != 9)) send_channel (eng, 0xB0 | chan, 32, (chase->cc [32] != 0xFF) ? chase->cc [32] : 0);
+		send_channel (eng, 0xC0 | chan, (chase->program != 0xFF) ? chase->program : 0, 0);
+
+		// volume and pan are not reset by reset all controllers
+		send_channel (eng, 0xB0 | chan, 7, (chase->cc [7] != 0xFF) ? chase->cc [7] : 100);
+		send_channel (eng, 0xB0 | chan, 10, (chase->cc [10] != 0xFF) ? chase->cc [10] : 64);
+		for (cc = 1; cc < 120; cc++) {
+			if ((chase->cc [cc] != 0xFF) && (cc != 7) && (cc != 10) && (cc != 32)) send_channel (eng, 0xB0 | chan, cc, chase->cc [cc]);
+		}
+		if (chase->pressure != 0xFF) send_channel (eng, 0xD0 | chan, chase->pressure, 0);
+		if (chase->pitch [0] != 0xFF) send_channel (eng, 0xE0 | chan, chase->pitch [0], chase->pitch [1]);
+
+		is_rpn = FALSE;
+		for (k = 0; k < 3; k++) {
+			if (chase->rpn [k][0] == 0xFF) continue;
+			send_channel (eng, 0xB0 | chan, 101, 0);
+			send_channel (eng, 0xB0 | chan, 100, k);
+			send_channel (eng, 0xB0 | chan, 6, chase->rpn [k][0]);
+			if (chase->rpn [k][1] != 0xFF) send_channel (eng, 0xB0 | chan, 38, chase->rpn [k][1]);
+			is_rpn = TRUE;
+		}
+		// RPN null: later data entry of the song does not change these RPNs
+		if (is_rpn) {
+			send_channel (eng, 0xB0 | chan, 101, 127);
+			send_channel (eng, 0xB0 | chan, 100, 127);
+		}
+	}
+}
+
+
+// length of a beat of bar, in ticks: a beat is the unit of its time signature (eighth note in 6/8)
+static uint32_t beat_ticks (seq_t *seq, song_bar_t *bar)
+{
+	uint32_t beat;
+
+	beat = ((uint32_t) seq->header->division * 4) >> bar->time_sig [1];
+	return (beat > 0) ? beat : 1;
+}
+
+
+// move click to next beat: next beat of its bar, or first beat of next bar; there is no click after the last bar
+static void next_click (seq_t *seq)
+{
+	song_bar_t *bar = &seq->bar [seq->click_bar];
+	int is_last;
+
+	is_last = (seq->click_bar + 1 >= seq->header->nb_bars);
+	seq->click_beat++;
+	seq->click_tick = bar->tick + seq->click_beat * beat_ticks (seq, bar);
+	if ((seq->click_beat < bar->time_sig [0]) && (is_last || (seq->click_tick < bar [1].tick))) return;
+
+	if (is_last) {
+		seq->click_tick = UINT32_MAX;
+		return;
+	}
+	seq->click_bar++;
+	seq->click_beat = 0;
+	seq->click_tick = bar [1].tick;
+}
+
+
+// move click to the first beat from tick
+static void click_locate (seq_t *seq, int tick)
+{
+	song_bar_t *bar;
+	uint32_t beat;
+
+	seq->click_bar = find_bar (seq, tick);
+	bar = &seq->bar [seq->click_bar];
+	beat = beat_ticks (seq, bar);
+	seq->click_beat = (int) (((uint32_t) tick - bar->tick + beat - 1) / beat) - 1;
+	next_click (seq);
+}
+
+
+// move sequencer to tick: sounds are stopped (notes are released if is_cut is FALSE), state of channels at start of
+// the bar of tick is restored from chase index, then events of the bar before tick but notes are sent again: channels
+// have the programs, controllers, pitch bend and RPNs of this position, whatever the length of the song
+static void locate (engine_t *eng, fluid_synth_t *synth, int tick, int is_cut)
+{
+	seq_t *seq = eng->seq;
+	song_bar_t *bar;
+	uint32_t i;
+
+	parts_all_off (is_cut);
+	bar = &seq->bar [find_bar (seq, tick)];
+	restore (eng, bar);
+	for (i = bar->event; (i < seq->header->nb_events) && (seq->event [i].tick < (uint32_t) tick); i++) {
+		if (((seq->event [i].status & 0xF0) != 0x80) && ((seq->event [i].status & 0xF0) != 0x90)) send_event (eng, &seq->event [i]);
+	}
+	seq->next = i;
+
+	for (i = bar->tempo + 1; (i < seq->header->nb_tempos) && (seq->tempo [i].tick <= (uint32_t) tick); i++);
+	__atomic_store_n (&seq->file_tempo, seq->tempo [i - 1].tempo, __ATOMIC_RELAXED);
+	seq->next_tempo = i;
+
+	seq->pos = (double) tick;
+	seq->is_region_end = FALSE;
+	click_locate (seq, tick);
+	__atomic_store_n (&seq->tick, -1, __ATOMIC_RELAXED);
+}
+
+
+// ticks per frame, at tempo set (pads, fader, beat switch) or at tempo of file; 0 if there is no tempo
+static double ticks_per_frame (seq_t *seq)
+{
+	int tempo, external;
+
+	external = __atomic_load_n (&seq->external_tempo, __ATOMIC_RELAXED);
+	tempo = (external > 0) ? external : (int) (((int64_t) seq->file_tempo * 1000) / __atomic_load_n (&seq->multiplier, __ATOMIC_RELAXED));
+	if (tempo <= 0) return 0.0;
+	return ((double) seq->header->division * 1.0e6) / ((double) sample_rate * (double) tempo);
+}
+
+
+// start count-in: count_bars bars of clicks at tempo and time signature of position played; song starts on the beat after them
+static void count_start (seq_t *seq, int count_bars)
+{
+	song_bar_t *bar;
+	double tpf;
+
+	tpf = ticks_per_frame (seq);
+	if ((count_bars <= 0) || (tpf <= 0.0)) return;
+	bar = &seq->bar [find_bar (seq, (int) seq->pos)];
+	seq->count_num = (bar->time_sig [0] > 0) ? bar->time_sig [0] : 4;
+	seq->count_in = count_bars * seq->count_num + 1;
+	seq->count_total = seq->count_in;
+	seq->count_frames = (double) beat_ticks (seq, bar) / tpf;
+	seq->count_next = 0.0;
+}
+
+
+// step sequencer before rendering len frames, offset frames after the start of the block rendered: events due are sent,
+// beats are clicked at their frame, then position moves by len frames
+// returns the number of frames to render before next step: less than len if loop region ends, or count-in is over, within them
+static int step (engine_t *eng, fluid_synth_t *synth, int offset, int len)
+{
+	seq_t *seq = eng->seq;
+	int tick, seek, end, n, is_start;
+	double tpf, over, limit;
+
+	// player stopped: notes of the song are released, as fluidsynth player does
+	if (__atomic_load_n (&seq->status, __ATOMIC_ACQUIRE) != FLUID_PLAYER_PLAYING) {
+		if (seq->is_running) parts_all_off (FALSE);
+		seq->is_running = FALSE;
+		seq->count_in = 0;
+		return len;
+	}
+	is_start = !seq->is_running;
+	seq->is_running = TRUE;
+
+	seek = __atomic_exchange_n (&seq->seek_to, -1, __ATOMIC_ACQ_REL);
+	if (seek >= 0) locate (eng, synth, seek, TRUE);
+
+	// count-in: a click on each beat, song (events, tick callback and midi clock) starts at the exact frame of the beat after them
+	if (is_start) count_start (seq, __atomic_load_n (&seq->count_bars, __ATOMIC_RELAXED));
+	if (seq->count_in > 0) {
+		while (seq->count_next < (double) len) {
+			n = (int) seq->count_next;
+			if (--seq->count_in == 0) {
+				if (n > 0) return n;
+				break;
+			}
+			click_beat (offset + n, ((seq->count_total - seq->count_in - 1) % seq->count_num) == 0);
+			seq->count_next += seq->count_frames;
+		}
+		if (seq->count_in > 0) {
+			seq->count_next -= (double) len;
+			return len;
+		}
+	}
+
+	// end of loop region: notes are released and region is played again, before events of the next bar are sent
+	// tick callback goes on from region start, so that midi clock keeps running
+	if (seq->is_region_end) {
+		seq->is_region_end = FALSE;
+		if (is_region_wrap (eng)) {
+			over = seq->pos - (double) __atomic_load_n (&eng->region_end, __ATOMIC_RELAXED);
+			locate (eng, synth, __atomic_load_n (&eng->region_start, __ATOMIC_RELAXED), FALSE);
+			seq->pos += over;
+		}
+	}
+
+	// tick callback, each time tick changes
+	tick = (int) seq->pos;
+	if (tick != __atomic_load_n (&seq->tick, __ATOMIC_RELAXED)) {
+		__atomic_store_n (&seq->tick, tick, __ATOMIC_RELAXED);
+		handle_tick ((void *) eng, tick);
+	}
+
+	// tempo changes and events due: linear scan of tempo map and events
+	while ((seq->next_tempo < seq->header->nb_tempos) && (seq->tempo [seq->next_tempo].tick <= (uint32_t) tick)) {
+		__atomic_store_n (&seq->file_tempo, seq->tempo [seq->next_tempo++].tempo, __ATOMIC_RELAXED);
+	}
+	while ((seq->next < seq->header->nb_events) && (seq->event [seq->next].tick <= (uint32_t) tick)) {
+		send_event (eng, &seq->event [seq->next++]);
+	}
+
+	// end of song: song is played again from its start, or player is done
+	if ((seq->next == seq->header->nb_events) && (tick >= seq->header->ticks)) {
+		if (__atomic_load_n (&seq->loop, __ATOMIC_RELAXED) == 0) {
+			__atomic_store_n (&seq->status, FLUID_PLAYER_DONE, __ATOMIC_RELEASE);
+			return len;
+		}
+		if (__atomic_load_n (&seq->loop, __ATOMIC_RELAXED) > 0) __atomic_sub_fetch (&seq->loop, 1, __ATOMIC_RELAXED);
+		parts_all_off (FALSE);
+		seq->pos -= (double) tick;
+		seq->next = 0;
+		seq->next_tempo = 0;
+		click_locate (seq, 0);
+		return len;
+	}
+
+	// position after len frames
+	tpf = ticks_per_frame (seq);
+	if (tpf <= 0.0) return len;
+	limit = seq->pos + (double) len * tpf;
+
+	// loop region ends within len frames: only frames up to region end are rendered, next step wraps
+	end = (__atomic_load_n (&eng->region_state, __ATOMIC_ACQUIRE) != REGION_OFF) ? __atomic_load_n (&eng->region_end, __ATOMIC_RELAXED) : 0;
+	if ((seq->pos < (double) end) && (limit >= (double) end)) {
+		len = (int) ceil (((double) end - seq->pos) / tpf);
+		if (len < 1) len = 1;
+		limit = (double) end;
+		seq->is_region_end = TRUE;
+	}
+
+	// beats reached within len frames are clicked at their frame
+	while ((double) seq->click_tick < limit) {
+		n = (int) ceil (((double) seq->click_tick - seq->pos) / tpf);
+		click_beat (offset + ((n > 0) ? n : 0), seq->click_beat == 0);
+		next_click (seq);
+	}
+
+	seq->pos += (double) len * tpf;
+	if (seq->is_region_end && (seq->pos < (double) end)) seq->pos = (double) end;
+	return len;
+}
+
+
+// render len frames of synth, stepping sequencer of engine every SONG_BLOCK frames, at the end of loop region and of count-in
+// called by render thread; parts (if any) are started, and are mixed by caller (see parts_mix ())
+// same as fluid_synth_process () if song of engine is played by fluidsynth player
+int player_render (engine_t *eng, fluid_synth_t *synth, int len, int nfx, float *fx [], int nout, float *out [])
+{
+	float *block_fx [nfx + 1], *block_out [nout + 1];
+	int done, n, i, result = FLUID_OK;
+
+	// fluidsynth player sends events of the block while main synth renders it: parts render it afterwards
+	if ((eng == NULL) || (eng->seq == NULL)) {
+		parts_begin (FALSE);
+		result = fluid_synth_process (synth, len, nfx, fx, nout, out);
+		parts_start (len);
+		return result;
+	}
+
+	// song split across synths: the whole block is sequenced first, so that parts render it while main synth does
+	if (nb_parts > 1) {
+		parts_begin (TRUE);
+		for (done = 0; done < len; done += n) {
+			n = (len - done < SONG_BLOCK) ? len - done : SONG_BLOCK;
+			parts_at (done);
+			n = step (eng, synth, done, n);
+		}
+		parts_start (len);
+		return parts_render (0, synth, len, nfx, fx, nout, out);
+	}
+
+	for (done = 0; done < len; done += n) {
+		n = (len - done < SONG_BLOCK) ? len - done : SONG_BLOCK;
+		n = step (eng, synth, done, n);
+		for (i = 0; i < nfx; i++) block_fx [i] = fx [i] + done;
+		for (i = 0; i < nout; i++) block_out [i] = out [i] + done;
+		if (fluid_synth_process (synth, n, nfx, block_fx, nout, block_out) != FLUID_OK) result = FLUID_FAILED;
+	}
+	return result;
+}
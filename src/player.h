@@ -0,0 +1,29 @@
+/** @file player.h
+ *
+ * @brief This file defines prototypes of functions inside player.c
+ *
+ */
+
+int player_load (engine_t *, char *, void *, size_t);
+void player_delete (engine_t *);
+int player_set_playback_callback (engine_t *, handle_midi_event_func_t, void *);
+int player_is_count_in (engine_t *);
+int player_count_in (engine_t *, int);
+int player_play (engine_t *);
+int player_stop (engine_t *);
+int player_seek (engine_t *, int);
+int player_set_loop (engine_t *, int);
+int player_get_status (engine_t *);
+int player_get_current_tick (engine_t *);
+int player_get_total_ticks (engine_t *);
+int player_get_nb_bars (engine_t *);
+int player_bar_at (engine_t *, int);
+int player_bar_tick (engine_t *, int);
+int player_set_region (engine_t *, int, int);
+void player_release_region (engine_t *, int);
+int player_get_region (engine_t *);
+int player_region_tick (engine_t *, int);
+int player_get_midi_tempo (engine_t *);
+int player_get_bpm (engine_t *);
+int player_set_tempo (engine_t *, int, double);
+int player_render (engine_t *, fluid_synth_t *, int, int, float *[], int, float *[]);
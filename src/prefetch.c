@@ -0,0 +1,159 @@
+/** @file prefetch.c
+ *
+ * @brief Background loader: while a song is played, the files of the next song of the setlist (midi file
+ * and SF2 file) are read in memory by a loader thread, so that loading next song does not wait for the SD card.
+ * Files are mapped in memory, and their pages populated; main thread takes the mapping of a file when it loads it.
+ *
+ */
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "globals.h"
+#include "prefetch.h"
+#include "utils.h"
+#include "rt.h"
+#include "catalog.h"
+
+
+// files prefetched: midi file and SF2 file
+static prefetch_t file [NB_NAMES];
+
+// request to loader thread: numbers of files to prefetch, and their banks
+static int request [NB_NAMES];
+static int request_bank [NB_NAMES];
+static int is_request = FALSE;
+
+// protection of files and request, shared between main thread and loader thread
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t requested = PTHREAD_COND_INITIALIZER;
+
+// map whole file in memory, and read all its pages; returns NULL if file can't be read
+static void *map_file (char *name, size_t *size)
+{
+	int fd;
+	struct stat st;
+	void *data;
+
+	if ((fd = open (name, O_RDONLY)) < 0) return NULL;
+	if ((fstat (fd, &st) < 0) || (st.st_size == 0)) {
+		close (fd);
+		return NULL;
+	}
+
+	data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close (fd);
+	if (data == MAP_FAILED) return NULL;
+
+	*size = st.st_size;
+	return data;
+}
+
+
+// loader thread: prefetch files requested by main thread
+static void *prefetch_thread (void *arg)
+{
+	int number [NB_NAMES];
+	int bank [NB_NAMES];
+	char name [PATH_LEN];
+	prefetch_t new, old;
+	int i;
+
+	rt_setup_thread (RT_LOADER);
+
+	while (1) {
+		// wait for a request
+		pthread_mutex_lock (&lock);
+		while (!is_request) pthread_cond_wait (&requested, &lock);
+		memcpy (number, request, sizeof (number));
+		memcpy (bank, request_bank, sizeof (bank));
+		is_request = FALSE;
+		pthread_mutex_unlock (&lock);
+
+		for (i = 0; i < NB_NAMES; i++) {
+			if (catalog_lookup (i, bank [i], (unsigned char) number [i], name, NULL) == FALSE) continue;
+
+			// file is already in memory
+			pthread_mutex_lock (&lock);
+			if (!strcmp (file [i].name, name)) {
+				pthread_mutex_unlock (&lock);
+				continue;
+			}
+			pthread_mutex_unlock (&lock);
+
+			// read file, without holding the lock: main thread may load other files meanwhile
+			memset (&new, 0, sizeof (prefetch_t));
+			new.data = map_file (name, &new.size);
+			if (new.data == NULL) {
+				fprintf ( stderr, "Unable to prefetch %s.\n", name );
+				continue;
+			}
+			strcpy (new.name, name);
+
+			// replace previous file
+			pthread_mutex_lock (&lock);
+			old = file [i];
+			file [i] = new;
+			pthread_mutex_unlock (&lock);
+			if (old.data != NULL) munmap (old.data, old.size);
+		}
+	}
+
+	return NULL;
+}
+
+
+// start loader thread
+int prefetch_start ()
+{
+	pthread_t thread;
+
+	if (pthread_create (&thread, NULL, prefetch_thread, NULL) != 0) {
+		fprintf ( stderr, "Unable to start loader thread.\n" );
+		return EXIT_FAILURE;
+	}
+	pthread_detach (thread);
+	return EXIT_SUCCESS;
+}
+
+
+// ask loader thread to prefetch midi file song of bank, and SF2 file soundfont of sf_bank; this does not wait
+void prefetch_request (int bank, int song, int sf_bank, int soundfont)
+{
+	pthread_mutex_lock (&lock);
+	request_bank [0] = bank;
+	request_bank [1] = sf_bank;
+	request [0] = song;
+	request [1] = soundfont;
+	is_request = TRUE;
+	pthread_cond_signal (&requested);
+	pthread_mutex_unlock (&lock);
+}
+
+
+// take file name of kind (0 for midi file, 1 for SF2 file) if it has been prefetched; returns FALSE if not
+// file is then owned by caller, who keeps it in memory while loading, and frees it with prefetch_free ()
+int prefetch_take (int kind, char *name, prefetch_t *taken)
+{
+	int found = FALSE;
+
+	pthread_mutex_lock (&lock);
+	if ((file [kind].data != NULL) && !strcmp (file [kind].name, name)) {
+		*taken = file [kind];
+		memset (&file [kind], 0, sizeof (prefetch_t));
+		found = TRUE;
+	}
+	pthread_mutex_unlock (&lock);
+
+	return found;
+}
+
+
+// free a file taken with prefetch_take ()
+void prefetch_free (prefetch_t *taken)
+{
+	if (taken->data != NULL) munmap (taken->data, taken->size);
+	memset (taken, 0, sizeof (prefetch_t));
+}
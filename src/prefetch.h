@@ -0,0 +1,10 @@
+/** @file prefetch.h
+ *
+ * @brief This file defines prototypes of functions inside prefetch.c
+ *
+ */
+
+int prefetch_start ();
+void prefetch_request (int, int, int, int);
+int prefetch_take (int, char *, prefetch_t *);
+void prefetch_free (prefetch_t *);
@@ -0,0 +1,482 @@
+/** @file prerender.c
+ *
+ * @brief Pre-rendered audio of heavy songs: songs which peak polyphony is too high to be rendered live are rendered
+ * with their soundfont to an audio file in cache directory by a background job, when they are loaded. Next time the song
+ * is loaded, it is played from this file: the player still runs (clock, beat, tick callback) but sends no event to synth,
+ * and a streamer thread reads the file ahead in a lock-free ring buffer. Render thread time-stretches the audio to follow
+ * the position of the player, through an index giving the frame of each tick: tempo pads, tap tempo, tempo fader and seek
+ * are followed, while cost of rendering is almost constant.
+ * Audio file is named after song and soundfont, their size and time of last modification, and sample rate: a song is
+ * rendered again if any of them changes. Soundfont changed while playing only applies to a cached song once stopped.
+ *
+ */
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "globals.h"
+#include "prerender.h"
+#include "stretch.h"
+#include "metadata.h"
+#include "utils.h"
+#include "rt.h"
+
+
+// rendering job requested to background thread
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t requested = PTHREAD_COND_INITIALIZER;
+static char request_song [PATH_LEN], request_sf2 [PATH_LEN], request_file [PATH_LEN], request_dir [PATH_LEN];
+static char rendering_file [PATH_LEN];
+static int is_request = FALSE;
+
+// file streamed (main thread and streamer thread, with lock held), and its index (read by render thread while stream is active)
+// streamer thread sleeps on stream_changed while no file is streamed
+static int fd = -1;
+static pthread_cond_t stream_changed = PTHREAD_COND_INITIALIZER;
+static prerender_header_t header;
+static int64_t *frame_index;
+
+// ring of frames read ahead: frames [ring_start, ring_end) of file; start is moved by render thread, end by streamer thread
+// a seek is requested by render thread, and done by streamer thread which then empties ring at seek_to
+static int16_t ring [PRERENDER_RING][2];
+static int64_t ring_start, ring_end;
+static int64_t seek_to = -1;
+
+// stream is played by render thread while active; in_use is set by render thread while it uses stream
+static int is_active = FALSE;
+static int in_use = FALSE;
+
+// time-stretch, and speed of the song measured by render thread
+static stretch_t stretch;
+static double ratio;
+static int64_t last_target;
+
+// last tick of player (tick callback to render thread), and blocks not played in time since last report
+static int tick_now;
+static int nb_underruns;
+
+// job rendering a song: frames rendered, and frame of every step ticks
+typedef struct {
+	int64_t frames;
+	int step;
+	int64_t *index;
+	int64_t nb_index;
+	int64_t size;
+	int is_failed;
+} job_t;
+
+
+// get name of cached audio file of song with soundfont sf2, in directory dir; returns FALSE if song or soundfont does not exist
+static int cache_name (char *dir, char *song, char *sf2, char *file)
+{
+	struct stat st_song, st_sf2;
+	char key [3 * PATH_LEN];
+
+	if ((song [0] == 0) || (stat (song, &st_song) < 0) || (stat (sf2, &st_sf2) < 0)) return FALSE;
+	snprintf (key, sizeof (key), "%s|%lld|%lld.%09ld|%s|%lld|%lld.%09ld|%d", song, (long long) st_song.st_size,
+		(long long) st_song.st_mtim.tv_sec, st_song.st_mtim.tv_nsec, sf2, (long long) st_sf2.st_size,
+		(long long) st_sf2.st_mtim.tv_sec, st_sf2.st_mtim.tv_nsec, sample_rate);
+	snprintf (file, PATH_LEN, "%s%016llx.pcm", dir, (unsigned long long) hash_string (key));
+	return TRUE;
+}
+
+
+// player tick callback of rendering job: frame of each step ticks is recorded in index
+static int record_tick (void *data, int tick)
+{
+	job_t *job = data;
+	int64_t *bigger;
+
+	while (!job->is_failed && (job->nb_index * job->step <= tick)) {
+		if (job->nb_index == job->size) {
+			bigger = realloc (job->index, (job->size + 4096) * sizeof (int64_t));
+			if (bigger == NULL) {
+				job->is_failed = TRUE;
+				break;
+			}
+			job->index = bigger;
+			job->size += 4096;
+		}
+		job->index [job->nb_index++] = job->frames;
+	}
+	return FLUID_OK;
+}
+
+
+// render song with soundfont sf2 (on top of default soundfont, as when played live) to audio file
+// file is written in a temporary file, synced, then renamed: a file in cache is always complete
+static int render (char *song, char *sf2, char *file)
+{
+	fluid_settings_t *set;
+	fluid_synth_t *syn;
+	fluid_player_t *player;
+	job_t job;
+	prerender_header_t head;
+	int16_t buf [64][2];
+	char tmp [PATH_LEN];
+	FILE *f;
+	int64_t tail;
+	int result = EXIT_FAILURE;
+
+	memset (&job, 0, sizeof (job_t));
+	job.step = get_division (song) / 8;
+	if (job.step < 1) job.step = 1;
+
+	// synth rendering as fast as it can: player is timed by samples rendered, not by system clock
+	set = new_fluid_settings ();
+	fluid_settings_setnum (set, "synth.sample-rate", (double) sample_rate);
+	fluid_settings_setnum (set, "synth.gain", PRERENDER_GAIN);
+	fluid_settings_setint (set, "synth.polyphony", 2 * DEFAULT_MAX_POLYPHONY);
+	fluid_settings_setint (set, "synth.lock-memory", 0);
+	fluid_settings_setstr (set, "player.timing-source", "sample");
+	syn = new_fluid_synth (set);
+	if (syn == NULL) {
+		delete_fluid_settings (set);
+		return EXIT_FAILURE;
+	}
+	fluid_synth_set_interp_method (syn, -1, FLUID_INTERP_HIGHEST);
+	if (fluid_is_soundfont (DEFAULT_SF2)) fluid_synth_sfload (syn, DEFAULT_SF2, TRUE);
+	if (strcmp (sf2, DEFAULT_SF2)) fluid_synth_sfload (syn, sf2, TRUE);
+
+	player = new_fluid_player (syn);
+	snprintf (tmp, PATH_LEN, "%s.tmp", file);
+	if ((player != NULL) && ((f = fopen (tmp, "wb")) != NULL)) {
+		fluid_player_set_tick_callback (player, record_tick, &job);
+		fluid_player_add (player, song);
+		fluid_player_play (player);
+
+		// frames, after room for header; rendering goes on after end of song for releases and reverb
+		memset (&head, 0, sizeof (head));
+		job.is_failed = (fwrite (&head, sizeof (head), 1, f) != 1);
+		tail = (int64_t) PRERENDER_TAIL_S * sample_rate;
+		while (!job.is_failed && (tail > 0)) {
+			fluid_synth_write_s16 (syn, 64, buf, 0, 2, buf, 1, 2);
+			if (fwrite (buf, sizeof (buf), 1, f) != 1) job.is_failed = TRUE;
+			job.frames += 64;
+			if (fluid_player_get_status (player) != FLUID_PLAYER_PLAYING) tail -= 64;
+		}
+
+		// index, then header
+		head.magic = PRERENDER_MAGIC;
+		head.version = PRERENDER_VERSION;
+		head.sample_rate = sample_rate;
+		head.index_step = job.step;
+		head.nb_frames = job.frames;
+		head.nb_index = job.nb_index;
+		if (!job.is_failed && ((job.nb_index == 0) || (fwrite (job.index, sizeof (int64_t), job.nb_index, f) == job.nb_index)) &&
+			(fseek (f, 0, SEEK_SET) == 0) && (fwrite (&head, sizeof (head), 1, f) == 1) && (fflush (f) == 0) && (fsync (fileno (f)) == 0)) result = EXIT_SUCCESS;
+		if (fclose (f) != 0) result = EXIT_FAILURE;
+
+		if ((result == EXIT_FAILURE) || (rename (tmp, file) < 0)) {
+			unlink (tmp);
+			result = EXIT_FAILURE;
+		}
+	}
+
+	if (player != NULL) delete_fluid_player (player);
+	delete_fluid_synth (syn);
+	delete_fluid_settings (set);
+	free (job.index);
+	return result;
+}
+
+
+// background thread rendering songs, when requested by main thread
+// cache directory comes with the request: mapping may be freed by a reload of config file while rendering
+static void *render_thread (void *arg)
+{
+	char song [PATH_LEN], sf2 [PATH_LEN], file [PATH_LEN], dir [PATH_LEN];
+	uint64_t start;
+
+	rt_setup_thread (RT_LOADER);
+
+	while (1) {
+		pthread_mutex_lock (&lock);
+		while (!is_request) pthread_cond_wait (&requested, &lock);
+		is_request = FALSE;
+		strcpy (song, request_song);
+		strcpy (sf2, request_sf2);
+		strcpy (file, request_file);
+		strcpy (dir, request_dir);
+		strcpy (rendering_file, file);
+		pthread_mutex_unlock (&lock);
+
+		start = micros ();
+		mkdir (dir, 0755);
+		if (render (song, sf2, file) == EXIT_SUCCESS) fprintf ( stderr, "prerender: %s rendered in %llu s.\n", song, (unsigned long long) ((micros () - start) / 1000000) );
+		else fprintf ( stderr, "prerender: unable to render %s in %s.\n", song, file );
+
+		pthread_mutex_lock (&lock);
+		rendering_file [0] = 0;
+		pthread_mutex_unlock (&lock);
+	}
+
+	return NULL;
+}
+
+
+// read frames of stream ahead in ring; called by streamer thread with lock held
+static void fill ()
+{
+	int16_t chunk [PRERENDER_CHUNK][2];
+	int64_t start, end, seek;
+	ssize_t got;
+	int i, n;
+
+	// seek requested by render thread: ring restarts at seek_to
+	seek = __atomic_load_n (&seek_to, __ATOMIC_ACQUIRE);
+	if (seek >= 0) {
+		__atomic_store_n (&ring_start, seek, __ATOMIC_RELAXED);
+		__atomic_store_n (&ring_end, seek, __ATOMIC_RELAXED);
+		__atomic_store_n (&seek_to, -1, __ATOMIC_RELEASE);
+	}
+
+	end = ring_end;
+	start = __atomic_load_n (&ring_start, __ATOMIC_ACQUIRE);
+	while ((end - start + PRERENDER_CHUNK <= PRERENDER_RING) && (end < header.nb_frames + PRERENDER_RING)) {
+		// frames after end of file are silent
+		memset (chunk, 0, sizeof (chunk));
+		if (end < header.nb_frames) {
+			n = (header.nb_frames - end < PRERENDER_CHUNK) ? (int) (header.nb_frames - end) : PRERENDER_CHUNK;
+			got = pread (fd, chunk, (size_t) n * sizeof (chunk [0]), sizeof (prerender_header_t) + end * sizeof (chunk [0]));
+			if (got < 0) break;
+		}
+		for (i = 0; i < PRERENDER_CHUNK; i++) {
+			ring [(end + i) & (PRERENDER_RING - 1)][0] = chunk [i][0];
+			ring [(end + i) & (PRERENDER_RING - 1)][1] = chunk [i][1];
+		}
+		end += PRERENDER_CHUNK;
+		__atomic_store_n (&ring_end, end, __ATOMIC_RELEASE);
+		start = __atomic_load_n (&ring_start, __ATOMIC_ACQUIRE);
+	}
+}
+
+
+// streamer thread: keep ring filled ahead of render thread while a file is streamed, sleep otherwise
+static void *stream_thread (void *arg)
+{
+	struct timespec period = { 0, PRERENDER_POLL_MS * 1000000 };
+
+	rt_setup_thread (RT_LOADER);
+
+	pthread_mutex_lock (&lock);
+	while (1) {
+		while (fd < 0) pthread_cond_wait (&stream_changed, &lock);
+		fill ();
+		pthread_mutex_unlock (&lock);
+		nanosleep (&period, NULL);
+		pthread_mutex_lock (&lock);
+	}
+
+	return NULL;
+}
+
+
+// read n frames of stream from frame, as float; called by time-stretch in render thread
+// returns FALSE if frames are not in ring (yet)
+static int ring_read (int64_t frame, int n, float *left, float *right)
+{
+	int i;
+
+	if (__atomic_load_n (&seek_to, __ATOMIC_ACQUIRE) >= 0) return FALSE;
+	if ((frame < __atomic_load_n (&ring_start, __ATOMIC_RELAXED)) || (frame + n > __atomic_load_n (&ring_end, __ATOMIC_ACQUIRE))) return FALSE;
+
+	for (i = 0; i < n; i++) {
+		left [i] = (float) ring [(frame + i) & (PRERENDER_RING - 1)][0] * (1.0f / 32768.0f);
+		right [i] = (float) ring [(frame + i) & (PRERENDER_RING - 1)][1] * (1.0f / 32768.0f);
+	}
+	return TRUE;
+}
+
+
+// frame of song at tick, from index
+static int64_t frame_at (int tick)
+{
+	int64_t i, last;
+
+	if (header.nb_index == 0) return 0;
+	i = tick / header.index_step;
+	last = header.nb_index - 1;
+	if ((i < last) && (i >= 0)) {
+		return frame_index [i] + ((frame_index [i + 1] - frame_index [i]) * (tick - i * header.index_step)) / header.index_step;
+	}
+	// after last tick of index: at the speed of the end of the song
+	if (last == 0) return frame_index [0];
+	return frame_index [last] + ((frame_index [last] - frame_index [last - 1]) * (tick - last * header.index_step)) / header.index_step;
+}
+
+
+// play stream of cached song, following the position of the player; called by render thread, after synth has rendered
+// the block (player has then reached the block); stream is added to the first pair of outputs
+void prerender_process (int len, int nout, float *out [])
+{
+	int64_t target, start, oldest;
+	double error, speed;
+
+	__atomic_store_n (&in_use, TRUE, __ATOMIC_SEQ_CST);
+	if ((nout < 2) || !__atomic_load_n (&is_active, __ATOMIC_SEQ_CST) || !__atomic_load_n (&is_play, __ATOMIC_RELAXED)) {
+		__atomic_store_n (&in_use, FALSE, __ATOMIC_RELEASE);
+		return;
+	}
+
+	// speed of the song: frames of song played by player in this block, smoothed over a few blocks
+	target = frame_at (__atomic_load_n (&tick_now, __ATOMIC_RELAXED));
+	if ((last_target >= 0) && (target >= last_target) && (target - last_target < 8 * len)) {
+		ratio += 0.1 * ((double) (target - last_target) / (double) len - ratio);
+	}
+	last_target = target;
+
+	// time-stretch is kept on position of player (one hop ahead: frames of a hop are output after the segment is read)
+	// a position too far (seek, loop) is jumped to: stream is silent until it is read from there
+	error = (double) target + ratio * STRETCH_HOP - stretch.pos;
+	if (fabs (error) > (double) sample_rate / 4.0) {
+		stretch_reset (&stretch, (double) target + ratio * STRETCH_HOP);
+		start = (int64_t) stretch.pos - STRETCH_SEEK;
+		__atomic_store_n (&seek_to, (start < 0) ? 0 : start, __ATOMIC_RELEASE);
+		__atomic_store_n (&in_use, FALSE, __ATOMIC_RELEASE);
+		return;
+	}
+	speed = ratio + error / (4.0 * STRETCH_FRAME);
+	if (speed < 0.25) speed = 0.25;
+	if (speed > 4.0) speed = 4.0;
+
+	if (!stretch_process (&stretch, speed, len, out [0], out [1], gain / PRERENDER_GAIN, ring_read)) __atomic_add_fetch (&nb_underruns, 1, __ATOMIC_RELAXED);
+
+	// frames time-stretch will not read any more are given back to streamer
+	oldest = stretch_oldest (&stretch);
+	if ((__atomic_load_n (&seek_to, __ATOMIC_ACQUIRE) < 0) && (oldest > ring_start) && (oldest <= __atomic_load_n (&ring_end, __ATOMIC_ACQUIRE))) {
+		__atomic_store_n (&ring_start, oldest, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n (&in_use, FALSE, __ATOMIC_RELEASE);
+}
+
+
+// tick of player; called by tick callback, in render thread
+void prerender_tick (int tick)
+{
+	__atomic_store_n (&tick_now, tick, __ATOMIC_RELAXED);
+}
+
+
+// player callback for each midi event of a cached song: events are not sent to synth, audio is played from cache
+int prerender_mute (void *data, fluid_midi_event_t *event)
+{
+	return FLUID_OK;
+}
+
+
+// stop playing stream; called by main thread: render thread does not use stream any more once this returns
+static void stop ()
+{
+	__atomic_store_n (&is_active, FALSE, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n (&in_use, __ATOMIC_SEQ_CST)) usleep (1000);
+
+	pthread_mutex_lock (&lock);
+	if (fd >= 0) close (fd);
+	fd = -1;
+	free (frame_index);
+	frame_index = NULL;
+	pthread_cond_signal (&stream_changed);
+	pthread_mutex_unlock (&lock);
+}
+
+
+// open cached audio file of song; returns FALSE if there is none, or if it can't be used
+static int open_stream (char *file)
+{
+	prerender_header_t head;
+	int64_t *idx;
+	int f;
+
+	if ((f = open (file, O_RDONLY)) < 0) return FALSE;
+	if ((pread (f, &head, sizeof (head), 0) != sizeof (head)) || (head.magic != PRERENDER_MAGIC) || (head.version != PRERENDER_VERSION) ||
+		(head.sample_rate != sample_rate) || (head.index_step < 1) || (head.nb_index < 0)) {
+		close (f);
+		return FALSE;
+	}
+	idx = malloc ((head.nb_index + 1) * sizeof (int64_t));
+	if ((idx == NULL) || (pread (f, idx, head.nb_index * sizeof (int64_t), sizeof (head) + head.nb_frames * 2 * sizeof (int16_t)) != head.nb_index * sizeof (int64_t))) {
+		free (idx);
+		close (f);
+		return FALSE;
+	}
+	// prefetch start of audio in page cache
+	posix_fadvise (f, sizeof (head), (off_t) PRERENDER_RING * 2 * sizeof (int16_t), POSIX_FADV_WILLNEED);
+
+	pthread_mutex_lock (&lock);
+	fd = f;
+	header = head;
+	frame_index = idx;
+	pthread_cond_signal (&stream_changed);
+	pthread_mutex_unlock (&lock);
+	return TRUE;
+}
+
+
+// play song with soundfont sf2 from cache, if it has been rendered; called by main thread when player is stopped
+// a heavy song which is not in cache yet is rendered in background, for next time; returns TRUE if song is played from cache
+int prerender_play (char *song, char *sf2)
+{
+	char file [PATH_LEN];
+	metadata_t md;
+
+	stop ();
+	if ((mapping->prerender_polyphony <= 0) || !cache_name (mapping->prerender_dir, song, sf2, file)) return FALSE;
+
+	if (open_stream (file)) {
+		stretch_reset (&stretch, 0.0);
+		ratio = 1.0;
+		last_target = -1;
+		tick_now = 0;
+		__atomic_store_n (&seek_to, 0, __ATOMIC_RELEASE);
+		__atomic_store_n (&is_active, TRUE, __ATOMIC_SEQ_CST);
+		fprintf ( stderr, "prerender: %s played from %s.\n", song, file );
+		return TRUE;
+	}
+
+	// heavy song: render it in background, unless it is being rendered
+	if (metadata_get (song, &md) && (md.peak_polyphony >= mapping->prerender_polyphony)) {
+		pthread_mutex_lock (&lock);
+		if (strcmp (rendering_file, file)) {
+			strcpy (request_song, song);
+			strcpy (request_sf2, sf2);
+			strcpy (request_file, file);
+			strcpy (request_dir, mapping->prerender_dir);
+			is_request = TRUE;
+			pthread_cond_signal (&requested);
+		}
+		pthread_mutex_unlock (&lock);
+	}
+	return FALSE;
+}
+
+
+// start background rendering thread and streamer thread
+int prerender_start ()
+{
+	pthread_t thread;
+
+	if (pthread_create (&thread, NULL, render_thread, NULL) != 0) {
+		fprintf ( stderr, "Unable to start prerender thread.\n" );
+		return EXIT_FAILURE;
+	}
+	pthread_detach (thread);
+	if (pthread_create (&thread, NULL, stream_thread, NULL) != 0) {
+		fprintf ( stderr, "Unable to start streamer thread.\n" );
+		return EXIT_FAILURE;
+	}
+	pthread_detach (thread);
+	return EXIT_SUCCESS;
+}
+
+
+// report blocks of cached songs not played in time since last report; called by main thread periodically
+void prerender_report ()
+{
+	int underruns;
+
+	underruns = __atomic_exchange_n (&nb_underruns, 0, __ATOMIC_RELAXED);
+	if (underruns > 0) fprintf ( stderr, "prerender: %d block(s) of cached audio not read in time.\n", underruns );
+}
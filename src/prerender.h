@@ -0,0 +1,12 @@
+/** @file prerender.h
+ *
+ * @brief This file defines prototypes of functions inside prerender.c
+ *
+ */
+
+int prerender_start ();
+int prerender_play (char *, char *);
+int prerender_mute (void *, fluid_midi_event_t *);
+void prerender_tick (int);
+void prerender_process (int, int, float *[]);
+void prerender_report ();
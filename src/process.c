@@ -11,12 +11,29 @@
 #include "process.h"
 #include "utils.h"
 #include "led.h"
+#include "control.h"
+#include "rt.h"
+#include "engine.h"
+#include "governor.h"
+#include "parts.h"
+#include "prerender.h"
+#include "player.h"
+#include "click.h"
 
 
 // number of midi clock signal sent per quarter note; from 0 to 23
 int midi_clock_num;
 // previous index pulse: used to see whether we changed quarter note (beat)
 int previous_index_pulse;
+// engine (player...) used during the whole process cycle; engine global may be swapped by main thread meanwhile
+static engine_t *eng;
+// realtime setup of the threads of process callback and of fluidsynth render is done at their first cycle
+static int is_setup = FALSE;
+static int is_render_setup = FALSE;
+// tick at which soundfont swap has been seen by tick callback; swap is done at next beat or bar after it
+static int swap_from = -1;
+// position where next PLAY starts: set by a seek while stopped, start of song otherwise
+static int cue_tick = 0;
 
 
 // main process callback called at capture of (nframes) frames/samples
@@ -25,12 +42,26 @@ int process ( jack_nframes_t nframes, void *arg )
 	jack_nframes_t h;
 	int i,j,k;
 	int mute = OFF;
-	void *midiin;
+	void *midiin [MAX_SURFACES];
 	void *midiout;
 	void *clockout;
-	jack_midi_event_t in_event;
-	jack_midi_data_t buffer[5];				// midi out buffer for lighting the pad leds and for midi clock
-	int dest, row, col, on_off;				// variables used to manage lighting of the pad leds
+	jack_midi_event_t in_event [MAX_SURFACES];
+	uint32_t nb_events [MAX_SURFACES];
+	uint32_t next_event [MAX_SURFACES];
+	int s, first;
+	mapping_t *map;
+	jack_midi_data_t buffer[5];				// midi out buffer for midi clock
+	command_t command;
+
+
+	// first cycle: pin thread to its core, and lock its stack
+	if (!is_setup) {
+		rt_setup_thread (RT_PROCESS);
+		is_setup = TRUE;
+	}
+
+	// get engine to be used for the whole cycle; it can't be freed before the end of the cycle
+	eng = __atomic_load_n (&engine, __ATOMIC_ACQUIRE);
 
 
 	/*****************************************************************************/
@@ -43,19 +74,60 @@ int process ( jack_nframes_t nframes, void *arg )
 	/* First, process MIDI in (UI) events */
 	/**************************************/
 
-	// Get midi clock midi out and midi in buffers
-	midiin = jack_port_get_buffer(midi_input_port, nframes);
+	// get mapping to be used for the whole cycle; mapping may be swapped by main thread when config file is reloaded
+	map = __atomic_load_n (&mapping, __ATOMIC_ACQUIRE);
+
+	// Get midi in buffers of all surfaces, and first midi in event of each surface
+	for (s = 0; s < map->nb_surfaces; s++) {
+		midiin[s] = jack_port_get_buffer(map->surface[s].input_port, nframes);
+		nb_events[s] = jack_midi_get_event_count(midiin[s]);
+		next_event[s] = 0;
+	}
 
-	// process MIDI IN events
-	for (i=0; i< jack_midi_get_event_count(midiin); i++) {
-		if (jack_midi_event_get (&in_event, midiin, i) != 0) {
-			fprintf ( stderr, "Missed in event\n" );
-			continue;
+	// process MIDI IN events of all surfaces, merged in timestamp order
+	while (1) {
+		// look for the surface which has the earliest midi in event
+		first = -1;
+		for (s = 0; s < map->nb_surfaces; s++) {
+			// get first event of the surface not processed yet; skip the events that can't be read
+			while (next_event[s] < nb_events[s]) {
+				if (jack_midi_event_get (&in_event[s], midiin[s], next_event[s]) == 0) break;
+				fprintf ( stderr, "Missed in event\n" );
+				next_event[s]++;
+			}
+			if (next_event[s] >= nb_events[s]) continue;
+			if ((first == -1) || (in_event[s].time < in_event[first].time)) first = s;
 		}
-		// call processing function
-		midi_in_process (&in_event,nframes);
+
+		// no more events to process
+		if (first == -1) break;
+
+		// call processing function, and move to next event of the surface
+		midi_in_process (&map->surface[first], &in_event[first]);
+		next_event[first]++;
+	}
+
+	// process commands received by control endpoint, the same way as functions of surfaces
+	while (command_pull (&command)) function_process (command.dest, command.row, command.col, command.value);
+
+	// apply volume and tempo changes requested by pads and faders
+	smooth_process (nframes);
+
+	// make state available to control endpoint
+	state_publish (eng);
+
+	// led of loop pad: on while looping, pending while a bar is punched in or loop is released (until region end)
+	if (eng != NULL) {
+		i = player_get_region (eng);
+		led_filefunct (0, LOOP, (i == REGION_ON) ? ON : (((i == REGION_RELEASE) || (eng->punch_bar >= 0)) ? PENDING : OFF));
 	}
 
+	// led of bank pad: on while a bank other than 0 is selected
+	led_filefunct (0, BANK, ((song_bank != 0) || (sf2_bank != 0)) ? ON : OFF);
+
+	// metronome click on its own audio port
+	click_process (nframes, map->click_level);
+
 
 	/*****************************************/
 	/* Second, process MIDI CLOCK out events */
@@ -89,42 +161,68 @@ int process ( jack_nframes_t nframes, void *arg )
 	/* Third, process MIDI out (UI) events */
 	/***************************************/
 
-	// define midi out port to write to
-	midiout = jack_port_get_buffer (midi_output_port, nframes);
-
-	// clear midi write buffer
-	jack_midi_clear_buffer (midiout);
-
-	//go through the list of led requests
-	while (pull_from_list(&dest, &row, &col, &on_off)) {
+	for (s = 0; s < map->nb_surfaces; s++) {
+		// define midi out port of the surface to write to
+		midiout = jack_port_get_buffer (map->surface[s].output_port, nframes);
 
-		// if this is a filename led
-		// copy midi event required to light led into midi buffer
-		if (dest == NAMES) memcpy (buffer, &filename[row].led [col][on_off][0], 3);
-		// copy midi event required to light led into midi buffer
-		if (dest == FCT) memcpy (buffer, &filefunct[row].led [col][on_off][0], 3);
+		// clear midi write buffer
+		jack_midi_clear_buffer (midiout);
 
-		// if buffer is not empty, then send as midi out event
-		// we take care of writing led events at different time marks to make sure all of these are taken into account
-		if (buffer [0] | buffer [1] | buffer [2]) {
-			jack_midi_event_write (midiout, 0, buffer, 3);
-		}
+		// send pending led requests to the surface, within the bandwidth budget of the surface
+		led_schedule (&map->surface[s], midiout, nframes);
 	}
 
+	// cycle is complete: mapping read at the start of the cycle is not used any more
+	__atomic_add_fetch (&process_cycle, 1, __ATOMIC_RELEASE);
+
 
 	return 0;
 }
 
 
-// process callback called to process midi_in events in realtime
-int midi_in_process (jack_midi_event_t *event, jack_nframes_t nframes) {
+// process callback called to process midi_in events of a surface in realtime
+// the function controlled by the event is given by the lookup table of the surface
+int midi_in_process (surface_t *surf, jack_midi_event_t *event) {
+
+	unsigned short code;
+
+	// only events with a status byte and a data byte can control a function
+	if ((event->size < 2) || !(event->buffer[0] & 0x80)) return 0;
+
+	// get function assigned to the event, if any
+	code = surf->dispatch [event->buffer[0] & 0x7F][event->buffer[1] & 0x7F];
+	if (code == NO_FUNCTION) return 0;
+
+	// call function processing, with the value of the event (3rd byte) for faders
+	return function_process ((code >> 8) & 0x0F, (code >> 4) & 0x0F, code & 0x0F, (event->size >= 3) ? event->buffer[2] : 0);
+}
+
+
+// move to tick while playing: state of channels at tick is restored by player; when stopped, next PLAY starts from tick
+static void seek (int tick)
+{
+	if (!is_play) {
+		cue_tick = tick;
+		return;
+	}
+	player_seek (eng, tick);
+	parts_notes_off (TRUE);
+}
+
+
+// process callback called to process a function (pad, fader) of a surface in realtime
+// dest is NAMES, FCT or FADERS; row and col give the function; value is the value of faders (0-127)
+int function_process (int dest, int row, int col, int value) {
 
 	int i,j;
-	int k,l;
+	mapping_t *map;
+
+	// player not created yet (startup): function is ignored
+	if (eng == NULL) return 0;
 
 
 	// check if play pad has been pressed
-	if (same_event(event->buffer,filename[0].ctrl[PLAY])) {
+	if ((dest == NAMES) && (row == 0) && (col == PLAY)) {
 		// toggle is_play value from ON to OFF (TRUE to FALSE)
 		is_play = (is_play == TRUE) ? FALSE : TRUE;
 
@@ -132,10 +230,15 @@ int midi_in_process (jack_midi_event_t *event, jack_nframes_t nframes) {
 		if (is_play) {
 			// init clock sending to indicate PLAY has been pressed
 			send_clock = CLOCK_PLAY_READY;
-			// rewind to the beggining of the file
-			fluid_player_seek (player, 0);
+			// rewind to the beggining of the file, or to the position set while stopped
+			player_seek (eng, cue_tick);
+			// count-in bars are clicked before the song starts
+			map = __atomic_load_n (&mapping, __ATOMIC_ACQUIRE);
+			player_count_in (eng, map->count_in);
+			cue_tick = 0;
+			parts_notes_off (TRUE);
 			// play the midi files, if any
-			if (fluid_player_play (player) == FLUID_FAILED) {
+			if (player_play (eng) == FLUID_FAILED) {
 				// no file to play; force is_play to FALSE
 				is_play = FALSE;
 			}
@@ -143,44 +246,45 @@ int midi_in_process (jack_midi_event_t *event, jack_nframes_t nframes) {
 		else
 		{
 			// stop the midi files, if any
-			fluid_player_stop (player);
+			player_stop (eng);
+			parts_notes_off (FALSE);
 		}
 
 		// set play led according to play value
 		led_filename (0, PLAY, is_play);
+		// main thread watches load only while playing
+		wakeup_main ();
 	}
 
 
 	// check if "load files" pad has been pressed
-	if (same_event(event->buffer,filename[0].ctrl[LOAD])) {
+	if ((dest == NAMES) && (row == 0) && (col == LOAD)) {
 		// set LOAD value to TRUE; it will be set back to false in the main thread, when files are actually loaded 
 		is_load=TRUE;
 		// set load led according to load value
 		led_filename (0, LOAD, is_load);
+		// wake up main thread to load files straight away
+		wakeup_main ();
 	}
 
 
 	// check if midi filename pads have been pressed
 	// check midi file name and SF2 file name
-	for (i=0; i<NB_NAMES; i++) {
-		// check all bits in name, and set status accordingly
-		for (j=B0; j<B7+1; j++) {
-			if (same_event(event->buffer,filename[i].ctrl[j])) {
-				// if status == 1 (ON), then set to 0 (OFF); if == 0, set to 1
-				filename[i].status[j] = (filename[i].status[j] == ON) ? OFF : ON;
-				// light/unlight corresponding led
-				led_filename (i, j, filename[i].status[j]);
-			}
-		}
+	// check all bits in name, and set status accordingly
+	if ((dest == NAMES) && (row < NB_NAMES) && (col >= B0) && (col <= B7)) {
+		// if status == 1 (ON), then set to 0 (OFF); if == 0, set to 1
+		filename[row].status[col] = (filename[row].status[col] == ON) ? OFF : ON;
+		// light/unlight corresponding led
+		led_filename (row, col, filename[row].status[col]);
 	}
 	
 	// PROCESS FILE FUNCTIONS : VOL -/+, BPM -/+
 	// check if volume down pad has been pressed
-	if (same_event(event->buffer,filefunct[0].ctrl[VOLDOWN])) {
-		// set VOLUME value to TRUE; it will be set back to false in the main thread, where volume is actually set
-		is_volume=TRUE;
+	if ((dest == FCT) && (row == 0) && (col == VOLDOWN)) {
 		// adjust volume: decrements until is reaches 0
 		volume = (volume <= 0) ? 0 : (volume - 1);
+		// set gain to reach; gain is actually set by smoothing in process callback
+		gain_target = (float) volume / 10.0f;
 
 		// if volume == 0, then light on volume down pad to indicate we have reached the lower limit
 		if (volume == 0) {
@@ -202,11 +306,11 @@ int midi_in_process (jack_midi_event_t *event, jack_nframes_t nframes) {
 	}
 
 	// check if volume up pad has been pressed
-	if (same_event(event->buffer,filefunct[0].ctrl[VOLUP])) {
-		// set VOLUME value to TRUE; it will be set back to false in the main thread, where volume is actually set
-		is_volume=TRUE;
+	if ((dest == FCT) && (row == 0) && (col == VOLUP)) {
 		// adjust volume: increments until is reaches 1
 		volume = (volume >= 10) ? 10 : (volume + 1);
+		// set gain to reach; gain is actually set by smoothing in process callback
+		gain_target = (float) volume / 10.0f;
 
 		// if volume == 10, then light on volume up pad to indicate we have reached the higher limit
 		if (volume == 10) {
@@ -229,19 +333,21 @@ int midi_in_process (jack_midi_event_t *event, jack_nframes_t nframes) {
 	}
 
 	// check if BPM down pad has been pressed
-	if (same_event(event->buffer,filefunct[0].ctrl[BPMDOWN])) {
+	if ((dest == FCT) && (row == 0) && (col == BPMDOWN)) {
 
 		// get initial BPM, in case we don't have it yet
 		if (initial_bpm == -1) {
-			initial_bpm = (fluid_player_get_bpm (player) == FLUID_FAILED) ? 0 : fluid_player_get_bpm (player);
+			initial_bpm = (player_get_bpm (eng) == FLUID_FAILED) ? 0 : player_get_bpm (eng);
 		}
 
 		// get bpm of the file
-		bpm = (fluid_player_get_bpm (player) == FLUID_FAILED) ? 0 : fluid_player_get_bpm (player);
+		bpm = (player_get_bpm (eng) == FLUID_FAILED) ? 0 : player_get_bpm (eng);
 
 		// adjust tempo: decrements until is reaches 0
 		bpm = (bpm <= 0) ? 0 : (bpm - 2);
-		fluid_player_set_tempo (player, FLUID_PLAYER_TEMPO_EXTERNAL_BPM, bpm);
+		player_set_tempo (eng, FLUID_PLAYER_TEMPO_EXTERNAL_BPM, bpm);
+		// pads set the tempo straight away: no smoothing required
+		tempo = tempo_target = (float) bpm;
 
 		// if bpm == 0, then light on bpm down pad to indicate we have reached the lower limit
 		if (bpm == 0) {
@@ -263,19 +369,21 @@ int midi_in_process (jack_midi_event_t *event, jack_nframes_t nframes) {
 	}
 
 	// check if BPM up pad has been pressed
-	if (same_event(event->buffer,filefunct[0].ctrl[BPMUP])) {
+	if ((dest == FCT) && (row == 0) && (col == BPMUP)) {
 
 		// get initial BPM, in case we don't have it yet
 		if (initial_bpm == -1) {
-			initial_bpm = (fluid_player_get_bpm (player) == FLUID_FAILED) ? 0 : fluid_player_get_bpm (player);
+			initial_bpm = (player_get_bpm (eng) == FLUID_FAILED) ? 0 : player_get_bpm (eng);
 		}
 
 		// get bpm of the file
-		bpm = (fluid_player_get_bpm (player) == FLUID_FAILED) ? 0 : fluid_player_get_bpm (player);
+		bpm = (player_get_bpm (eng) == FLUID_FAILED) ? 0 : player_get_bpm (eng);
 
 		// adjust tempo: increments until it reaches 60000000
 		bpm = (bpm >= 60000000) ? 60000000 : (bpm + 2);
-		fluid_player_set_tempo (player, FLUID_PLAYER_TEMPO_EXTERNAL_BPM, bpm);
+		player_set_tempo (eng, FLUID_PLAYER_TEMPO_EXTERNAL_BPM, bpm);
+		// pads set the tempo straight away: no smoothing required
+		tempo = tempo_target = (float) bpm;
 
 		// if bpm == 60000000, then light on bpm up pad to indicate we have reached the higher limit
 		if (bpm == 60000000) {
@@ -297,43 +405,300 @@ int midi_in_process (jack_midi_event_t *event, jack_nframes_t nframes) {
 	}
 
 	// check if BEAT pad has been pressed
-	if (same_event(event->buffer,filefunct[0].ctrl[BEAT])) {
+	if ((dest == FCT) && (row == 0) && (col == BEAT)) {
 		beat_process ();
 	}
+
+	// check if next or previous pad has been pressed: load next or previous entry of setlist
+	// this is ignored while playing, as files can only be loaded when player is stopped
+	if ((dest == FCT) && (row == 0) && ((col == NEXT) || (col == PREV)) && !is_play) {
+		map = __atomic_load_n (&mapping, __ATOMIC_ACQUIRE);
+		i = setlist_index + ((col == NEXT) ? 1 : -1);
+		if ((i >= 0) && (i < map->nb_setlist)) {
+			setlist_index = i;
+			function_process (COMMANDS, 4, CMD_LOAD, map->setlist [i][0] | (map->setlist [i][1] << 8) | (map->setlist_bank [i][0] << 16) | (map->setlist_bank [i][1] << 24));
+		}
+	}
+
+	// check if back or forward pad has been pressed: jump some bars back or forward, to the start of a bar
+	if ((dest == FCT) && (row == 0) && ((col == BACK) || (col == FORWARD))) {
+		map = __atomic_load_n (&mapping, __ATOMIC_ACQUIRE);
+		i = player_bar_at (eng, is_play ? player_get_current_tick (eng) : cue_tick);
+		seek (player_bar_tick (eng, i + ((col == FORWARD) ? map->seek_bars : -map->seek_bars)));
+	}
+
+	// check if loop pad has been pressed: a first press punches in the bar played, a second press sets loop region up to
+	// the end of the bar played then; while looping, it releases loop at next region end, or takes release back
+	if ((dest == FCT) && (row == 0) && (col == LOOP)) {
+		i = player_bar_at (eng, is_play ? player_get_current_tick (eng) : cue_tick);
+		switch (player_get_region (eng)) {
+		case REGION_ON:
+			player_release_region (eng, TRUE);
+			break;
+		case REGION_RELEASE:
+			player_release_region (eng, FALSE);
+			break;
+		default:
+			if (eng->punch_bar < 0) eng->punch_bar = i;
+			else {
+				j = (i < eng->punch_bar) ? i : eng->punch_bar;
+				player_set_region (eng, j, ((i > eng->punch_bar) ? i : eng->punch_bar) - j + 1);
+				eng->punch_bar = -1;
+			}
+		}
+	}
+
+	// check if bank pad has been pressed: banks of songs and of soundfonts are set to the numbers set by the name pads of
+	// song and of soundfont (numbers from MAX_BANKS leave bank as it is); names of files in these banks are then set as usual
+	if ((dest == FCT) && (row == 0) && (col == BANK)) {
+		i = name_to_byte (&filename [0]);
+		j = name_to_byte (&filename [1]);
+		if (i < MAX_BANKS) song_bank = i;
+		if (j < MAX_BANKS) sf2_bank = j;
+	}
+
+	// PROCESS FADERS : VOLUME, TEMPO
+	// faders are CC messages: value is the 3rd byte of the message
+	// check if volume fader has been moved
+	if ((dest == FADERS) && (col == FADER_VOLUME)) {
+		// set gain to reach: 0 < gain < 1.0; gain is actually set by smoothing in process callback
+		gain_target = (float) value / 127.0f;
+		// set volume to the closest step, so volume pads continue from the fader position
+		volume = (int) lroundf (gain_target * 10.0f);
+
+		// light volume pads the same way as when volume pads are pressed
+		if (volume == 0) {
+			led_filefunct (0, VOLDOWN, ON);
+			led_filefunct (0, VOLUP, OFF);
+		}
+		else if (volume == 10) {
+			led_filefunct (0, VOLDOWN, OFF);
+			led_filefunct (0, VOLUP, ON);
+		}
+		else if (volume == 2) {
+			led_filefunct (0, VOLDOWN, PENDING);
+			led_filefunct (0, VOLUP, PENDING);
+		}
+		else {
+			led_filefunct (0, VOLDOWN, OFF);
+			led_filefunct (0, VOLUP, OFF);
+		}
+	}
+
+	// check if tempo fader has been moved
+	if ((dest == FADERS) && (col == FADER_TEMPO)) {
+
+		// get initial BPM, in case we don't have it yet
+		if (initial_bpm == -1) {
+			initial_bpm = (player_get_bpm (eng) == FLUID_FAILED) ? 0 : player_get_bpm (eng);
+		}
+
+		// set tempo to reach, within fader range; tempo is actually set by smoothing in process callback
+		map = __atomic_load_n (&mapping, __ATOMIC_ACQUIRE);
+		tempo_target = (float) map->fader.tempo_min + ((float) value * (float) (map->fader.tempo_max - map->fader.tempo_min) / 127.0f);
+		// start smoothing from the current tempo of the file, if fader has not been used yet
+		if (tempo < 0.0f) tempo = (player_get_bpm (eng) == FLUID_FAILED) ? tempo_target : (float) player_get_bpm (eng);
+		// set bpm to the fader position, so bpm pads continue from there
+		bpm = (int) lroundf (tempo_target);
+
+		// light bpm pads the same way as when bpm pads are pressed
+		if (bpm == initial_bpm) {
+			led_filefunct (0, BPMDOWN, PENDING);
+			led_filefunct (0, BPMUP, PENDING);
+		}
+		else {
+			led_filefunct (0, BPMDOWN, OFF);
+			led_filefunct (0, BPMUP, OFF);
+		}
+	}
+
+	// COMMANDS : functions without pad, requested by control endpoint
+	// load given song and soundfont: set names as if bit pads were pressed, then do as load pad
+	if ((dest == COMMANDS) && (col == CMD_LOAD)) {
+		if ((row > NB_NAMES) && (((value >> 16) & 0xFF) < MAX_BANKS)) song_bank = (value >> 16) & 0xFF;
+		if ((row > NB_NAMES + 1) && (((value >> 24) & 0xFF) < MAX_BANKS)) sf2_bank = (value >> 24) & 0xFF;
+		for (i = 0; (i < row) && (i < NB_NAMES); i++) {
+			for (j = B0; j <= B7; j++) {
+				filename[i].status[j] = ((value >> (8 * i + j)) & 1) ? ON : OFF;
+				led_filename (i, j, filename[i].status[j]);
+			}
+		}
+		function_process (NAMES, 0, LOAD, 0);
+	}
+
+	// play or stop: do as play pad if play status has to change
+	if ((dest == COMMANDS) && (col == CMD_PLAY)) {
+		if (is_play != value) function_process (NAMES, 0, PLAY, 0);
+	}
+
+	// set tempo: same as tempo fader, without range
+	if ((dest == COMMANDS) && (col == CMD_TEMPO)) {
+		// get initial BPM, in case we don't have it yet
+		if (initial_bpm == -1) {
+			initial_bpm = (player_get_bpm (eng) == FLUID_FAILED) ? 0 : player_get_bpm (eng);
+		}
+
+		// set tempo to reach; tempo is actually set by smoothing in process callback
+		tempo_target = (float) value / 100.0f;
+		// start smoothing from the current tempo of the file, if tempo has not been set yet
+		if (tempo < 0.0f) tempo = (player_get_bpm (eng) == FLUID_FAILED) ? tempo_target : (float) player_get_bpm (eng);
+		// set bpm, so bpm pads continue from there
+		bpm = (int) lroundf (tempo_target);
+
+		// light bpm pads the same way as when bpm pads are pressed
+		if (bpm == initial_bpm) {
+			led_filefunct (0, BPMDOWN, PENDING);
+			led_filefunct (0, BPMUP, PENDING);
+		}
+		else {
+			led_filefunct (0, BPMDOWN, OFF);
+			led_filefunct (0, BPMUP, OFF);
+		}
+	}
+
+	// move to a position in the song, or to the start of a bar
+	if ((dest == COMMANDS) && (col == CMD_SEEK)) {
+		seek (value);
+	}
+	if ((dest == COMMANDS) && (col == CMD_BAR)) {
+		seek (player_bar_tick (eng, value));
+	}
+
+	// set loop region, or release it at next region end
+	if ((dest == COMMANDS) && (col == CMD_LOOP)) {
+		if (value < 0) player_release_region (eng, TRUE);
+		else if (player_set_region (eng, value >> 16, value & 0xFFFF) == FLUID_OK) eng->punch_bar = -1;
+	}
+
+	// select bank of songs or of soundfonts: names set by pads are then looked up in this bank
+	if ((dest == COMMANDS) && (col == CMD_BANK)) {
+		if ((value >= 0) && (value < MAX_BANKS)) {
+			if (row == 0) song_bank = value;
+			else sf2_bank = value;
+		}
+	}
+
+	return 0;
+}
+
+
+// fluidsynth render callback, called by fluidsynth audio driver (jack) in its realtime thread
+// data is the synth
+int render_process (void *data, int len, int nfx, float *fx[], int nout, float *out[]) {
+
+	struct timespec start, end, deadline;
+	engine_t *eng_render;
+	int result;
+
+	// first cycle: pin thread to its core, and lock its stack
+	if (!is_render_setup) {
+		rt_setup_thread (RT_RENDER);
+		is_render_setup = TRUE;
+	}
+
+	// gain and notes off asked by process callback, notes released by load governor, then render block, timed for governor
+	parts_sync (0, (fluid_synth_t *) data);
+	governor_shed ((fluid_synth_t *) data, 0);
+	clock_gettime (CLOCK_MONOTONIC, &start);
+	// compiled song: its sequencer is stepped while rendering, and clicks beats at their frame in this cycle
+	eng_render = __atomic_load_n (&engine, __ATOMIC_ACQUIRE);
+	click_render_start ();
+	result = player_render (eng_render, (fluid_synth_t *) data, len, nfx, fx, nout, out);
+
+	// parts have been started by player: they are mixed in once done
+	if (nb_parts > 1) {
+		deadline = start;
+		deadline.tv_nsec += (long) (PART_DEADLINE * 1.0e9f * (float) len / (float) sample_rate);
+		deadline.tv_sec += deadline.tv_nsec / 1000000000;
+		deadline.tv_nsec %= 1000000000;
+		parts_mix (len, nout, out, &deadline);
+	}
+	// cached song: its audio is streamed, following the position of the player, once count-in is over
+	if (!player_is_count_in (eng_render)) prerender_process (len, nout, out);
+	clock_gettime (CLOCK_MONOTONIC, &end);
+	governor_render_time ((uint64_t) (end.tv_sec - start.tv_sec) * 1000000000 + end.tv_nsec - start.tv_nsec);
+
+	return result;
+}
+
+
+// process smoothing volume and tempo towards the values requested by pads and faders
+// called once per period by the process callback: volume and tempo change with less than a period of latency,
+// and without steps (zipper noise); inside the period, fluidsynth further ramps gain of each voice block by block
+int smooth_process (jack_nframes_t nframes) {
+
+	float alpha;
+	mapping_t *map;
+
+	// synth or player is not created yet
+	if ((synth == NULL) || (eng == NULL)) return 0;
+
+	// part of the remaining distance to cover in this period (1-pole lowpass filter)
+	map = __atomic_load_n (&mapping, __ATOMIC_ACQUIRE);
+	alpha = 1.0f - expf (-((float) nframes * 1000.0f / (float) sample_rate) / map->fader.smoothing_ms);
+
+	// smooth gain
+	if (gain != gain_target) {
+		gain += (gain_target - gain) * alpha;
+		// snap to target when close enough
+		if (fabsf (gain_target - gain) < 0.001f) gain = gain_target;
+		parts_set_gain (gain);
+	}
+
+	// smooth tempo, if tempo has been set by fader
+	if ((tempo_target > 0.0f) && (tempo != tempo_target)) {
+		tempo += (tempo_target - tempo) * alpha;
+		// snap to target when close enough
+		if (fabsf (tempo_target - tempo) < 0.05f) tempo = tempo_target;
+		player_set_tempo (eng, FLUID_PLAYER_TEMPO_EXTERNAL_BPM, tempo);
+	}
+
+	return 0;
 }
 
 
-// process managing external switch and LED
+// process presses of external switch, detected by gpio thread
+// returns TRUE if switch has been pressed since last cycle
 int gpio_process () {
 
-	// get current time
-	now = micros ();
+	return __atomic_exchange_n (&gpio_beat, FALSE, __ATOMIC_ACQ_REL);
+}
+
+
+// thread managing external switch and LED; it is not realtime: reading gpio goes through pigpiod socket
+// a press of the switch is given to process callback by gpio_beat
+void *gpio_thread (void *arg) {
+
+	uint64_t time_now;
+	int led = OFF;
 
-	// test if GPIO is enabled
-	if (gpio_state == ON) {
+	rt_setup_thread (RT_GPIO);
 
-		// test switch value; if switch is pressed then value is LOW
-//		if (gpioRead (SWITCH_GPIO) == OFF) {
-		if (gpio_read (gpio_deamon, SWITCH_GPIO) == OFF) {
+	// run until GPIO is disabled
+	while (gpio_state == ON) {
+
+		// wait for switch to be pressed (value goes LOW), or for led on time
+		if (wait_for_edge (gpio_deamon, SWITCH_GPIO, FALLING_EDGE, (double) TIMEON_US / 1000000.0) == 1) {
+			time_now = micros ();
 			// anti_bounce mechanism: make sure the switch is not "bouncing", causing repeated ON-OFF in a short period
 			// no bounce if previous is 0
-			if ((previous == 0) || ((now-previous) >= ANTIBOUNCE_US))
+			if ((previous == 0) || ((time_now - previous) >= ANTIBOUNCE_US))
 			{
-				previous_led = now;			// set time when led has been put on
-//				gpioWrite (LED_GPIO, ON);	// turn LED ON
+				previous_led = time_now;	// set time when led has been put on
 				gpio_write (gpio_deamon, LED_GPIO, ON);	// turn LED ON
-				return TRUE;				// switch pressed, no bounce : exit function with press	OK
+				led = ON;
+				__atomic_store_n (&gpio_beat, TRUE, __ATOMIC_RELEASE);	// switch pressed, no bounce : press OK
 			}
 		}
 
 		// check when to turn LED off : it is turned off when led is on for more than TIMEON_US
-	    if ((now - previous_led) > TIMEON_US) {
-//			gpioWrite (LED_GPIO, OFF);	// turn LED OFF
+		if ((led == ON) && ((micros () - previous_led) > TIMEON_US)) {
 			gpio_write (gpio_deamon, LED_GPIO, OFF);	// turn LED OFF
+			led = OFF;
 		}
 	}
 
-	return FALSE;		// return false (no switch press) when: 1- no GPIO enabled; 2- switch pressed but this is a bounce
+	return NULL;
 }
 
 
@@ -342,21 +707,24 @@ int beat_process () {
 
 	uint64_t tempo_us;						// for beat management
 
+	// player not created yet (startup)
+	if (eng == NULL) return 0;
+
 	// get current time
 	now = micros ();
 
-	tempo_us = fluid_player_get_midi_tempo (player);	// get tempo per quarter note
+	tempo_us = player_get_midi_tempo (eng);	// get tempo per quarter note
 
 	// proceed only if we have a valid tempo; otherwise do nothing
 	if (tempo_us != FLUID_FAILED) {
 
 		// check if previous time is set; if not, set to a default value corresponding to current BPM
-		// fluid_player_get_midi_tempo () returns current tempo of player in us per quarter note (ie per beat)
+		// player_get_midi_tempo () returns current tempo of player in us per quarter note (ie per beat)
 		if (previous == 0) {
 			// we are here when this is the first time we press the beat button
 			// take advantage to note the initial BPM of the file, just in case
 			if (initial_bpm == -1) {
-				initial_bpm = (fluid_player_get_bpm (player) == FLUID_FAILED) ? 0 : fluid_player_get_bpm (player);
+				initial_bpm = (player_get_bpm (eng) == FLUID_FAILED) ? 0 : player_get_bpm (eng);
 			}
 
 			previous = now - tempo_us;						// set value of previous according to tempo
@@ -371,7 +739,7 @@ int beat_process () {
 		}
 		else {
 			// set new tempo
-			fluid_player_set_tempo (player, FLUID_PLAYER_TEMPO_EXTERNAL_MIDI, (double)(now-previous));
+			player_set_tempo (eng, FLUID_PLAYER_TEMPO_EXTERNAL_MIDI, (double)(now-previous));
 			previous = now;
 		}
 	}
@@ -383,26 +751,54 @@ int beat_process () {
 // into MIDI_CLOCK ticks (24 ticks per quarter note) to drive external midi systems
 int handle_tick(void *data, int tick) {
 
-	fluid_player_t* player;
+	engine_t *eng_tick;
+	int ppq;
 	int index_pulse;
 	int i;
 	float ppq_per_midi_clock;
 	int end_tick, et1, et2, et3;
+	int sf2_id;
+
+	// position of the player, followed by the audio of a cached song
+	prerender_tick (tick);
+
+	// define data as being a pointer to the engine of the player
+	eng_tick = (engine_t*) data;
 
-	// define data as being a pointer to player
-	player = (fluid_player_t*) data;
+	// midi file played by fluidsynth player has crossed the end of its loop region: it is moved back to region start
+	if (player_region_tick (eng_tick, tick)) return FLUID_OK;
+	// midi file played by fluidsynth player: beats are clicked by tick callback (sequencer clicks compiled songs itself)
+	if (eng_tick->seq == NULL) click_tick (eng_tick, tick);
+	ppq = eng_tick->ppq;
 	// number of pulse per midi_clock event
 	ppq_per_midi_clock = ppq / 24.0;
 	// index of pulse within quarter note
 	index_pulse = tick % ppq;
 
+	// soundfont swap requested by main thread: re-bind programs to new soundfont at next boundary (beat or bar)
+	// this runs in synth thread, between 2 midi events: notes played from now on use the new soundfont
+	if (__atomic_load_n (&sf2_swap, __ATOMIC_ACQUIRE) != -1) {
+		if (swap_from == -1) swap_from = tick;
+		else if ((tick / sf2_swap_ticks) != (swap_from / sf2_swap_ticks)) {
+			// main thread may complete the swap itself if player has stopped
+			sf2_id = __atomic_exchange_n (&sf2_swap, -1, __ATOMIC_ACQ_REL);
+			if (sf2_id != -1) {
+				parts_rebind (sf2_id);
+				// main thread unloads previous soundfont
+				wakeup_main ();
+			}
+			swap_from = -1;
+		}
+	}
+	else swap_from = -1;
+
 	// make sure the song ends on a exact beat... not in the middle of a beat
 	// division shall be integer division so remaining is lost and we have an exact multiple of ppq
 	// why "+1" ??? suppose PPQ= 120; in case total tick of song is 119 (stop on exact beat), then end_tick will be 120
 	// and condition will never be met (clean loop /stop)
 	// in case total tick of song is 120 (not so clean stop), then we will skip the last tick (#120)
 	// same if song length is 125: we will skip the last 5 ticks.
-	end_tick = (fluid_player_get_total_ticks (player) + 1) / ppq;
+	end_tick = (player_get_total_ticks (eng_tick) + 1) / ppq;
 	end_tick *= ppq; 	// here, end_tick shall contain the tick value of real song end
 	// we should not send clock signals if tick is greater or equal to end_tick... so we stop at end of last beat, and could loop properly
 	if (tick >= end_tick) {
@@ -5,8 +5,12 @@
  */
 
 int process ( jack_nframes_t, void *);
-int midi_in_process (jack_midi_event_t *, jack_nframes_t);
+int midi_in_process (surface_t *, jack_midi_event_t *);
+int function_process (int, int, int, int);
+int smooth_process (jack_nframes_t);
+int render_process (void *, int, int, float *[], int, float *[]);
 int gpio_process ();
+void *gpio_thread (void *);
 int beat_process ();
 int handle_tick(void *, int);
 
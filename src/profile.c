@@ -0,0 +1,98 @@
+/** @file profile.c
+ *
+ * @brief Calibration profile: synthesis settings (interpolation, polyphony, reverb, chorus, number of cores used for
+ * rendering) chosen by the calibration benchmark on this device, for a sample rate and a period of jack.
+ * Profile is written by synthi_calibrate.a, and applied by synthi at startup if jack runs with the same sample rate and period.
+ *
+ */
+
+#include "types.h"
+#include "globals.h"
+#include "profile.h"
+#include "utils.h"
+
+
+// read profile from file name; returns EXIT_FAILURE if there is no profile, or if it is not complete
+int profile_read (char *name, profile_t *profile)
+{
+	config_t cfg;
+	double value;
+	int result;
+
+	memset (profile, 0, sizeof (profile_t));
+	if (name [0] == 0) return EXIT_FAILURE;
+
+	config_init(&cfg);
+	if(! config_read_file(&cfg, name))
+	{
+		config_destroy(&cfg);
+		return EXIT_FAILURE;
+	}
+
+	result = config_lookup_int (&cfg, "sample_rate", &profile->sample_rate) && config_lookup_int (&cfg, "period", &profile->period)
+		&& config_lookup_int (&cfg, "interpolation", &profile->interpolation) && config_lookup_int (&cfg, "polyphony", &profile->polyphony)
+		&& config_lookup_bool (&cfg, "reverb", &profile->reverb) && config_lookup_bool (&cfg, "chorus", &profile->chorus)
+		&& config_lookup_int (&cfg, "cpu_cores", &profile->cpu_cores);
+	if (config_lookup_float (&cfg, "p99", &value)) profile->p99 = (float) value;
+	if (config_lookup_float (&cfg, "max", &value)) profile->max = (float) value;
+	config_destroy(&cfg);
+
+	if (!result || (profile->polyphony < 1) || (profile->cpu_cores < 1)) return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+
+// add a setting to root of cfg
+static config_setting_t *add_setting (config_t *cfg, char *name, int type)
+{
+	return config_setting_add (config_root_setting (cfg), name, type);
+}
+
+
+// write profile in file name, atomically
+int profile_write (char *name, profile_t *profile)
+{
+	config_t cfg;
+	int result;
+
+	config_init(&cfg);
+	config_setting_set_int (add_setting (&cfg, "sample_rate", CONFIG_TYPE_INT), profile->sample_rate);
+	config_setting_set_int (add_setting (&cfg, "period", CONFIG_TYPE_INT), profile->period);
+	config_setting_set_int (add_setting (&cfg, "interpolation", CONFIG_TYPE_INT), profile->interpolation);
+	config_setting_set_int (add_setting (&cfg, "polyphony", CONFIG_TYPE_INT), profile->polyphony);
+	config_setting_set_bool (add_setting (&cfg, "reverb", CONFIG_TYPE_BOOL), profile->reverb);
+	config_setting_set_bool (add_setting (&cfg, "chorus", CONFIG_TYPE_BOOL), profile->chorus);
+	config_setting_set_int (add_setting (&cfg, "cpu_cores", CONFIG_TYPE_INT), profile->cpu_cores);
+	config_setting_set_float (add_setting (&cfg, "p99", CONFIG_TYPE_FLOAT), profile->p99);
+	config_setting_set_float (add_setting (&cfg, "max", CONFIG_TYPE_FLOAT), profile->max);
+
+	result = config_write_atomic (&cfg, name);
+	config_destroy(&cfg);
+	return result;
+}
+
+
+// apply profile of map to settings, before synth is created: max polyphony of governor is lowered to the one of profile
+// returns interpolation to set on synth once created, -1 if there is no profile for current sample rate and period
+int profile_apply (mapping_t *map, fluid_settings_t *settings)
+{
+	profile_t profile;
+
+	if (profile_read (map->profile_file, &profile) == EXIT_FAILURE) return -1;
+
+	if ((profile.sample_rate != sample_rate) || (profile.period != nb_frames_per_packet)) {
+		fprintf ( stderr, "Profile %s was calibrated for %d Hz, %d frames: not used (run synthi_calibrate.a again).\n",
+			map->profile_file, profile.sample_rate, profile.period );
+		return -1;
+	}
+
+	fluid_settings_setint (settings, "synth.cpu-cores", profile.cpu_cores);
+	fluid_settings_setint (settings, "synth.reverb.active", profile.reverb);
+	fluid_settings_setint (settings, "synth.chorus.active", profile.chorus);
+	if (map->governor.max_polyphony > profile.polyphony) map->governor.max_polyphony = profile.polyphony;
+	if (map->governor.min_polyphony > map->governor.max_polyphony) map->governor.min_polyphony = map->governor.max_polyphony;
+
+	fprintf ( stderr, "Profile %s: interpolation %d, polyphony %d, reverb %s, chorus %s, %d core(s).\n", map->profile_file,
+		profile.interpolation, map->governor.max_polyphony, profile.reverb ? "on" : "off", profile.chorus ? "on" : "off", profile.cpu_cores );
+	return profile.interpolation;
+}
@@ -0,0 +1,9 @@
+/** @file profile.h
+ *
+ * @brief This file defines prototypes of functions inside profile.c
+ *
+ */
+
+int profile_read (char *, profile_t *);
+int profile_write (char *, profile_t *);
+int profile_apply (mapping_t *, fluid_settings_t *);
@@ -0,0 +1,160 @@
+/** @file rt.c
+ *
+ * @brief Realtime setup: locking and prefaulting of memory (code, stacks, samples) within a budget,
+ * cores and scheduling policies of threads. What could not be obtained is reported, synthi runs anyway.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <alloca.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "types.h"
+#include "globals.h"
+#include "rt.h"
+
+
+// realtime settings, copied from mapping at startup: mapping may be swapped when config file is reloaded
+static realtime_t rt;
+
+// memory locked so far (code and stacks), in bytes; samples are locked by fluidsynth, within RLIMIT_MEMLOCK
+static size_t locked;
+
+// failures of each thread (RT_FAIL_*), and failures already reported
+static int thread_failed [RT_NB_THREADS];
+static int thread_reported [RT_NB_THREADS];
+
+static const char *thread_name [RT_NB_THREADS] = { "process", "render", "control", "loader", "gpio", "part1", "part2", "part3" };
+
+
+// get realtime settings, and limit locked memory to budget
+void rt_init (mapping_t *map)
+{
+	struct rlimit limit;
+	rlim_t budget;
+
+	rt = map->realtime;
+	if (!rt.lock_memory || (rt.memory_budget_mb == 0)) return;
+
+	// fluidsynth locks samples as long as RLIMIT_MEMLOCK allows it: limit it to budget
+	// (processes with CAP_IPC_LOCK, eg. root, are not limited: budget then only applies to code and stacks)
+	budget = (rlim_t) rt.memory_budget_mb * 1024 * 1024;
+	if (getrlimit (RLIMIT_MEMLOCK, &limit) < 0) return;
+	if ((limit.rlim_max != RLIM_INFINITY) && (limit.rlim_max < budget)) budget = limit.rlim_max;
+	limit.rlim_cur = budget;
+	setrlimit (RLIMIT_MEMLOCK, &limit);
+}
+
+
+// return TRUE if samples shall be locked in memory by fluidsynth (synth.lock-memory)
+int rt_lock_samples ()
+{
+	return rt.lock_memory;
+}
+
+
+// lock size bytes at addr, if it fits in budget; memory is prefaulted by locking
+static int lock_in_budget (void *addr, size_t size)
+{
+	size_t total;
+
+	total = __atomic_add_fetch (&locked, size, __ATOMIC_RELAXED);
+	if ((rt.memory_budget_mb != 0) && (total > (size_t) rt.memory_budget_mb * 1024 * 1024)) {
+		__atomic_sub_fetch (&locked, size, __ATOMIC_RELAXED);
+		return FALSE;
+	}
+	if (mlock (addr, size) < 0) {
+		__atomic_sub_fetch (&locked, size, __ATOMIC_RELAXED);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+// lock and prefault code of synthi and of libraries (jack, fluidsynth...); returns EXIT_FAILURE if some code could not be locked
+int rt_lock_code ()
+{
+	FILE *f;
+	char line [PATH_LEN];
+	unsigned long start, end;
+	char perms [5];
+	int result = EXIT_SUCCESS;
+
+	if (!rt.lock_memory) return EXIT_SUCCESS;
+
+	if ((f = fopen ("/proc/self/maps", "r")) == NULL) return EXIT_FAILURE;
+
+	// lock executable mappings
+	while (fgets (line, sizeof (line), f) != NULL) {
+		if (sscanf (line, "%lx-%lx %4s", &start, &end, perms) != 3) continue;
+		if (perms [2] != 'x') continue;
+		if (!lock_in_budget ((void *) start, end - start)) result = EXIT_FAILURE;
+	}
+
+	fclose (f);
+	return result;
+}
+
+
+// prefault and lock size bytes of the stack of current thread
+static int lock_stack (size_t size)
+{
+	char *buf;
+
+	if (size == 0) return TRUE;
+
+	// touch stack below the caller, so its pages are mapped now and not at first use in a realtime cycle
+	buf = alloca (size);
+	memset (buf, 0, size);
+	return lock_in_budget (buf, size);
+}
+
+
+// set core, scheduling policy and priority of current thread, and lock its stack; role is RT_PROCESS, RT_RENDER...
+// for jack threads (process and render), jack sets the priority: only core and stack are set
+// failures are recorded, to be reported by rt_report ()
+void rt_setup_thread (int role)
+{
+	cpu_set_t cpus;
+	struct sched_param param;
+	int failed = 0;
+
+	// pin thread to its core
+	if (rt.core [role] >= 0) {
+		CPU_ZERO (&cpus);
+		CPU_SET (rt.core [role], &cpus);
+		if (pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus) != 0) failed |= RT_FAIL_CORE;
+	}
+
+	// set scheduling of threads not managed by jack
+	if ((role != RT_PROCESS) && (role != RT_RENDER)) {
+		memset (&param, 0, sizeof (param));
+		param.sched_priority = rt.priority [role];
+		if (pthread_setschedparam (pthread_self (), (rt.priority [role] > 0) ? SCHED_FIFO : SCHED_OTHER, &param) != 0) failed |= RT_FAIL_PRIORITY;
+	}
+
+	// prefault and lock stack
+	if (rt.lock_memory && !lock_stack ((size_t) rt.stack_kb * 1024)) failed |= RT_FAIL_STACK;
+
+	__atomic_or_fetch (&thread_failed [role], failed, __ATOMIC_RELAXED);
+}
+
+
+// report what could not be obtained by threads, and was not reported yet
+// called by main thread at startup, and then periodically: jack threads are set up at their first cycle
+void rt_report ()
+{
+	int i, failed;
+
+	for (i = 0; i < RT_NB_THREADS; i++) {
+		failed = __atomic_load_n (&thread_failed [i], __ATOMIC_RELAXED) & ~thread_reported [i];
+		if (failed == 0) continue;
+		thread_reported [i] |= failed;
+
+		if (failed & RT_FAIL_CORE) fprintf ( stderr, "realtime: %s thread could not be pinned to core %d.\n", thread_name [i], rt.core [i] );
+		if (failed & RT_FAIL_PRIORITY) fprintf ( stderr, "realtime: %s thread could not get priority %d.\n", thread_name [i], rt.priority [i] );
+		if (failed & RT_FAIL_STACK) fprintf ( stderr, "realtime: stack of %s thread could not be locked in memory.\n", thread_name [i] );
+	}
+}
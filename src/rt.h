@@ -0,0 +1,11 @@
+/** @file rt.h
+ *
+ * @brief This file defines prototypes of functions inside rt.c
+ *
+ */
+
+void rt_init (mapping_t *);
+int rt_lock_samples ();
+int rt_lock_code ();
+void rt_setup_thread (int);
+void rt_report ();
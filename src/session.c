@@ -0,0 +1,124 @@
+/** @file session.c
+ *
+ * @brief Session state (song and soundfont with bank, volume, tempo set by user, position, setlist entry) is saved by main thread
+ * in a small state file, and restored at startup: after a crash or a power cycle, synthi is back where it was.
+ * State file is written in a temporary file then renamed, so it is always complete, even if power is cut while writing.
+ *
+ */
+
+#include "types.h"
+#include "globals.h"
+#include "session.h"
+#include "control.h"
+#include "utils.h"
+
+
+// session last saved, so that state file is only written when session changes
+static session_t saved;
+static int is_saved = FALSE;
+
+
+// read session from state file name; returns EXIT_FAILURE if there is no state file
+int session_restore (char *name, session_t *session)
+{
+	config_t cfg;
+	double value;
+
+	// default session: as at startup without state file
+	session->song = 0;
+	session->soundfont = 0;
+	session->volume = 0.2f;
+	session->tempo = 0.0f;
+	session->tick = 0;
+	session->setlist_index = -1;
+	session->bank = 0;
+	session->sf2_bank = 0;
+
+	if (name [0] == 0) return EXIT_FAILURE;
+
+	config_init(&cfg);
+	if(! config_read_file(&cfg, name))
+	{
+		config_destroy(&cfg);
+		return EXIT_FAILURE;
+	}
+
+	config_lookup_int (&cfg, "song", &session->song);
+	config_lookup_int (&cfg, "soundfont", &session->soundfont);
+	if (config_lookup_float (&cfg, "volume", &value)) session->volume = (float) value;
+	if (config_lookup_float (&cfg, "tempo", &value)) session->tempo = (float) value;
+	config_lookup_int (&cfg, "tick", &session->tick);
+	config_lookup_int (&cfg, "setlist_index", &session->setlist_index);
+	config_lookup_int (&cfg, "bank", &session->bank);
+	config_lookup_int (&cfg, "soundfont_bank", &session->sf2_bank);
+	config_destroy(&cfg);
+
+	// check values, in case file has been edited
+	session->song &= 0xFF;
+	session->soundfont &= 0xFF;
+	if ((session->volume < 0.0f) || (session->volume > 1.0f)) session->volume = 0.2f;
+	if (session->tempo < 0.0f) session->tempo = 0.0f;
+	if (session->tick < 0) session->tick = 0;
+	if (session->setlist_index < -1) session->setlist_index = -1;
+	if ((session->bank < 0) || (session->bank >= MAX_BANKS)) session->bank = 0;
+	if ((session->sf2_bank < 0) || (session->sf2_bank >= MAX_BANKS)) session->sf2_bank = 0;
+
+	// session in file does not have to be written again
+	saved = *session;
+	is_saved = TRUE;
+	return EXIT_SUCCESS;
+}
+
+
+// add a setting to root of cfg
+static config_setting_t *add_setting (config_t *cfg, char *name, int type)
+{
+	return config_setting_add (config_root_setting (cfg), name, type);
+}
+
+
+// save current session in state file name, if it has changed since last save; called by main thread, never by realtime threads
+int session_save (char *name)
+{
+	config_t cfg;
+	state_t st;
+	session_t session;
+	int result;
+
+	if (name [0] == 0) return EXIT_SUCCESS;
+
+	// session, from the state published by process callback
+	state_read (&st);
+	memset (&session, 0, sizeof (session_t));
+	session.song = st.song;
+	session.soundfont = st.soundfont;
+	session.volume = st.volume;
+	session.tempo = st.is_tempo ? st.tempo : 0.0f;
+	session.tick = st.tick;
+	session.setlist_index = setlist_index;
+	session.bank = st.bank;
+	session.sf2_bank = st.sf2_bank;
+	if (is_saved && !memcmp (&session, &saved, sizeof (session_t))) return EXIT_SUCCESS;
+
+	config_init(&cfg);
+	config_setting_set_int (add_setting (&cfg, "song", CONFIG_TYPE_INT), session.song);
+	config_setting_set_int (add_setting (&cfg, "soundfont", CONFIG_TYPE_INT), session.soundfont);
+	config_setting_set_float (add_setting (&cfg, "volume", CONFIG_TYPE_FLOAT), session.volume);
+	config_setting_set_float (add_setting (&cfg, "tempo", CONFIG_TYPE_FLOAT), session.tempo);
+	config_setting_set_int (add_setting (&cfg, "tick", CONFIG_TYPE_INT), session.tick);
+	config_setting_set_int (add_setting (&cfg, "setlist_index", CONFIG_TYPE_INT), session.setlist_index);
+	config_setting_set_int (add_setting (&cfg, "bank", CONFIG_TYPE_INT), session.bank);
+	config_setting_set_int (add_setting (&cfg, "soundfont_bank", CONFIG_TYPE_INT), session.sf2_bank);
+
+	// write state file atomically
+	result = config_write_atomic (&cfg, name);
+	config_destroy(&cfg);
+	if (result == EXIT_FAILURE) {
+		fprintf ( stderr, "Unable to save session in %s.\n", name );
+		return EXIT_FAILURE;
+	}
+
+	saved = session;
+	is_saved = TRUE;
+	return EXIT_SUCCESS;
+}
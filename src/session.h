@@ -0,0 +1,8 @@
+/** @file session.h
+ *
+ * @brief This file defines prototypes of functions inside session.c
+ *
+ */
+
+int session_restore (char *, session_t *);
+int session_save (char *);
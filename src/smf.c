@@ -0,0 +1,613 @@
+/** @file smf.c
+ *
+ * @brief Analysis of standard midi files (SMF), and compilation of songs: done once per file change, by the scanner of
+ * the metadata cache. A compiled song is a flat array of events of fixed size, with absolute ticks and ordered by time,
+ * with a tempo map built beforehand: it is mapped in memory when the song is loaded, and played without any parsing.
+ *
+ */
+
+#include <sys/stat.h>
+#include "types.h"
+#include "smf.h"
+
+
+// read a variable length quantity at *pos; returns -1 if it goes beyond end
+static long read_varlen (unsigned char *buf, long *pos, long end)
+{
+	long value = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (*pos >= end) return -1;
+		value = (value << 7) | (buf [*pos] & 0x7F);
+		if (!(buf [(*pos)++] & 0x80)) return value;
+	}
+	return -1;
+}
+
+
+// read whole file name in memory; returns NULL if file can't be read, or is too short to be a midi file
+static unsigned char *read_file (char *name, long *size)
+{
+	FILE *f;
+	unsigned char *buf;
+
+	if ((f = fopen (name, "rb")) == NULL) return NULL;
+	fseek (f, 0, SEEK_END);
+	*size = ftell (f);
+	fseek (f, 0, SEEK_SET);
+	if ((*size < 14) || ((buf = malloc (*size)) == NULL)) {
+		fclose (f);
+		return NULL;
+	}
+	if (fread (buf, *size, 1, f) != 1) {
+		free (buf);
+		fclose (f);
+		return NULL;
+	}
+	fclose (f);
+	return buf;
+}
+
+
+// add preset (bank, program) to the presets of the song, if not in it yet
+static void add_preset (metadata_t *md, int bank, int prog)
+{
+	int i;
+
+	for (i = 0; i < md->nb_presets; i++) {
+		if ((md->preset [i][0] == bank) && (md->preset [i][1] == prog)) return;
+	}
+	if (md->nb_presets >= MAX_PRESETS) return;
+	md->preset [md->nb_presets][0] = bank;
+	md->preset [md->nb_presets][1] = prog;
+	md->nb_presets++;
+}
+
+
+// add a note event (tick, +1 for note on, -1 for note off) to the notes of the song; returns FALSE if there is no memory left
+static int add_note (int **note, long *nb, long *size, long tick, int on)
+{
+	int *bigger;
+
+	if (*nb == *size) {
+		bigger = realloc (*note, (*size + 4096) * 2 * sizeof (int));
+		if (bigger == NULL) return FALSE;
+		*note = bigger;
+		*size += 4096;
+	}
+	(*note) [2 * *nb] = (int) tick;
+	(*note) [2 * *nb + 1] = on;
+	(*nb)++;
+	return TRUE;
+}
+
+
+// order of note events: by tick, note off before note on at the same tick
+static int compare_notes (const void *a, const void *b)
+{
+	const int *na = a, *nb = b;
+
+	if (na [0] != nb [0]) return (na [0] < nb [0]) ? -1 : 1;
+	return na [1] - nb [1];
+}
+
+
+// analyze a midi file, for the metadata cache and the catalog:
+// - division (ticks per quarter note), and length in ticks (longest track)
+// - tempo map (first MAX_TEMPOS tempo events), and first time signature (numerator, and denominator as a power of 2; 4/4 by default)
+// - presets (bank, program) played by each channel: bank select and program change events, and default preset of
+//   channels playing notes before any program change; drum channel (10) uses bank 128
+// - peak polyphony: max number of notes on at the same time, all channels together
+// returns EXIT_FAILURE if file can't be read; size and mtime of md are not set
+int smf_analyze (char *name, metadata_t *md)
+{
+	unsigned char *buf;
+	long size, pos, end, len, delta, tick;
+	int bank [16], has_program [16];
+	int status, type, chan, i;
+	int is_time_sig;
+	int *note = NULL;
+	long nb_notes = 0, notes_size = 0, j;
+	int on;
+
+	if ((buf = read_file (name, &size)) == NULL) return EXIT_FAILURE;
+
+	memset (md, 0, sizeof (metadata_t));
+	md->division = (buf [12] << 8) | buf [13];
+
+	// no time signature event: 4/4
+	md->time_sig [0] = 4;
+	md->time_sig [1] = 2;
+	is_time_sig = FALSE;
+
+	// bank and program of each channel are the same across tracks
+	for (i = 0; i < 16; i++) {
+		bank [i] = (i == 9) ? 128 : 0;
+		has_program [i] = FALSE;
+	}
+
+	// go through chunks; only track chunks (MTrk) are read
+	pos = 8 + ((buf [4] << 24) | (buf [5] << 16) | (buf [6] << 8) | buf [7]);
+	while (pos + 8 <= size) {
+		len = (buf [pos + 4] << 24) | (buf [pos + 5] << 16) | (buf [pos + 6] << 8) | buf [pos + 7];
+		end = pos + 8 + len;
+		if ((len < 0) || (end > size)) end = size;
+		if (memcmp (&buf [pos], "MTrk", 4)) {
+			pos = end;
+			continue;
+		}
+		pos += 8;
+		status = 0;
+		tick = 0;
+
+		// read events of the track
+		while (pos < end) {
+			// delta time
+			if ((delta = read_varlen (buf, &pos, end)) < 0) break;
+			tick += delta;
+			if (pos >= end) break;
+
+			// status byte, or running status
+			if (buf [pos] & 0x80) status = buf [pos++];
+			if (status == 0) break;
+
+			// meta event and sysex: skip; tempo events and first time signature are read
+			if ((status == 0xFF) || (status == 0xF0) || (status == 0xF7)) {
+				type = 0;
+				if (status == 0xFF) {
+					if (pos >= end) break;
+					type = buf [pos++];		// meta event type
+				}
+				len = read_varlen (buf, &pos, end);
+				if ((len < 0) || (pos + len > end)) break;
+				if ((status == 0xFF) && (type == 0x51) && (len >= 3) && (md->nb_tempos < MAX_TEMPOS)) {
+					md->tempo [md->nb_tempos][0] = (int) tick;
+					md->tempo [md->nb_tempos][1] = (buf [pos] << 16) | (buf [pos + 1] << 8) | buf [pos + 2];
+					md->nb_tempos++;
+				}
+				if ((status == 0xFF) && (type == 0x58) && (len >= 2) && !is_time_sig) {
+					if ((buf [pos] > 0) && (buf [pos + 1] < 8)) {
+						md->time_sig [0] = buf [pos];
+						md->time_sig [1] = buf [pos + 1];
+					}
+					is_time_sig = TRUE;
+				}
+				pos += len;
+				status = 0;			// running status is cancelled by meta and sysex events
+				continue;
+			}
+
+			type = status & 0xF0;
+			chan = status & 0x0F;
+
+			// program change and channel pressure have 1 data byte, other channel messages have 2
+			if ((type == 0xC0) || (type == 0xD0)) {
+				if (pos + 1 > end) break;
+				if (type == 0xC0) {
+					add_preset (md, bank [chan], buf [pos] & 0x7F);
+					has_program [chan] = TRUE;
+				}
+				pos += 1;
+				continue;
+			}
+			if (pos + 2 > end) break;
+
+			// bank select (MSB); drum channel stays on drum bank
+			if ((type == 0xB0) && (buf [pos] == 0x00) && (chan != 9)) bank [chan] = buf [pos + 1] & 0x7F;
+
+			// note on before any program change: default preset of the channel is played
+			if ((type == 0x90) && (buf [pos + 1] != 0) && !has_program [chan]) {
+				add_preset (md, bank [chan], 0);
+				has_program [chan] = TRUE;
+			}
+
+			// notes, for polyphony (note on with velocity 0 is a note off)
+			if ((type == 0x90) || (type == 0x80)) {
+				on = ((type == 0x90) && (buf [pos + 1] != 0)) ? 1 : -1;
+				if (!add_note (&note, &nb_notes, &notes_size, tick, on)) break;
+			}
+			pos += 2;
+		}
+
+		if (tick > md->ticks) md->ticks = (int) tick;
+		pos = end;
+	}
+
+	// peak polyphony: go through notes of all tracks in time order
+	if (nb_notes > 0) {
+		qsort (note, nb_notes, 2 * sizeof (int), compare_notes);
+		on = 0;
+		for (j = 0; j < nb_notes; j++) {
+			on += note [2 * j + 1];
+			if (on < 0) on = 0;
+			if (on > md->peak_polyphony) md->peak_polyphony = on;
+		}
+	}
+
+	free (note);
+	free (buf);
+	return EXIT_SUCCESS;
+}
+
+
+// tempo at start of song, in 1/100 bpm (120 bpm if there is no tempo event at tick 0)
+int smf_start_tempo (metadata_t *md)
+{
+	if ((md->nb_tempos == 0) || (md->tempo [0][0] != 0) || (md->tempo [0][1] <= 0)) return 12000;
+	return (int) lround (6000000000.0 / (double) md->tempo [0][1]);
+}
+
+
+// event of a song being compiled, with its track and its position in track: events of all tracks are merged in this order
+typedef struct {
+	song_event_t event;
+	uint32_t track;
+	uint32_t order;
+} merge_t;
+
+// tempo change or time signature of a song being compiled
+typedef struct {
+	uint32_t tick;
+	uint32_t value;						// tempo, or time signature (numerator, denominator as a power of 2 << 8)
+	uint32_t track;
+	uint32_t order;
+} merge_meta_t;
+
+
+// order of events of a song being compiled: by tick, then by track, then by position in track (as fluidsynth player)
+static int compare_merge (const void *a, const void *b)
+{
+	const merge_t *ma = a, *mb = b;
+
+	if (ma->event.tick != mb->event.tick) return (ma->event.tick < mb->event.tick) ? -1 : 1;
+	if (ma->track != mb->track) return (ma->track < mb->track) ? -1 : 1;
+	if (ma->order != mb->order) return (ma->order < mb->order) ? -1 : 1;
+	return 0;
+}
+
+
+// order of tempo changes and time signatures, same as events
+static int compare_merge_meta (const void *a, const void *b)
+{
+	const merge_meta_t *ta = a, *tb = b;
+
+	if (ta->tick != tb->tick) return (ta->tick < tb->tick) ? -1 : 1;
+	if (ta->track != tb->track) return (ta->track < tb->track) ? -1 : 1;
+	if (ta->order != tb->order) return (ta->order < tb->order) ? -1 : 1;
+	return 0;
+}
+
+
+// make room for one more element in array of elements of size bytes; returns FALSE if there is no memory left
+static int grow (void **array, long nb, long *size, size_t bytes)
+{
+	void *bigger;
+
+	if (nb < *size) return TRUE;
+	bigger = realloc (*array, (*size + 4096) * bytes);
+	if (bigger == NULL) return FALSE;
+	*array = bigger;
+	*size += 4096;
+	return TRUE;
+}
+
+
+// update state of a channel with a channel message (status, data): state is what is sent again when seeking
+// rpn is the RPN selected by the channel (MSB << 7 | LSB), -1 if none or if NRPN is selected
+static void chase_event (song_chase_t *chase, int *rpn, uint8_t status, uint8_t *data)
+{
+	switch (status & 0xF0) {
+	case 0xB0:
+		switch (data [0]) {
+		case 6:					// data entry of RPN selected
+		case 38:
+			if ((*rpn >= 0) && (*rpn < 3)) chase->rpn [*rpn][(data [0] == 6) ? 0 : 1] = data [1];
+			break;
+		case 101:				// RPN selection (MSB, LSB)
+			*rpn = (data [1] << 7) | (((*rpn >= 0) ? *rpn : 0x3FFF) & 0x7F);
+			break;
+		case 100:
+			*rpn = (((*rpn >= 0) ? *rpn : 0x3FFF) & 0x3F80) | data [1];
+			break;
+		case 98:				// NRPN selection: data entry is not for an RPN any more
+		case 99:
+			*rpn = -1;
+			break;
+		case 121:				// reset all controllers
+			chase->cc [1] = 0;
+			chase->cc [11] = 127;
+			chase->cc [64] = chase->cc [65] = chase->cc [66] = chase->cc [67] = 0;
+			chase->pitch [0] = 0;
+			chase->pitch [1] = 64;
+			chase->pressure = 0;
+			*rpn = -1;
+			break;
+		default:
+			if ((data [0] != 96) && (data [0] != 97) && (data [0] < 120)) chase->cc [data [0]] = data [1];
+			break;
+		}
+		break;
+	case 0xC0:
+		chase->program = data [0];
+		break;
+	case 0xD0:
+		chase->pressure = data [0];
+		break;
+	case 0xE0:
+		chase->pitch [0] = data [0];
+		chase->pitch [1] = data [1];
+		break;
+	}
+}
+
+
+// build bars of compiled song, from time signatures (4/4 until the first one; a time signature starts a new bar);
+// each bar gets the state of channels at its start (before events of its first tick), its first event and its tempo
+// returns number of bars, or -1 if there is no memory left
+static long build_bars (song_header_t *header, merge_t *merge, song_tempo_t *tempo, merge_meta_t *sig, long nb_sigs, song_bar_t **bar)
+{
+	song_chase_t chase [16];
+	int rpn [16];
+	long nb = 0, size = 0, i = 0, s = 0, t = 0;
+	uint32_t tick = 0, next, length;
+	int num = 4, den = 2;
+
+	memset (chase, 0xFF, sizeof (chase));
+	for (i = 0; i < 16; i++) rpn [i] = -1;
+	i = 0;
+
+	do {
+		// time signature from this bar
+		while ((s < nb_sigs) && (sig [s].tick <= tick)) {
+			num = sig [s].value & 0xFF;
+			den = sig [s].value >> 8;
+			s++;
+		}
+		// state of channels at start of bar
+		while ((i < header->nb_events) && (merge [i].event.tick < tick)) {
+			if (merge [i].event.status != 0xF0) chase_event (&chase [merge [i].event.status & 0x0F], &rpn [merge [i].event.status & 0x0F], merge [i].event.status, merge [i].event.data);
+			i++;
+		}
+		while ((t + 1 < header->nb_tempos) && (tempo [t + 1].tick <= tick)) t++;
+
+		if (!grow ((void **) bar, nb, &size, sizeof (song_bar_t))) return -1;
+		memset (&(*bar) [nb], 0, sizeof (song_bar_t));
+		(*bar) [nb].tick = tick;
+		(*bar) [nb].event = (uint32_t) i;
+		(*bar) [nb].tempo = (uint32_t) t;
+		(*bar) [nb].time_sig [0] = num;
+		(*bar) [nb].time_sig [1] = den;
+		memcpy ((*bar) [nb].channel, chase, sizeof (chase));
+		nb++;
+
+		// next bar: after a bar of this time signature, or at next time signature
+		length = ((uint32_t) header->division * 4 * num) >> den;
+		next = tick + ((length > 0) ? length : 1);
+		if ((s < nb_sigs) && (sig [s].tick > tick) && (sig [s].tick < next)) next = sig [s].tick;
+		tick = next;
+	} while (tick < (uint32_t) header->ticks);
+
+	return nb;
+}
+
+
+// write compiled song in file: written in a temporary file, synced, then renamed
+static int write_song (char *file, song_header_t *header, merge_t *merge, song_tempo_t *tempo, song_bar_t *bar, song_sysex_t *sysex, unsigned char *sysex_data)
+{
+	char tmp [PATH_LEN];
+	FILE *f;
+	long i;
+	int result = EXIT_FAILURE;
+
+	snprintf (tmp, PATH_LEN, "%s.tmp", file);
+	if ((f = fopen (tmp, "wb")) != NULL) {
+		result = (fwrite (header, sizeof (song_header_t), 1, f) == 1) ? EXIT_SUCCESS : EXIT_FAILURE;
+		for (i = 0; (result == EXIT_SUCCESS) && (i < header->nb_events); i++) {
+			if (fwrite (&merge [i].event, sizeof (song_event_t), 1, f) != 1) result = EXIT_FAILURE;
+		}
+		if ((result == EXIT_SUCCESS) && (fwrite (tempo, sizeof (song_tempo_t), header->nb_tempos, f) == header->nb_tempos) &&
+			(fwrite (bar, sizeof (song_bar_t), header->nb_bars, f) == header->nb_bars) &&
+			((header->nb_sysex == 0) || (fwrite (sysex, sizeof (song_sysex_t), header->nb_sysex, f) == header->nb_sysex)) &&
+			((header->sysex_size == 0) || (fwrite (sysex_data, header->sysex_size, 1, f) == 1)) &&
+			(fflush (f) == 0) && (fsync (fileno (f)) == 0)) result = EXIT_SUCCESS;
+		else result = EXIT_FAILURE;
+		if (fclose (f) != 0) result = EXIT_FAILURE;
+	}
+
+	if ((result == EXIT_FAILURE) || (rename (tmp, file) < 0)) {
+		unlink (tmp);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+// compile midi file name to file: events of all tracks merged in time order, with absolute ticks; running status,
+// variable length quantities and meta events are decoded once here; tempo events make the tempo map (120 bpm at tick 0
+// if the file gives no tempo there), with the time of each tempo change; time signatures make the bars, each with the
+// state of channels at its start (chase index), so that a seek does not go through the song; other meta events are dropped
+// returns EXIT_FAILURE if file can't be read, is not a midi file, or if compiled song can't be written
+int smf_compile (char *name, char *file)
+{
+	unsigned char *buf, *sysex_data = NULL;
+	long size, pos, end, len, delta, tick;
+	merge_t *merge = NULL;
+	merge_meta_t *merge_tempo = NULL, *merge_sig = NULL;
+	song_tempo_t *tempo = NULL;
+	song_bar_t *bar = NULL;
+	song_sysex_t *sysex = NULL;
+	long nb = 0, merge_size = 0, nb_tempos = 0, tempos_size = 0, nb_sigs = 0, sigs_size = 0, nb_sysex = 0, sysex_size = 0, data_size = 0, data_len = 0;
+	song_header_t header;
+	struct stat st;
+	uint32_t track = 0, order;
+	int status, type, is_error = FALSE;
+	long i, j;
+	int result = EXIT_FAILURE;
+
+	if (stat (name, &st) < 0) return EXIT_FAILURE;
+	if ((buf = read_file (name, &size)) == NULL) return EXIT_FAILURE;
+	if (memcmp (buf, "MThd", 4) || (((buf [12] << 8) | buf [13]) == 0) || (buf [12] & 0x80)) {
+		free (buf);
+		return EXIT_FAILURE;
+	}
+
+	memset (&header, 0, sizeof (song_header_t));
+	header.magic = SONG_MAGIC;
+	header.version = SONG_VERSION;
+	header.size = st.st_size;
+	header.mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	header.division = (buf [12] << 8) | buf [13];
+
+	// go through chunks; only track chunks (MTrk) are read
+	pos = 8 + ((buf [4] << 24) | (buf [5] << 16) | (buf [6] << 8) | buf [7]);
+	while (!is_error && (pos + 8 <= size)) {
+		len = (buf [pos + 4] << 24) | (buf [pos + 5] << 16) | (buf [pos + 6] << 8) | buf [pos + 7];
+		end = pos + 8 + len;
+		if ((len < 0) || (end > size)) end = size;
+		if (memcmp (&buf [pos], "MTrk", 4)) {
+			pos = end;
+			continue;
+		}
+		pos += 8;
+		status = 0;
+		tick = 0;
+		order = 0;
+
+		// read events of the track
+		while (pos < end) {
+			// delta time
+			if ((delta = read_varlen (buf, &pos, end)) < 0) break;
+			tick += delta;
+			if (pos >= end) break;
+
+			// status byte, or running status
+			if (buf [pos] & 0x80) status = buf [pos++];
+			if (status == 0) break;
+
+			// meta event and sysex: tempo events go to tempo map, sysex messages (F0) to events
+			if ((status == 0xFF) || (status == 0xF0) || (status == 0xF7)) {
+				type = 0;
+				if (status == 0xFF) {
+					if (pos >= end) break;
+					type = buf [pos++];		// meta event type
+				}
+				len = read_varlen (buf, &pos, end);
+				if ((len < 0) || (pos + len > end)) break;
+				if ((status == 0xFF) && (type == 0x51) && (len >= 3)) {
+					if (!grow ((void **) &merge_tempo, nb_tempos, &tempos_size, sizeof (merge_meta_t))) is_error = TRUE;
+					else {
+						merge_tempo [nb_tempos].tick = (uint32_t) tick;
+						merge_tempo [nb_tempos].value = (buf [pos] << 16) | (buf [pos + 1] << 8) | buf [pos + 2];
+						merge_tempo [nb_tempos].track = track;
+						merge_tempo [nb_tempos].order = order++;
+						nb_tempos++;
+					}
+				}
+				if ((status == 0xFF) && (type == 0x58) && (len >= 2) && (buf [pos] > 0) && (buf [pos + 1] < 8)) {
+					if (!grow ((void **) &merge_sig, nb_sigs, &sigs_size, sizeof (merge_meta_t))) is_error = TRUE;
+					else {
+						merge_sig [nb_sigs].tick = (uint32_t) tick;
+						merge_sig [nb_sigs].value = buf [pos] | (buf [pos + 1] << 8);
+						merge_sig [nb_sigs].track = track;
+						merge_sig [nb_sigs].order = order++;
+						nb_sigs++;
+					}
+				}
+				if ((status == 0xF0) && (nb_sysex < MAX_SYSEX)) {
+					// data of message, without trailing F7
+					j = ((len > 0) && (buf [pos + len - 1] == 0xF7)) ? len - 1 : len;
+					while (!is_error && (data_len + j > data_size)) {
+						if (!grow ((void **) &sysex_data, data_size, &data_size, 1)) is_error = TRUE;
+					}
+					if (!is_error && grow ((void **) &sysex, nb_sysex, &sysex_size, sizeof (song_sysex_t)) && grow ((void **) &merge, nb, &merge_size, sizeof (merge_t))) {
+						memcpy (&sysex_data [data_len], &buf [pos], j);
+						sysex [nb_sysex].offset = (uint32_t) data_len;
+						sysex [nb_sysex].size = (uint32_t) j;
+						data_len += j;
+						memset (&merge [nb], 0, sizeof (merge_t));
+						merge [nb].event.tick = (uint32_t) tick;
+						merge [nb].event.status = 0xF0;
+						merge [nb].event.data [0] = nb_sysex & 0xFF;
+						merge [nb].event.data [1] = (nb_sysex >> 8) & 0xFF;
+						merge [nb].track = track;
+						merge [nb].order = order++;
+						nb++;
+						nb_sysex++;
+					}
+					else is_error = TRUE;
+				}
+				pos += len;
+				status = 0;			// running status is cancelled by meta and sysex events
+				if (is_error) break;
+				continue;
+			}
+
+			// channel message: program change and channel pressure have 1 data byte, other channel messages have 2
+			len = (((status & 0xF0) == 0xC0) || ((status & 0xF0) == 0xD0)) ? 1 : 2;
+			if (pos + len > end) break;
+			if (!grow ((void **) &merge, nb, &merge_size, sizeof (merge_t))) {
+				is_error = TRUE;
+				break;
+			}
+			memset (&merge [nb], 0, sizeof (merge_t));
+			merge [nb].event.tick = (uint32_t) tick;
+			merge [nb].event.status = status;
+			merge [nb].event.data [0] = buf [pos] & 0x7F;
+			if (len == 2) merge [nb].event.data [1] = buf [pos + 1] & 0x7F;
+			merge [nb].track = track;
+			merge [nb].order = order++;
+			nb++;
+			pos += len;
+		}
+
+		if (tick > header.ticks) header.ticks = (int32_t) tick;
+		track++;
+		pos = end;
+	}
+
+	// tempo map: tempo of file from tick 0, and time of each tempo change; last change of a tick is kept
+	if (!is_error) {
+		qsort (merge, nb, sizeof (merge_t), compare_merge);
+		qsort (merge_tempo, nb_tempos, sizeof (merge_meta_t), compare_merge_meta);
+		qsort (merge_sig, nb_sigs, sizeof (merge_meta_t), compare_merge_meta);
+		tempo = malloc ((nb_tempos + 1) * sizeof (song_tempo_t));
+		if (tempo == NULL) is_error = TRUE;
+	}
+	if (!is_error) {
+		tempo [0].tick = 0;
+		tempo [0].tempo = 500000;
+		tempo [0].time = 0;
+		header.nb_tempos = 1;
+		for (i = 0; i < nb_tempos; i++) {
+			j = header.nb_tempos - 1;
+			if (merge_tempo [i].value == 0) continue;
+			if (merge_tempo [i].tick != tempo [j].tick) {
+				j++;
+				tempo [j].tick = merge_tempo [i].tick;
+				tempo [j].time = tempo [j - 1].time + ((int64_t) (tempo [j].tick - tempo [j - 1].tick) * tempo [j - 1].tempo) / header.division;
+				header.nb_tempos++;
+			}
+			tempo [j].tempo = merge_tempo [i].value;
+		}
+
+		header.nb_events = (uint32_t) nb;
+		header.nb_sysex = (uint32_t) nb_sysex;
+		header.sysex_size = (uint32_t) data_len;
+		j = build_bars (&header, merge, tempo, merge_sig, nb_sigs, &bar);
+		if (j > 0) {
+			header.nb_bars = (uint32_t) j;
+			result = write_song (file, &header, merge, tempo, bar, sysex, sysex_data);
+		}
+	}
+
+	free (merge);
+	free (merge_tempo);
+	free (merge_sig);
+	free (tempo);
+	free (bar);
+	free (sysex);
+	free (sysex_data);
+	free (buf);
+	return result;
+}
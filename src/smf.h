@@ -0,0 +1,9 @@
+/** @file smf.h
+ *
+ * @brief This file defines prototypes of functions inside smf.c
+ *
+ */
+
+int smf_analyze (char *, metadata_t *);
+int smf_start_tempo (metadata_t *);
+int smf_compile (char *, char *);
@@ -0,0 +1,104 @@
+/** @file song.c
+ *
+ * @brief Compiled songs: each midi file of the catalog is compiled by the scanner of the metadata cache (see smf.c)
+ * in SONG_DIR, in a file named after the hash of the name of the midi file. When the song is loaded, its compiled song is
+ * mapped in memory, without any parsing, if it is up to date (same size and time of last modification as the midi file);
+ * otherwise the midi file is played by fluidsynth player, as before compiled songs existed.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "types.h"
+#include "song.h"
+#include "smf.h"
+#include "utils.h"
+
+
+// get name of compiled song of midi file name
+void song_file (char *name, char *file)
+{
+	snprintf (file, PATH_LEN, "%s%016llx.sng", SONG_DIR, (unsigned long long) hash_string (name));
+}
+
+
+// check header of compiled song against midi file (st) and size of compiled song; returns FALSE if it can't be used
+static int is_valid (song_header_t *header, size_t size, struct stat *st)
+{
+	if ((size < sizeof (song_header_t)) || (header->magic != SONG_MAGIC) || (header->version != SONG_VERSION) ||
+		(header->size != st->st_size) || (header->mtime != (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec) ||
+		(header->division <= 0) || (header->nb_tempos == 0) || (header->nb_bars == 0)) return FALSE;
+	return size >= sizeof (song_header_t) + (size_t) header->nb_events * sizeof (song_event_t) + (size_t) header->nb_tempos * sizeof (song_tempo_t) +
+		(size_t) header->nb_bars * sizeof (song_bar_t) + (size_t) header->nb_sysex * sizeof (song_sysex_t) + header->sysex_size;
+}
+
+
+// compile midi file name if its compiled song is missing or outdated; called by scanner of metadata cache
+int song_update (char *name)
+{
+	char file [PATH_LEN];
+	song_header_t header;
+	struct stat st, st_song;
+	FILE *f;
+	int is_current = FALSE;
+
+	if (stat (name, &st) < 0) return EXIT_FAILURE;
+	song_file (name, file);
+	if ((stat (file, &st_song) == 0) && ((f = fopen (file, "rb")) != NULL)) {
+		is_current = (fread (&header, sizeof (header), 1, f) == 1) && is_valid (&header, st_song.st_size, &st);
+		fclose (f);
+	}
+	if (is_current) return EXIT_SUCCESS;
+
+	mkdir (SONG_DIR, 0755);
+	if (smf_compile (name, file) == EXIT_FAILURE) {
+		fprintf ( stderr, "Unable to compile %s in %s.\n", name, file );
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+// map compiled song of midi file name in seq; returns EXIT_FAILURE if there is no up to date compiled song
+// pages of the song are read ahead: song is then played from memory
+int song_map (char *name, seq_t *seq)
+{
+	char file [PATH_LEN];
+	struct stat st, st_song;
+	void *data;
+	int fd;
+
+	if (stat (name, &st) < 0) return EXIT_FAILURE;
+	song_file (name, file);
+	if ((fd = open (file, O_RDONLY)) < 0) return EXIT_FAILURE;
+	if ((fstat (fd, &st_song) < 0) || (st_song.st_size < sizeof (song_header_t))) {
+		close (fd);
+		return EXIT_FAILURE;
+	}
+	data = mmap (NULL, st_song.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+	close (fd);
+	if (data == MAP_FAILED) return EXIT_FAILURE;
+	if (!is_valid ((song_header_t *) data, st_song.st_size, &st)) {
+		munmap (data, st_song.st_size);
+		return EXIT_FAILURE;
+	}
+
+	seq->map = data;
+	seq->map_size = st_song.st_size;
+	seq->header = data;
+	seq->event = (song_event_t *) ((char *) data + sizeof (song_header_t));
+	seq->tempo = (song_tempo_t *) (seq->event + seq->header->nb_events);
+	seq->bar = (song_bar_t *) (seq->tempo + seq->header->nb_tempos);
+	seq->sysex = (song_sysex_t *) (seq->bar + seq->header->nb_bars);
+	seq->sysex_data = (uint8_t *) (seq->sysex + seq->header->nb_sysex);
+	return EXIT_SUCCESS;
+}
+
+
+// unmap compiled song of seq
+void song_unmap (seq_t *seq)
+{
+	if (seq->map != NULL) munmap (seq->map, seq->map_size);
+	seq->map = NULL;
+}
@@ -0,0 +1,10 @@
+/** @file song.h
+ *
+ * @brief This file defines prototypes of functions inside song.c
+ *
+ */
+
+void song_file (char *, char *);
+int song_update (char *);
+int song_map (char *, seq_t *);
+void song_unmap (seq_t *);
@@ -0,0 +1,166 @@
+/** @file stretch.c
+ *
+ * @brief Time-stretch by WSOLA (waveform similarity overlap-add): segments of the stream are overlapped every STRETCH_HOP
+ * output frames, while the position in the stream moves by ratio * STRETCH_HOP; each segment is shifted (up to STRETCH_SEEK
+ * frames) to where it best matches the continuation of the previous one, so that waveforms overlap in phase.
+ * Tempo changes without pitch change. Inner loops use vectors of 4 floats (gcc vector extensions: SSE on x86, NEON on ARM; makefile enables NEON on 32-bit ARM).
+ *
+ */
+
+#include "types.h"
+#include "globals.h"
+#include "stretch.h"
+
+
+// vector of 4 floats
+typedef float v4sf __attribute__ ((vector_size (16)));
+
+
+// dot product of a and b, n being a multiple of 4; a and b don't need to be aligned
+static float dot (const float *a, const float *b, int n)
+{
+	v4sf sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4sf va, vb;
+	int i;
+
+	for (i = 0; i < n; i += 4) {
+		memcpy (&va, a + i, sizeof (v4sf));
+		memcpy (&vb, b + i, sizeof (v4sf));
+		sum += va * vb;
+	}
+	return sum [0] + sum [1] + sum [2] + sum [3];
+}
+
+
+// add window * segment to acc, n being a multiple of 4
+static void overlap_add (float *acc, const float *window, const float *segment, int n)
+{
+	v4sf va, vw, vs;
+	int i;
+
+	for (i = 0; i < n; i += 4) {
+		memcpy (&va, acc + i, sizeof (v4sf));
+		memcpy (&vw, window + i, sizeof (v4sf));
+		memcpy (&vs, segment + i, sizeof (v4sf));
+		va += vw * vs;
+		memcpy (acc + i, &va, sizeof (v4sf));
+	}
+}
+
+
+// similarity of segment with template: normalized cross-correlation (sign kept, so that opposite phase is avoided)
+static float similarity (const float *segment, const float *template, int n)
+{
+	float energy;
+
+	energy = dot (segment, segment, n);
+	return (energy > 1.0e-9f) ? dot (segment, template, n) / sqrtf (energy) : 0.0f;
+}
+
+
+// reset time-stretch at position pos of the stream: next segment is not matched to a previous one
+void stretch_reset (stretch_t *st, double pos)
+{
+	int i;
+
+	for (i = 0; i < STRETCH_FRAME; i++) st->window [i] = 0.5f - 0.5f * cosf (2.0f * (float) M_PI * (float) i / (float) STRETCH_FRAME);
+	memset (st->acc, 0, sizeof (st->acc));
+	st->nb_ready = 0;
+	st->first_ready = 0;
+	st->prev = -1;
+	st->pos = pos;
+}
+
+
+// overlap next segment of the stream: STRETCH_HOP frames are then ready; read gets frames of the stream (FALSE if they
+// are not available yet); returns FALSE if frames of the stream are missing
+static int next_segment (stretch_t *st, double ratio, stream_read_t read)
+{
+	float region [2][2 * STRETCH_SEEK + STRETCH_FRAME];
+	float mono [2 * STRETCH_SEEK + STRETCH_FRAME];
+	float template [2][STRETCH_HOP];
+	float best_sim, sim;
+	int64_t start;
+	int shift, best, from, to, i;
+
+	// stream around nominal position: segment may be shifted in it
+	start = (int64_t) st->pos - STRETCH_SEEK;
+	if (start < 0) start = 0;
+	if (!read (start, 2 * STRETCH_SEEK + STRETCH_FRAME, region [0], region [1])) return FALSE;
+
+	// best shift: segment which start matches the continuation of previous segment (mono, coarse then fine search)
+	best = (int) ((int64_t) st->pos - start);
+	if (st->prev >= 0) {
+		if (!read (st->prev + STRETCH_HOP, STRETCH_HOP, template [0], template [1])) return FALSE;
+		for (i = 0; i < STRETCH_HOP; i++) template [0][i] += template [1][i];
+		for (i = 0; i < 2 * STRETCH_SEEK + STRETCH_FRAME; i++) mono [i] = region [0][i] + region [1][i];
+
+		best_sim = -1.0e30f;
+		for (shift = 0; shift <= 2 * STRETCH_SEEK; shift += 4) {
+			sim = similarity (&mono [shift], template [0], STRETCH_HOP);
+			if (sim > best_sim) {
+				best_sim = sim;
+				best = shift;
+			}
+		}
+		from = (best > 3) ? best - 3 : 0;
+		to = (best + 3 < 2 * STRETCH_SEEK) ? best + 3 : 2 * STRETCH_SEEK;
+		for (shift = from; shift <= to; shift++) {
+			sim = similarity (&mono [shift], template [0], STRETCH_HOP);
+			if (sim > best_sim) {
+				best_sim = sim;
+				best = shift;
+			}
+		}
+	}
+
+	// overlap-add segment; first STRETCH_HOP frames are then complete
+	overlap_add (st->acc [0], st->window, &region [0][best], STRETCH_FRAME);
+	overlap_add (st->acc [1], st->window, &region [1][best], STRETCH_FRAME);
+	memcpy (st->ready [0], st->acc [0], STRETCH_HOP * sizeof (float));
+	memcpy (st->ready [1], st->acc [1], STRETCH_HOP * sizeof (float));
+	memmove (st->acc [0], &st->acc [0][STRETCH_HOP], (STRETCH_FRAME - STRETCH_HOP) * sizeof (float));
+	memmove (st->acc [1], &st->acc [1][STRETCH_HOP], (STRETCH_FRAME - STRETCH_HOP) * sizeof (float));
+	memset (&st->acc [0][STRETCH_FRAME - STRETCH_HOP], 0, STRETCH_HOP * sizeof (float));
+	memset (&st->acc [1][STRETCH_FRAME - STRETCH_HOP], 0, STRETCH_HOP * sizeof (float));
+	st->nb_ready = STRETCH_HOP;
+	st->first_ready = 0;
+
+	st->prev = start + best;
+	st->pos += ratio * STRETCH_HOP;
+	return TRUE;
+}
+
+
+// add len frames of the stream, played ratio times faster, to left and right, scaled by gain
+// returns FALSE if frames of the stream were missing (frames not output are then silent)
+int stretch_process (stretch_t *st, double ratio, int len, float *left, float *right, float gain, stream_read_t read)
+{
+	int n, i;
+
+	while (len > 0) {
+		if ((st->first_ready == st->nb_ready) && !next_segment (st, ratio, read)) return FALSE;
+		n = st->nb_ready - st->first_ready;
+		if (n > len) n = len;
+		for (i = 0; i < n; i++) {
+			left [i] += gain * st->ready [0][st->first_ready + i];
+			right [i] += gain * st->ready [1][st->first_ready + i];
+		}
+		st->first_ready += n;
+		left += n;
+		right += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+
+// first frame of the stream that time-stretch may still read: frames before it may be dropped
+int64_t stretch_oldest (stretch_t *st)
+{
+	int64_t oldest;
+
+	oldest = (int64_t) st->pos - STRETCH_SEEK;
+	if ((st->prev >= 0) && (st->prev + STRETCH_HOP < oldest)) oldest = st->prev + STRETCH_HOP;
+	return (oldest < 0) ? 0 : oldest;
+}
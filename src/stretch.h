@@ -0,0 +1,9 @@
+/** @file stretch.h
+ *
+ * @brief This file defines prototypes of functions inside stretch.c
+ *
+ */
+
+void stretch_reset (stretch_t *, double);
+int stretch_process (stretch_t *, double, int, float *, float *, float, stream_read_t);
+int64_t stretch_oldest (stretch_t *);
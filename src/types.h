@@ -29,6 +29,84 @@
 #define ANTIBOUNCE_US   250000      // 0.25 sec = 250000 usec : used for switch anti-bouncing check : allows 240BPM max
 #define TIMEON_US       200000      // 0.20 sec : used as on/off time for leds 
 
+/* period of housekeeping done by main thread, in sec */
+#define HOUSEKEEPING_S 5
+
+/* load governor: period of load checks, max number of voices looked at when releasing notes */
+#define GOVERNOR_MS 100
+#define MAX_VOICES 1024
+#define DEFAULT_GOVERNOR_HIGH 0.75f		// load above which polyphony is lowered
+#define DEFAULT_GOVERNOR_LOW 0.5f		// load under which polyphony is given back
+#define DEFAULT_MIN_POLYPHONY 32
+#define DEFAULT_MAX_POLYPHONY 256
+
+/* calibration: synthesis settings measured on device, written in a profile loaded at startup */
+#define DEFAULT_PROFILE_FILE "./synthi.profile"
+#define CALIBRATE_WARMUP_MS 200			// rendering not measured, while voices build up
+#define CALIBRATE_MS 1000				// rendering measured for each candidate setting
+#define CALIBRATE_P99 0.5f				// max part of period taken by 99% of blocks, for a setting to be safe
+#define CALIBRATE_MAX 0.75f				// max part of period taken by the slowest block
+#define CALIBRATE_MAX_CORES 4			// max number of cores tried for rendering
+
+/* max length of a file name, including directory */
+#define PATH_LEN 1000
+
+/* max number of presets (bank, program) used by a song */
+#define MAX_PRESETS 128
+
+/* soundfont swap while playing: programs are re-bound to new soundfont at next beat or bar */
+#define SWAP_BEAT 0
+#define SWAP_BAR 1
+#define SWAP_NONE 0				// no swap in progress
+#define SWAP_PENDING 1			// new soundfont is waiting for beat or bar boundary
+#define SWAP_DONE 2				// programs have been re-bound, old soundfont is unloaded
+
+/* catalog of songs and soundfonts: files of bank 0 are in ./songs/ (./soundfonts/), files of bank NN in subdirectory NN_name */
+#define MAX_BANKS 16
+#define CATALOG_FILE "catalog.cfg"		// index of a directory, rebuilt when directory has changed
+
+/* metadata cache: analysis of songs, kept in a binary file next to songs, and mapped in memory */
+#define METADATA_FILE "./songs/metadata.bin"
+#define METADATA_MAGIC 0x4D4E5953		// "SYNM"
+#define METADATA_VERSION 1
+#define MAX_TEMPOS 32					// max number of tempo changes kept for a song
+
+/* compiled songs: midi files converted to a flat array of events, mapped in memory and played by the sequencer of synthi */
+#define SONG_DIR "./songs/compiled/"	// no 2 hex digits: this directory is not a bank of songs
+#define SONG_MAGIC 0x43535953			// "SYSC"
+#define SONG_VERSION 2
+#define SONG_BLOCK 64					// frames rendered between 2 steps of the sequencer, as fluidsynth player
+#define MAX_SYSEX 65536					// max number of sysex messages in a compiled song
+#define DEFAULT_SEEK_BARS 4				// bars jumped by back and forward pads
+
+/* loop region of a song: bars played again at region end, until released */
+#define REGION_OFF 0					// no loop region, or released loop region has been played through
+#define REGION_ON 1						// region is played again at its end
+#define REGION_RELEASE 2				// song plays through at next region end
+
+/* metronome click: precomputed samples played on a dedicated audio port, and count-in before the song starts */
+#define CLICK_MS 25						// length of click samples
+#define CLICK_RING 64					// clicks queued by render thread for process callback (power of 2)
+#define MAX_COUNT_IN 2					// max number of count-in bars
+#define DEFAULT_COUNT_IN 1				// count-in bars before the song starts
+#define DEFAULT_CLICK_LEVEL 0.5f		// level of click samples (1.0 for full scale)
+
+/* pre-rendered audio of heavy songs: cache files, streaming and time-stretch */
+#define DEFAULT_PRERENDER_DIR "./cache/"
+#define PRERENDER_MAGIC 0x52505953		// "SYPR"
+#define PRERENDER_VERSION 1
+#define PRERENDER_GAIN 0.2f				// gain of synth when song is rendered; cached audio is scaled by gain / PRERENDER_GAIN
+#define PRERENDER_TAIL_S 3				// rendering goes on after end of song, for releases and reverb
+#define PRERENDER_RING 65536			// frames of cached audio streamed ahead in memory; power of 2
+#define PRERENDER_CHUNK 4096			// frames read from file at once
+#define PRERENDER_POLL_MS 5				// period of streamer thread
+#define STRETCH_FRAME 1024				// frames of each segment overlapped by time-stretch
+#define STRETCH_HOP (STRETCH_FRAME / 2)	// frames output for each segment
+#define STRETCH_SEEK 256				// max shift of a segment, in frames, to match the end of the previous one
+
+/* max number of entries of the setlist */
+#define MAX_SETLIST 128
+
 /* default soundfont file */
 #define DEFAULT_SF2 "./soundfonts/00_FluidR3_GM.sf2"
 
@@ -60,7 +138,22 @@
 #define	BPMDOWN	2
 #define	BPMUP	3
 #define BEAT	4
-#define LAST_ELT_FCT 5		// used for declarations and loops
+#define NEXT	5		// load next entry of setlist
+#define PREV	6		// load previous entry of setlist
+#define BACK	7		// jump back some bars in song
+#define FORWARD	8		// jump forward some bars in song
+#define LOOP	9		// punch in loop region, or release it at next region end
+#define BANK	10		// select banks of songs and soundfonts given by name pads
+#define LAST_ELT_FCT 11		// used for declarations and loops
+
+#define FIRST_ELT_FADER 0	// used for declarations and loops for fader struct
+#define	FADER_VOLUME 0		// continuous volume (CC fader or knob)
+#define	FADER_TEMPO 1		// continuous tempo (CC fader or knob)
+#define LAST_ELT_FADER 2	// used for declarations and loops
+
+#define DEFAULT_TEMPO_MIN 40		// default bpm range of the tempo fader
+#define DEFAULT_TEMPO_MAX 240
+#define DEFAULT_SMOOTHING_MS 30		// default time constant used to smooth volume and tempo changes
 
 /* define status, etc */
 #define TRUE 1
@@ -68,6 +161,17 @@
 
 #define NAMES 0
 #define FCT 1
+#define FADERS 2
+#define COMMANDS 3			// functions without pad, only requested by control endpoint (OSC over UDP)
+
+#define CMD_LOAD 0			// load song and soundfont given in value (song | soundfont << 8); row gives how many names are set
+							// if row is 3, bank of song is given too (bank << 16); if row is 4, bank of soundfont too (bank << 24)
+#define CMD_PLAY 1			// play if value is TRUE, stop if FALSE
+#define CMD_TEMPO 2			// set tempo; value is in 1/100 bpm
+#define CMD_SEEK 3			// move to tick given in value
+#define CMD_BANK 4			// select bank given in value: bank of songs if row is 0, of soundfonts if row is 1
+#define CMD_BAR 5			// move to start of bar given in value (0 for first bar)
+#define CMD_LOOP 6			// set loop region given in value (first bar << 16 | number of bars, 0 for first bar); release it if value is -1
 
 #define CLOCK_PLAY_READY 3
 #define	CLOCK_PLAY 2
@@ -80,8 +184,61 @@
 #define PENDING	2
 #define LAST_STATE 3		// used for declarations and loops
 
-/* list management (used for led mgmt) */
-#define LIST_ELT 100
+/* surfaces (midi control surfaces: launchpad, foot controller, keyboard...) */
+#define MAX_SURFACES 8			// max number of surfaces, ie. of midi input/output port pairs
+#define NO_FUNCTION 0xFFFF		// no function assigned to a midi event in surface lookup table
+#define FUNCTION_CODE(dest,row,col)	((unsigned short) (((dest) << 8) | ((row) << 4) | (col)))	// function assigned to a midi event
+
+/* connections of ports */
+#define MAX_CONNECTIONS 128		// max number of (server, client) port pairs to connect
+#define PORT_NAME_LEN 256		// max length of a jack port name
+
+/* surface output (used for led mgmt) */
+#define SURFACE_GENERIC 0		// surface only understands individual led messages (note on, cc...)
+#define SURFACE_SYSEX 1			// surface also accepts a bulk sysex message lighting several leds at once
+#define SYSEX_HEADER_MAX 16		// max length of the bulk led sysex header (from 0xF0 to command byte)
+#define SYSEX_BULK_MAX 80		// max number of leds in one bulk sysex message
+#define DEFAULT_BYTES_PER_MS 1	// default bandwidth of midi link to surface: 1 byte per ms, ie. 333 led messages per second
+
+/* control endpoint (OSC messages over UDP) */
+#define CONTROL_ADDRESS_LEN 64		// max length of the address the control endpoint is bound to
+#define COMMAND_RING_SIZE 256		// number of commands that can wait for process callback; power of 2
+#define MAX_SUBSCRIBERS 8			// max number of clients getting state notifications
+#define CONTROL_PUSH_MS 100			// max delay between a state change and its notification to subscribers
+#define OSC_MAX_ARGS 8				// max number of arguments read from an OSC message
+#define OSC_BUFFER_LEN 1024			// max size of OSC packets sent and received
+#define OSC_MAX_BPM 1000.0			// max tempo set by OSC
+
+
+/* parts: channels split across several synths, each rendering on its own core */
+#define MAX_PARTS 4				// main synth and up to 3 parts
+#define MAX_PART_FRAMES 4096	// max number of frames rendered by a part in one block
+#define PART_DEADLINE 0.8f		// part of period after which a part which has not rendered its block is left out of the mix
+#define PART_IDLE 0				// part waits for a block to render
+#define PART_BUSY 1				// part is rendering a block
+#define PART_DONE 2				// part has rendered its block, not mixed yet
+#define PART_QUEUE 1024			// max number of operations queued for a synth (power of 2)
+#define PART_SYSEX 64			// max size of a sysex queued for a synth; longer ones are only sent to main synth
+#define PART_EVENT 0			// operation queued for a synth: midi event
+#define PART_NOTES_OFF 1		// release all notes
+#define PART_SOUNDS_OFF 2		// stop all sounds at once
+#define PART_REBIND 3			// re-bind programs of channels to a soundfont
+#define DEFAULT_PART_PRIORITY 60	// SCHED_FIFO priority of render threads of parts
+
+
+/* realtime setup: threads which core and priority can be set */
+#define RT_PROCESS 0			// jack process callback of synthi (priority set by jack)
+#define RT_RENDER 1				// fluidsynth render, ie. jack process callback of fluidsynth (priority set by jack)
+#define RT_CONTROL 2			// control endpoint thread
+#define RT_LOADER 3				// main thread: loads files, handles requests
+#define RT_GPIO 4				// external beat switch and LED thread
+#define RT_PART 5				// render thread of part 1; part p is RT_PART + p - 1
+#define RT_NB_THREADS (RT_PART + MAX_PARTS - 1)
+#define RT_FAIL_CORE 1			// thread could not be pinned to its core
+#define RT_FAIL_PRIORITY 2		// thread could not get its scheduling policy and priority
+#define RT_FAIL_STACK 4			// stack of thread could not be prefaulted and locked
+#define DEFAULT_STACK_KB 64		// size of stack prefaulted and locked for each thread
+#define DEFAULT_MEMORY_BUDGET_MB 256	// max memory locked for code, stacks and samples
 
 
 /* types */
@@ -97,3 +254,297 @@ typedef struct {						// structure for each of the 2 names
 	unsigned char status [LAST_ELT_FCT];	// Status byte for each function
 } filefunct_t;
 
+typedef struct {						// structure for faders and knobs (continuous controls)
+	unsigned char ctrl [LAST_ELT_FADER] [2];	// CC controls on the midi control surface; value is 3rd byte of midi message
+	int tempo_min;						// bpm when tempo fader is at 0
+	int tempo_max;						// bpm when tempo fader is at 127
+	float smoothing_ms;					// time constant used to smooth volume and tempo changes
+} fader_t;
+
+typedef struct {						// structure for each midi control surface: input, output, controls and leds
+	jack_port_t *input_port;			// midi in port receiving the controls of the surface
+	jack_port_t *output_port;			// midi out port sending led messages to the surface
+	filename_t filename [NB_NAMES];		// controls and leds of the surface for filenames (status is in global filename structure)
+	filefunct_t filefunct [NB_FCT];		// controls and leds of the surface for functions (status is in global filefunct structure)
+	fader_t fader;						// controls of the surface for faders (settings are in mapping fader structure)
+	unsigned short dispatch [128][128];	// lookup table giving function code for each midi event (status byte, 1st data byte)
+	int type;							// SURFACE_GENERIC or SURFACE_SYSEX
+	unsigned char sysex [SYSEX_HEADER_MAX];	// header of bulk led sysex message; led (note, velocity) pairs and 0xF7 are appended to it
+	int sysex_len;						// length of sysex header
+	int bytes_per_ms;					// bandwidth budget of the midi link to the surface
+	float credit;						// number of bytes that can still be sent; carried over from period to period
+	unsigned char pending_filename [NB_NAMES][LAST_ELT];	// leds which state shall be (re)sent to the surface
+	unsigned char pending_filefunct [NB_FCT][LAST_ELT_FCT];	// leds which state shall be (re)sent to the surface
+} surface_t;
+
+typedef struct {						// structure for realtime setup: memory locking, cores and priorities of threads
+	int lock_memory;					// lock code, stacks and samples in memory
+	int memory_budget_mb;				// max locked memory, in MB; 0 for no limit
+	int stack_kb;						// size of stack prefaulted and locked for each thread, in kB
+	int core [RT_NB_THREADS];			// core each thread is pinned to; -1 for any core
+	int priority [RT_NB_THREADS];		// SCHED_FIFO priority of each thread; 0 for SCHED_OTHER (not used for jack threads)
+} realtime_t;
+
+typedef struct {						// structure for load governor: polyphony lowered and notes released when DSP load is high
+	int enabled;						// TRUE if governor is used
+	float high;							// load (0 to 1) above which polyphony is lowered
+	float low;							// load (0 to 1) under which polyphony is given back
+	int min_polyphony;					// polyphony is never lowered under this
+	int max_polyphony;					// polyphony when load is low; set as synth.polyphony at startup
+	int important [16];					// channels (0-based) which notes are released last, after drums (bass...)
+	int nb_important;					// number of important channels
+} governor_t;
+
+typedef struct mapping_s {			// structure for everything read from config file: surfaces and connections
+	surface_t surface [MAX_SURFACES];	// midi control surfaces
+	int nb_surfaces;					// number of surfaces in use
+	fader_t fader;						// fader settings: tempo range, smoothing (controls are in surfaces)
+	char connection [MAX_CONNECTIONS][2][PORT_NAME_LEN];	// pairs of ports (server, client) to be connected
+	int nb_connections;					// number of port pairs to be connected
+	char control_address [CONTROL_ADDRESS_LEN];	// address the control endpoint is bound to (127.0.0.1, 0.0.0.0 for LAN...)
+	int control_port;					// udp port of the control endpoint; 0 if there is no control endpoint
+	realtime_t realtime;				// memory locking, cores and priorities of threads; only used at startup
+	int lazy_loading;					// load samples of the presets played by the song only; only used at startup
+	governor_t governor;				// load governor settings; only used at startup
+	int swap_at;						// when soundfont changed while playing is used: SWAP_BEAT or SWAP_BAR
+	char session_file [PATH_LEN];		// file where session state is saved, restored at startup; empty if none
+	int prerender_polyphony;			// songs with a peak polyphony from this are pre-rendered; 0 for none
+	char prerender_dir [PATH_LEN];		// directory of pre-rendered audio files
+	char profile_file [PATH_LEN];		// file where calibration profile is written, loaded at startup; empty if none
+	int channel_part [16];				// part rendering each channel: 0 for main synth; only used at startup
+	int nb_parts;						// number of synths channels are split across, including main synth
+	int setlist [MAX_SETLIST][NB_NAMES];	// ordered list of (song, soundfont) numbers
+	int setlist_bank [MAX_SETLIST][NB_NAMES];	// banks of the song and of the soundfont of each entry of setlist
+	int nb_setlist;						// number of entries in setlist; 0 if there is no setlist
+	int seek_bars;						// bars jumped by back and forward pads
+	int count_in;						// bars of clicks played before the song starts; 0 for none
+	float click_level;					// level of click on its audio port
+	uint32_t retired_cycle;				// process cycle when the mapping has been replaced by a reloaded one
+	struct mapping_s *next;				// next retired mapping
+} mapping_t;
+
+typedef struct engine_s {				// structure for what realtime threads use to play a song: published by main thread, freed once not used
+	fluid_player_t *player;				// midi player of the song
+	int ppq;							// division of the song (ticks per quarter note)
+	int ticks_per_bar;					// length of a bar, from time signature at start of song
+	int sf2_id;							// id of sf2 file currently loaded; only used by main thread
+	char sf2 [PATH_LEN];				// full name of sf2 file currently loaded; only used by main thread
+	char song [PATH_LEN];				// full name of the midi file; empty if no song
+	int preset [MAX_PRESETS][2];		// presets (bank, program) played by the song
+	int nb_presets;						// number of presets played by the song
+	int pinned_sf2_id;					// soundfont in which presets of the song are pinned; -1 if not pinned
+	struct seq_s *seq;					// sequencer of the compiled song; NULL if the midi file is played by fluidsynth player
+	handle_midi_event_func_t callback;	// playback callback of the player, for each midi event
+	void *callback_data;
+	int region_start;					// loop region, in ticks (start of bars); region_end is 0 if there is none
+	int region_end;
+	int region_state;					// REGION_OFF, REGION_ON or REGION_RELEASE
+	int region_tick;					// last tick of fluidsynth player, to find when it crosses region end; only used by render thread
+	int punch_bar;						// bar punched in by loop pad, waiting for the end of region; -1 if none; only used by process callback
+	uint32_t retired_cycle;				// process cycle when the engine has been replaced by a new one
+	struct engine_s *next;				// next retired engine
+} engine_t;
+
+typedef struct {						// file read in memory by background loader
+	char name [PATH_LEN];				// full name of the file; empty if none
+	void *data;							// file mapped in memory
+	size_t size;						// size of file
+} prefetch_t;
+
+typedef struct {						// command requested by control endpoint, processed by process callback like a function of a surface
+	int dest;							// NAMES, FCT, FADERS or COMMANDS
+	int row;
+	int col;
+	int value;
+} command_t;
+
+typedef struct {						// state of the player, published by process callback for the control endpoint
+	int song;							// song number (midi file name byte)
+	int soundfont;						// soundfont number (SF2 file name byte)
+	int bank;							// bank of songs selected
+	int sf2_bank;						// bank of soundfonts selected
+	int play;							// is_play
+	int load;							// is_load
+	float tempo;						// bpm currently played
+	int is_tempo;						// TRUE if tempo is set by pads, fader or control endpoint (not the tempo of the file)
+	float volume;						// gain requested, from 0 to 1.0
+	int tick;							// current position in song
+	int total_ticks;					// length of song
+	int bar;							// current bar (0 for first bar)
+	int nb_bars;						// number of bars of song
+} state_t;
+
+typedef struct {						// session state, saved in state file and restored at startup
+	int song;							// song number (midi file name byte)
+	int soundfont;						// soundfont number (SF2 file name byte)
+	float volume;						// gain requested, from 0 to 1.0
+	float tempo;						// tempo set by pads, fader or control endpoint; 0 if tempo of the file is used
+	int tick;							// position in song
+	int setlist_index;					// entry of setlist loaded; -1 if none
+	int bank;							// bank of songs selected
+	int sf2_bank;						// bank of soundfonts selected
+} session_t;
+
+typedef struct {						// analysis of a song, kept in metadata cache (fixed size, as it is written in a binary file)
+	uint64_t key;						// hash of the full name of the file
+	int64_t size;						// size of the file, and time of last modification (ns): metadata is outdated if they change
+	int64_t mtime;
+	int32_t division;					// ticks per quarter note
+	int32_t ticks;						// length in ticks
+	int32_t time_sig [2];				// first time signature: numerator, and denominator as a power of 2
+	int32_t peak_polyphony;				// max number of notes on at the same time
+	int32_t nb_tempos;					// tempo map: tick, and microseconds per quarter note
+	int32_t tempo [MAX_TEMPOS][2];
+	int32_t nb_presets;					// presets played by the song: bank (128 for drums), program
+	uint8_t preset [MAX_PRESETS][2];
+} metadata_t;
+
+typedef struct {						// header of metadata cache file, followed by metadata of songs ordered by key
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;				// size of metadata_t
+	uint32_t nb;						// number of songs
+} metadata_header_t;
+
+typedef struct {						// header of compiled song, followed by events, tempo map, bars, sysex messages and their data
+	uint32_t magic;						// SONG_MAGIC
+	uint32_t version;					// SONG_VERSION
+	int64_t size;						// size and time of last modification (ns) of the midi file: compiled song is outdated if they change
+	int64_t mtime;
+	int32_t division;					// ticks per quarter note
+	int32_t ticks;						// length in ticks (longest track)
+	uint32_t nb_events;
+	uint32_t nb_tempos;
+	uint32_t nb_bars;
+	uint32_t nb_sysex;
+	uint32_t sysex_size;				// size of data of sysex messages
+	uint32_t reserved;
+} song_header_t;
+
+typedef struct {						// event of a compiled song (fixed size: song is played by a linear scan)
+	uint32_t tick;						// absolute tick; events are ordered by tick, then by track as in the midi file
+	uint8_t status;						// status byte of channel message, or 0xF0 for sysex
+	uint8_t data [3];					// data bytes; sysex: number of the message (data [0] low byte, data [1] high byte)
+} song_event_t;
+
+typedef struct {						// entry of tempo map of a compiled song
+	uint32_t tick;
+	uint32_t tempo;						// microseconds per quarter note from tick
+	int64_t time;						// time of tick from start of song, in microseconds, at the tempo of the file
+} song_tempo_t;
+
+typedef struct {						// state of a channel at the start of a bar; 0xFF for what the song has not set yet
+	uint8_t cc [128];					// controllers, but data entry, (N)RPN selection and channel mode messages
+	uint8_t program;
+	uint8_t pressure;					// channel pressure
+	uint8_t pitch [2];					// pitch bend (LSB, MSB)
+	uint8_t rpn [3][2];					// RPN 0 (pitch bend range), 1 (fine tuning), 2 (coarse tuning): data entry MSB, LSB
+} song_chase_t;
+
+typedef struct {						// bar of a compiled song, with the state of channels at its start (chase index)
+	uint32_t tick;
+	uint32_t event;						// first event at or after tick
+	uint32_t tempo;						// entry of tempo map in effect at tick
+	uint8_t time_sig [2];				// time signature: numerator, and denominator as a power of 2
+	uint8_t reserved [2];
+	song_chase_t channel [16];
+} song_bar_t;
+
+typedef struct {						// sysex message of a compiled song: data without F0 and F7
+	uint32_t offset;
+	uint32_t size;
+} song_sysex_t;
+
+typedef struct seq_s {					// sequencer playing a compiled song: stepped by render thread, controlled by process callback
+	void *map;							// compiled song mapped in memory
+	size_t map_size;
+	song_header_t *header;
+	song_event_t *event;
+	song_tempo_t *tempo;
+	song_bar_t *bar;
+	song_sysex_t *sysex;
+	uint8_t *sysex_data;
+	fluid_midi_event_t *midi;			// event given to playback callback
+	int status;							// FLUID_PLAYER_READY, FLUID_PLAYER_PLAYING or FLUID_PLAYER_DONE
+	int loop;							// number of times the song is played again at its end; -1 for ever
+	int seek_to;						// tick requested by seek; -1 if none
+	int external_tempo;					// tempo set by pads or fader, in microseconds per quarter note; 0 for tempo of file
+	int multiplier;						// multiplier of tempo of file, in 1/1000
+	int tick;							// current tick, as given to tick callback
+	int file_tempo;						// tempo of file at current tick, in microseconds per quarter note
+	double pos;							// position in ticks; only used by render thread
+	uint32_t next;						// next event to play; only used by render thread
+	uint32_t next_tempo;				// next entry of tempo map; only used by render thread
+	int is_running;						// song has been played since last stop; only used by render thread
+	int is_region_end;					// position has reached end of loop region; only used by render thread
+	int count_bars;						// count-in bars played when the song starts, set by process callback
+	int count_in;						// count-in beats left, song start included; only used by render thread (and what follows)
+	int count_total;					// count-in beats, song start included
+	int count_num;						// beats per bar of count-in
+	double count_next;					// frames to next beat of count-in
+	double count_frames;				// frames per beat of count-in
+	uint32_t click_tick;				// tick of next beat clicked; UINT32_MAX if none
+	uint32_t click_bar;					// bar of next beat clicked
+	int click_beat;						// next beat clicked, in its bar (0 for first beat)
+} seq_t;
+
+typedef struct {						// click queued by render thread for process callback
+	jack_nframes_t frame;				// frame time of the click, in the cycle rendered
+	int accent;							// TRUE for first beat of bar
+} click_t;
+
+typedef struct {						// synthesis settings chosen by calibration, for a sample rate and a period
+	int sample_rate;
+	int period;							// frames per period
+	int interpolation;					// FLUID_INTERP_*
+	int polyphony;
+	int reverb;
+	int chorus;
+	int cpu_cores;						// synth.cpu-cores
+	float p99;							// part of period taken by 99% of blocks, as measured
+	float max;							// part of period taken by the slowest block, as measured
+} profile_t;
+
+typedef struct {						// header of pre-rendered audio file, followed by frames (int16, stereo interleaved) then by index
+	uint32_t magic;						// PRERENDER_MAGIC
+	uint32_t version;					// PRERENDER_VERSION
+	int32_t sample_rate;
+	int32_t index_step;					// index gives the frame of every index_step ticks of the song
+	int64_t nb_frames;
+	int64_t nb_index;					// number of frames (int64) in index
+} prerender_header_t;
+
+typedef int (*stream_read_t) (int64_t, int, float *, float *);	// read frames of a stream (start, number, left, right)
+
+typedef struct {						// time-stretch of a stream by WSOLA (overlap of segments of the stream, shifted to match)
+	float window [STRETCH_FRAME];		// window of segments (Hann: sums to 1 with STRETCH_HOP overlap)
+	float acc [2][STRETCH_FRAME];		// overlap-add of segments; first STRETCH_HOP frames are complete after each segment
+	float ready [2][STRETCH_HOP];		// frames ready to be output
+	int nb_ready;						// number of frames in ready
+	int first_ready;					// first frame of ready not output yet
+	int64_t prev;						// start of last segment in stream; -1 if there is none
+	double pos;							// position of next segment in stream, before shift
+} stretch_t;
+
+typedef struct {						// operation queued by render thread for a synth, applied by the thread rendering it
+	uint32_t block;						// block which the operation belongs to
+	int offset;							// frame of the block where it is applied
+	int op;								// PART_EVENT, PART_NOTES_OFF, PART_SOUNDS_OFF or PART_REBIND
+	int type;							// midi event: status without channel (0xF0 for sysex)
+	int channel;
+	int param1;							// midi event: key, control, program or pitch; soundfont id for PART_REBIND
+	int param2;							// midi event: velocity or value
+	int size;							// sysex: size of data
+	uint8_t data [PART_SYSEX];			// sysex: data, without F0 and F7
+} part_op_t;
+
+typedef struct {						// entry of catalog: a song or a soundfont
+	int bank;							// bank of the file (subdirectory NN_*); 0 for files at top of directory
+	int number;							// number of the file in its bank (2 hex digits starting file name)
+	char *path;							// full name of the file
+	int division;						// songs only: ticks per quarter note
+	int ticks;							// songs only: length in ticks
+	int tempo;							// songs only: tempo at start of song, in 1/100 bpm
+	int soundfont;						// songs only: soundfont linked to song (bank << 8 | number), loaded when soundfont 00 is selected; -1 if none
+	int loop [2];						// songs only: first and last bar (1 for first bar) of loop region set at load; 0 if none
+} catalog_entry_t;
@@ -19,39 +19,26 @@ unsigned char name_to_byte (filename_t *name) {
 	
 }
 
-// in the given directory, look for filename starting with number, and return corresponding full name
-// returns FALSE if no file found, TRUE if file is found 
-int get_full_filename (char * name, unsigned char number, char * directory) {
-
-	DIR *dir;
-	struct dirent *ent;
-	char st1[3], st2[3];
-
-	// convert number into string (in lowercases and uppercases)
-	sprintf (st1, "%02x", number);
-	sprintf (st2, "%02X", number);
-	if ((dir = opendir (directory)) != NULL) {
-		/* print all the files and directories within directory */
-		while ((ent = readdir (dir)) != NULL) {
-			// check if file starts with number; allow mixing lower and upper cases
-			if (((st1[0] == ent->d_name [0]) || (st2[0] == ent->d_name [0])) && ((st1[1] == ent->d_name [1]) || (st2[1] == ent->d_name [1]))) {
-				// copy full file name (including directory) into result variable
-				strcpy (name, directory);
-				strcat (name, ent->d_name);
-				closedir (dir);
-				return TRUE;
-			}
-		}
-	// could not find a file starting with number
-	closedir (dir);
-	return FALSE;
+// write cfg in file name atomically: it is written in name.tmp, synced, then renamed to name,
+// so that name is either the previous file or the new one, even if power is cut while writing
+int config_write_atomic (config_t *cfg, char *name) {
+
+	char tmp [PATH_LEN + 4];
+	FILE *f;
+	int result = EXIT_FAILURE;
+
+	snprintf (tmp, sizeof (tmp), "%s.tmp", name);
+	if ((f = fopen (tmp, "w")) != NULL) {
+		config_write (cfg, f);
+		if ((fflush (f) == 0) && (fsync (fileno (f)) == 0)) result = EXIT_SUCCESS;
+		if (fclose (f) != 0) result = EXIT_FAILURE;
 	}
 
-	else {
-		// could not open directory
-		fprintf ( stderr, "Directory not found.\n" );
-		return FALSE;
+	if ((result == EXIT_FAILURE) || (rename (tmp, name) < 0)) {
+		unlink (tmp);
+		return EXIT_FAILURE;
 	}
+	return EXIT_SUCCESS;
 }
 
 // read PPQ from midi file 
@@ -86,49 +73,16 @@ int same_event (unsigned char * evt1, unsigned char * evt2) {
 }
 
 
-// add led request to the list of requests to be processed
-int push_to_list (int dest, int row, int col, int on_off) {
+// wake up main thread to handle a request given by a flag (is_load, is_reconnect...)
+// this does not block: it can be called from process callback and jack callbacks
+void wakeup_main () {
 
-	// add to list
-	list_buffer [list_index][0] = (unsigned char) dest;
-	list_buffer [list_index][1] = (unsigned char) row;
-	list_buffer [list_index][2] = (unsigned char) col;
-	list_buffer [list_index][3] = (unsigned char) on_off;
+	uint64_t one = 1;
 
-	// increment index and check boundaries
-	//list_index = (list_index >= LIST_ELT) ? 0; list_index++;
-	if (list_index >= LIST_ELT) {
-		fprintf ( stderr, "too many led requests in the list.\n" );
-		list_index = 0;
-	}
-	else list_index++;
+	write (wakeup_fd, &one, sizeof (one));
 }
 
 
-// pull out led request from the list of requests to be processed (FIFO style)
-// returns 0 if pull request has failed (nomore request to be pulled out)
-int pull_from_list (int *dest, int *row, int *col, int *on_off) {
-
-	// check if we have requests to be pulled; if not, leave
-	if (list_index == 0) return 0;
-
-	// remove first element from list
-	*dest = list_buffer [0][0];
-	*row = list_buffer [0][1];
-	*col = list_buffer [0][2];
-	*on_off = list_buffer [0][3];
-
-	// decrement index
-	list_index--;
-
-	// move the rest of the list 1 item backwards
-	memmove (&list_buffer[0][0], &list_buffer[1][0], list_index * 4);
-
-	return 1;
-}
-
-
-
 /// Convert seconds to microseconds
 #define SEC_TO_US(sec) ((sec)*1000000)
 /// Convert nanoseconds to microseconds
@@ -142,3 +96,16 @@ uint64_t micros() {
     uint64_t us = SEC_TO_US((uint64_t)ts.tv_sec) + NS_TO_US((uint64_t)ts.tv_nsec);
     return us;
 }
+
+
+// hash of a string, eg. a file name (FNV-1a)
+uint64_t hash_string (char *str)
+{
+	uint64_t h = 0xCBF29CE484222325ULL;
+
+	while (*str) {
+		h ^= (unsigned char) *str++;
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
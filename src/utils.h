@@ -5,9 +5,9 @@
  */
 
 unsigned char name_to_byte (filename_t *);
-int get_full_filename (char *, unsigned char, char *);
+int config_write_atomic (config_t *, char *);
 int get_division (char *);
 int same_event (unsigned char *, unsigned char *);
-int push_to_list (int, int , int , int);
-int pull_from_list (int *, int *, int *, int *);
+void wakeup_main ();
 uint64_t micros();
+uint64_t hash_string (char *);
@@ -34,11 +34,15 @@ else
 # launch synthi + boocli
 	export JACK_NO_AUDIO_RESERVATION=1
 	jackd --realtime --realtime-priority 70 --port-max 30 --silent -d alsa --device $device --nperiods 3 --rate 48000 --period 128 &
-	sleep 5
+	# wait for jack server to be up, instead of a fixed delay
+	jack_wait -w
+	# synthi starts as soon as jack is up: it loads its soundfonts in background, and connects to a2j and boocli
+	# ports as soon as they appear; its startup phases are timed on stderr (lines starting with "boot:")
+	/home/pi/synthi/synthi.a /home/pi/synthi/synthi.cfg &
+	synthi=$!
 	a2jmidid -ue &
 	sleep 5
 	/home/pi/boocli/boocli.a /home/pi/boocli/boocli.cfg &
-	sleep 5
-	/home/pi/synthi/synthi.a /home/pi/synthi/synthi.cfg
+	wait $synthi
 fi
 